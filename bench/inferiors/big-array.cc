@@ -0,0 +1,11 @@
+// Multi-MB variable, to time variable lookup
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE (8 << 20)
+#endif
+
+int main() {
+		static char big[ARRAY_SIZE];
+		for (int i = 0; i < ARRAY_SIZE; i += 4096) big[i] = i;
+		return big[0];
+}
@@ -0,0 +1,11 @@
+// Tight loop with a breakpoint target: every call to tick is a hit
+
+volatile unsigned long counter = 0;
+
+void tick(unsigned long i) {
+		counter += i;
+}
+
+int main() {
+		for (unsigned long i = 0; i < 1000000000UL; ++i) tick(i);
+}
@@ -0,0 +1,19 @@
+// Deep call stack for `finish` and `backtrace`: main -> recurse x DEPTH -> leaf
+
+#ifndef DEPTH
+#define DEPTH 2000
+#endif
+
+int leaf(int n) {
+		return n * 2;
+}
+
+int recurse(int n) {
+		if (n == 0) return leaf(n);
+		int r = recurse(n - 1);
+		return r + 1;
+}
+
+int main() {
+		return recurse(DEPTH) == DEPTH ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+// Times mdb commands on the synthetic inferiors of bench/.
+// Each scenario runs mdb with a command script twice: setup only, and
+// setup followed by <ops> timed commands. The difference, divided by
+// <ops>, is the cost of one command. Results are JSON lines
+//
+// Usage: mdb-bench <mdb> <inferior dir> [--output <file>] [--repeat <n>]
+//                  [--only <benchmark>]
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef MDB_BENCH_CUS
+#define MDB_BENCH_CUS 10000
+#endif
+
+#ifndef MDB_BENCH_DEPTH
+#define MDB_BENCH_DEPTH 2000
+#endif
+
+namespace {
+
+struct Scenario {
+    std::string name;
+    std::string inferior;
+    std::vector<std::string> setup;  // commands before the timed ones
+    std::string op;                  // the timed command, empty for startup
+    unsigned ops;
+    std::vector<std::pair<std::string, uint64_t>> params; // reported as is
+};
+
+const std::vector<Scenario> scenarios = {
+    {"startup", "bench-many-cus", {}, "", 0, {{"cus", MDB_BENCH_CUS}}},
+    {"step", "bench-long-function", {"break longFunction", "continue"}, "step", 2000, {}},
+    {"next", "bench-long-function", {"break longFunction", "continue"}, "next", 2000, {}},
+    {"finish", "bench-recursion", {"break leaf", "continue"}, "finish", 1000, {}},
+    {"backtrace", "bench-recursion", {"break leaf", "continue"}, "backtrace", 20,
+     {{"depth", MDB_BENCH_DEPTH}}},
+    {"breakpoint_hits", "bench-hot-loop", {"break tick", "continue"}, "continue", 5000, {}},
+    // `var` reads one word: this times the lookup, not the 8 MiB
+    {"variable_read", "bench-big-array", {"break main", "continue"}, "var big", 1000, {}},
+    {"next_20_displays", "bench-long-function",
+     {"break longFunction", "continue", "display v", "display v + 1", "display v * 2",
+      "display v & 0xff", "display v >> 3", "display v != 0", "display v % 7",
+      "display v - 1", "display v ^ 1", "display v | 1", "display (char)v",
+      "display (short)v", "display (int)v", "display -v", "display ~v", "display !v",
+      "display v == 3", "display v < 10", "display &v", "display *&v"},
+     "next", 2000, {{"displays", 20}}},
+};
+
+// Run <mdb> on <inferior> fed with <commands>. Return the wall time
+std::chrono::nanoseconds runMdb(const std::string &mdb, const std::string &inferior,
+                                const std::vector<std::string> &commands) {
+    std::string script;
+    for (const auto &c : commands) script += c + "\n";
+    script += "exit\n";
+
+    int fds[2];
+    if (pipe(fds) < 0) throw std::runtime_error(strerror(errno));
+
+    auto start = std::chrono::steady_clock::now();
+    auto pid = fork();
+    if (pid < 0) throw std::runtime_error(strerror(errno));
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(fds[0], STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl(mdb.c_str(), mdb.c_str(), inferior.c_str(), nullptr);
+        _exit(127);
+    }
+
+    close(fds[0]);
+    for (size_t done = 0; done < script.size();) {
+        auto n = write(fds[1], script.data() + done, script.size() - done);
+        if (n <= 0) break; // mdb gone; the exit status tells
+        done += n;
+    }
+    close(fds[1]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error("mdb failed on " + inferior);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+}
+
+// Best of <repeat> runs: the least disturbed by the rest of the machine
+std::chrono::nanoseconds bestOf(unsigned repeat, const std::string &mdb,
+                                const std::string &inferior,
+                                const std::vector<std::string> &commands) {
+    auto best = std::chrono::nanoseconds::max();
+    for (unsigned i = 0; i < repeat; ++i)
+        best = std::min(best, runMdb(mdb, inferior, commands));
+    return best;
+}
+
+std::string result(const Scenario &s, std::chrono::nanoseconds total, time_t now) {
+    std::string json = "{\"benchmark\": \"" + s.name + "\", \"inferior\": \""
+                       + s.inferior + "\", \"timestamp\": " + std::to_string(now)
+                       + ", \"ops\": " + std::to_string(s.ops)
+                       + ", \"total_ns\": " + std::to_string(total.count());
+    if (s.ops) {
+        double per_op = double(total.count()) / s.ops;
+        json += ", \"ns_per_op\": " + std::to_string(uint64_t(per_op))
+                + ", \"ops_per_sec\": " + std::to_string(per_op > 0 ? 1e9 / per_op : 0);
+    }
+    for (const auto &p : s.params)
+        json += ", \"" + p.first + "\": " + std::to_string(p.second);
+    return json + "}";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <mdb> <inferior dir> [--output <file>]"
+                  << " [--repeat <n>] [--only <benchmark>]" << std::endl;
+        return 1;
+    }
+    std::string mdb = argv[1];
+    std::string dir = argv[2];
+    std::string output, only;
+    unsigned repeat = 3;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string opt = argv[i];
+        if (opt == "--output") output = argv[i + 1];
+        else if (opt == "--repeat") repeat = std::max(1, std::stoi(argv[i + 1]));
+        else if (opt == "--only") only = argv[i + 1];
+    }
+
+    std::ofstream file;
+    if (!output.empty()) file.open(output, std::ios::app);
+
+    auto now = time(nullptr);
+    int rc = 0;
+    for (const auto &s : scenarios) {
+        if (!only.empty() && s.name != only) continue;
+        std::cerr << s.name << "..." << std::endl;
+
+        auto inferior = dir + "/" + s.inferior;
+        std::vector<std::string> commands = s.setup;
+        commands.insert(commands.end(), s.ops, s.op);
+        try {
+            auto total = bestOf(repeat, mdb, inferior, commands);
+            if (s.ops) total -= bestOf(repeat, mdb, inferior, s.setup);
+
+            auto line = result(s, std::max(total, std::chrono::nanoseconds{0}), now);
+            std::cout << line << std::endl;
+            if (file.is_open()) file << line << std::endl;
+        } catch (std::exception &e) {
+            std::cerr << s.name << ": " << e.what() << std::endl;
+            rc = 1;
+        }
+    }
+    return rc;
+}
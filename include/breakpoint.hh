@@ -21,6 +21,16 @@ public:
 
     // Get address
     intptr_t getAddress() const { return addr_; }
+
+    // Original byte replaced by int3
+    uint8_t getSavedData() const { return saved_data_; }
+
+    // Same breakpoint in a forked copy of the process memory
+    Breakpoint inheritedBy(pid_t pid) const {
+        auto bp = *this;
+        bp.pid_ = pid;
+        return bp;
+    }
 private:
     pid_t pid_; // process id
     intptr_t addr_; // id of the breakpoint
@@ -28,4 +38,13 @@ private:
     uint8_t saved_data_; // saved data byte
 };
 
+// Relocated copy of the instruction under a breakpoint. Executing it out
+// of line steps past the breakpoint without removing the int3
+struct DisplacedCopy {
+    uint64_t slot;       // address of the copy in the debuggee
+    uint8_t orig_length; // length of the original instruction
+    uint8_t copy_length; // length of the relocated instruction
+    bool is_call;        // pushes a return address that has to be fixed
+};
+
 #endif
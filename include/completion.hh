@@ -0,0 +1,52 @@
+#ifndef COMPLETION_HH
+#define COMPLETION_HH
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dwarf++.hh"
+
+#include "helper.hh"
+#include "line-index.hh"
+
+// Names the prompt completes with Tab
+enum class NameKind {
+    function,   // DWARF functions & .symtab/.dynsym functions
+    variable,   // global variables & data symbols
+    file,       // source & header basenames
+};
+
+// Sorted arrays of a program's names, one per kind, built on first use
+// from its symbols & DWARF. A prefix is found with a binary search, so a
+// keystroke costs O(log n) plus the matches returned
+class CompletionIndex {
+public:
+    CompletionIndex(const dwarf::dwarf &dw,
+                    const std::unordered_map<std::string, std::vector<Symbol>> &symbols,
+                    LineIndex &lines)
+        : dw_{dw}, symbols_{symbols}, lines_{lines} {}
+
+    CompletionIndex(const CompletionIndex &) = delete;
+    CompletionIndex &operator=(const CompletionIndex &) = delete;
+
+    // Append up to <max> names of <kind> starting with <prefix> to <out>
+    void complete(NameKind kind, const std::string &prefix, size_t max,
+                  std::vector<std::string> *out);
+
+private:
+    void build();
+
+    const dwarf::dwarf &dw_;
+    const std::unordered_map<std::string, std::vector<Symbol>> &symbols_;
+    LineIndex &lines_;
+    bool built_ {false};
+    std::vector<std::string> names_[3];     // by NameKind, sorted & unique
+};
+
+// Append the strings of sorted <names> that start with <prefix>, up to
+// <max> in all, to <out>
+void completeSorted(const std::vector<std::string> &names, const std::string &prefix,
+                    size_t max, std::vector<std::string> *out);
+
+#endif
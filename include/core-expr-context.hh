@@ -0,0 +1,36 @@
+#ifndef CORE_EXPR_CONTEXT_HH
+#define CORE_EXPR_CONTEXT_HH
+
+#include "dwarf++.hh"
+#include "core-file.hh"
+#include "helper.hh"
+
+#include <algorithm>
+
+
+// Evaluate DWARF expressions against a core dump instead of a live process
+class CoreExprContext : public dwarf::expr_context {
+public:
+		CoreExprContext(const CoreFile &core) : core_{core} { }
+
+		dwarf::taddr reg(unsigned regnum) override {
+				if (auto rd = findFpDwarfRegister(regnum))
+						return getFpRegisterValue(core_.fpRegisters(), *rd);
+				return getRegisterValue(core_.registers(),
+				                        getRegisterFromDwarfRegister(regnum));
+		}
+
+		dwarf::taddr pc() override {
+				return core_.registers().rip;
+		}
+
+		dwarf::taddr deref_size(dwarf::taddr address, unsigned size) override {
+				uint64_t value = 0;
+				core_.read(address, &value, std::min(size, 8u));
+				return value;
+		}
+private:
+		const CoreFile &core_;
+};
+
+#endif
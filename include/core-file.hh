@@ -0,0 +1,93 @@
+#ifndef CORE_FILE_HH
+#define CORE_FILE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include "fp-registers.hh"
+#include "memory-scan.hh"
+
+// ELF core dump, mmapped read-only. Memory reads are served straight
+// from the mapping, opening it only parses program headers & notes
+class CoreFile {
+public:
+    // Throw std::runtime_error if <path> isn't an x86-64 ELF core
+    explicit CoreFile(const std::string &path);
+    ~CoreFile();
+
+    CoreFile(const CoreFile &) = delete;
+    CoreFile &operator=(const CoreFile &) = delete;
+
+    // Pointer to [address, address + len) of the dumped process, nullptr
+    // if not entirely available. No copy is made
+    const uint8_t *map(uint64_t address, size_t len) const;
+
+    // Copy [address, address + len) into <buf>; memory the core omitted
+    // reads as zeroes. Return false if <address> is not mapped at all
+    bool read(uint64_t address, void *buf, size_t len) const;
+
+    // Registers of the thread that received the signal (first NT_PRSTATUS)
+    const user_regs_struct &registers() const { return regs_; }
+
+    // FP/SSE/AVX registers of the same thread (NT_X86_XSTATE, or
+    // NT_PRFPREG); all zero if the core has neither
+    const FpRegisters &fpRegisters() const { return fp_regs_; }
+
+    pid_t pid() const { return pid_; }
+
+    int signal() const { return signal_; }
+
+    // Dumped mappings (PT_LOAD segments), by address
+    std::vector<MemoryRegion> regions() const;
+
+    // Lowest address <file> was mapped at (NT_FILE), 0 if unknown
+    uint64_t loadAddress(const std::string &file) const;
+
+private:
+    // A PT_LOAD segment of the core
+    struct Segment {
+        uint64_t vaddr;
+        uint64_t memsz;
+        uint64_t offset;
+        uint64_t filesz;
+    };
+
+    // A file mapping listed in NT_FILE
+    struct FileMapping {
+        uint64_t start;
+        uint64_t end;
+        uint64_t file_offset;
+        std::string path;
+    };
+
+    // ELF header & program headers of the mapped core
+    void parse(const std::string &path);
+
+    void parseNotes(const uint8_t *notes, size_t size);
+
+    void parseFileNote(const uint8_t *desc, size_t size);
+
+    // Mapped image of a file named by NT_FILE, nullptr if unavailable
+    const uint8_t *mapFile(const std::string &path, size_t *size) const;
+
+    const uint8_t *data_{nullptr};
+    size_t size_{0};
+    std::map<uint64_t, Segment> segments_;      // keyed by end address
+    std::map<uint64_t, FileMapping> files_;     // keyed by end address
+    mutable std::map<std::string, std::pair<const uint8_t *, size_t>> file_images_;
+
+    user_regs_struct regs_{};
+    bool has_regs_{false};
+    FpRegisters fp_regs_{};
+    bool has_xstate_{false};
+    pid_t pid_{0};
+    int signal_{0};
+};
+
+#endif
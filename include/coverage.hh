@@ -0,0 +1,53 @@
+#ifndef COVERAGE_HH
+#define COVERAGE_HH
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+class Debugger;
+
+// `mdb --coverage`: line coverage without recompiling. An int3 goes on
+// every is_stmt address of the selected compilation units; each one is
+// removed on its first hit & the debuggee resumed right away, so a line
+// costs a single trap however hot it is. Threads & forked children are
+// covered too
+class CoverageRun {
+public:
+    explicit CoverageRun(Debugger &dbg) : dbg_{dbg} {}
+
+    // Plant the breakpoints in the CUs whose name contains one of
+    // <filters> (all if empty). Return the number of addresses
+    size_t plant(const std::vector<std::string> &filters);
+
+    // Run the stopped debuggee to the end. Return its exit code
+    int run();
+
+    // Write lcov tracefile <path>. False if it can't be written
+    bool writeLcov(const std::string &path) const;
+
+    // Number of lines in the selected CUs & of those executed
+    std::pair<size_t, size_t> lineCounts() const;
+
+private:
+    struct Site {
+        uint8_t original;
+        std::vector<std::pair<std::string, unsigned>> lines;  // file, line
+    };
+
+    // Put the original byte back under the int3 at <addr> in <pid>
+    void restore(pid_t pid, uint64_t addr);
+
+    Debugger &dbg_;
+    std::unordered_map<uint64_t, Site> sites_;
+    std::map<std::string, std::map<unsigned, unsigned>> hits_;  // file -> line -> hits
+    std::set<pid_t> exec_pids_;     // replaced their image: not ours anymore
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef DEBUG_INFO_HH
+#define DEBUG_INFO_HH
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dwarf++.hh"
+#include "elf++.hh"
+
+// Hex GNU build-id of <f> (.note.gnu.build-id), empty if it has none
+std::string buildId(const elf::elf &f);
+
+// Separate debug file of the executable <f> at <path>, empty if it
+// carries its own DWARF or none is found. Looked up like gdb does, in
+// each debug directory ($MDB_DEBUG_FILE_DIRECTORY, colon separated, or
+// /usr/lib/debug): .build-id/xx/yyyy.debug, then the .gnu_debuglink
+// name next to <path>, in its .debug/ and under the debug directory
+std::string findSeparateDebugFile(const elf::elf &f, const std::string &path);
+
+// DWARF sections of <f> for libelfin. SHF_COMPRESSED (zlib, zstd) and
+// .zdebug_* sections are inflated when the loader is created, one thread
+// per section, into files under ~/.cache/mdb/sections/<key>/ which are
+// mmapped; the next run maps them straight away. Uncompressed sections
+// point into <f>'s own mapping
+class DebugSectionLoader : public dwarf::loader {
+public:
+    // <cache_key> names the cache directory (the build-id, or something
+    // unique to the file); empty to keep decompressed sections in memory
+    DebugSectionLoader(const elf::elf &f, const std::string &cache_key);
+    ~DebugSectionLoader() override;
+
+    DebugSectionLoader(const DebugSectionLoader &) = delete;
+    DebugSectionLoader &operator=(const DebugSectionLoader &) = delete;
+
+    const void *load(dwarf::section_type section, size_t *size_out) override;
+
+private:
+    // mmap the cached <file> if it holds <size> bytes
+    bool mapCached(const std::string &file, size_t size, dwarf::section_type type);
+
+    elf::elf elf_;  // keeps the uncompressed sections mapped
+    std::map<dwarf::section_type, std::pair<const void *, size_t>> sections_;
+    std::vector<std::pair<void *, size_t>> mappings_;   // cache files
+    std::deque<std::vector<uint8_t>> buffers_;          // uncached sections
+};
+
+#endif
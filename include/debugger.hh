@@ -5,11 +5,29 @@
 #include "elf++.hh"
 
 #include "breakpoint.hh"
+#include "core-file.hh"
+#include "disassembler.hh"
+#include "display.hh"
+#include "event-loop.hh"
+#include "fp-registers.hh"
 #include "helper.hh"
-
+#include "inferior.hh"
+#include "perf-counters.hh"
+#include "recorder.hh"
+#include "remote-target.hh"
+#include "signal-table.hh"
+#include "syscall-catch.hh"
+#include "tracepoint.hh"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
 
 
 
@@ -18,14 +36,36 @@ public:
     // Constructor that takes program name & process ID
     Debugger (std::string prog_name, pid_t pid);
 
+    // Post-mortem debugging of <prog_name> from a core dump
+    Debugger (std::string prog_name, std::unique_ptr<CoreFile> core);
+
+    // Debuggee behind a GDB remote protocol server (`mdb --remote`)
+    Debugger (std::string prog_name, std::unique_ptr<RemoteTarget> remote);
+
     // Start the debugger
     void run();
 
+    // Wait for the debuggee's first stop (after exec) & set up tracing
+    void startInferior();
+
     // Handle command entered in cmd
     void handleCommand(const std::string& line);
 
-    // Continue command
-    void continueExecution();
+    // Tab completions of the prompt's <line>: a command name, then the
+    // functions, files or variables (those in scope first) it takes
+    void complete(const std::string &line, std::vector<std::string> *out);
+
+    // Continue command. With <any_inferior>, a stop of any traced
+    // process ends the wait and becomes current
+    void continueExecution(bool any_inferior = false);
+
+    // Resume the current inferior with <request>, remembered so that
+    // transparent stops (fork, exec) can repeat it. The signal it stopped
+    // with is delivered if its disposition passes it
+    void resume(__ptrace_request request);
+
+    // Request of the last resume
+    __ptrace_request lastResume() const { return last_resume_; }
 
     // Setting breakpoint at a given address
     void setBreakpointAtAddress(intptr_t at_addr);
@@ -33,6 +73,31 @@ public:
     // Printout values of all registers
     void dumpRegisters();
 
+    // Value of register <r>, from the core file in post-mortem mode
+    uint64_t getRegister(Reg r);
+
+    // Value of the register with DWARF number <regnum>
+    uint64_t getDwarfRegister(unsigned regnum);
+
+    // Floating-point & vector registers of the current stop, fetched on
+    // first use and kept until the process runs again
+    const FpRegisters &getFpRegisters();
+
+    // The current process ran or changed: cached registers are stale
+    void invalidateRegisterCache() { fp_regs_valid_ = false; ++generation_; }
+
+    // Bumped whenever the current process runs or changes
+    uint64_t generation() const { return generation_; }
+
+    // Context for evaluating DWARF location expressions
+    std::unique_ptr<dwarf::expr_context> makeExprContext();
+
+    // Is a core dump being examined instead of a live process
+    bool isPostMortem() const { return core_ != nullptr; }
+
+    // Is the debuggee behind a remote server
+    bool isRemote() const { return remote_ != nullptr; }
+
     // Return value at that memory address
     uint64_t readMemory(uint64_t address);
 
@@ -40,6 +105,63 @@ public:
     // write on memory
     void writeMemory(uint64_t address, uint64_t value); 
 
+    // Read <len> bytes starting at <address> with a single syscall
+    bool readMemoryBlock(uint64_t address, void *buf, size_t len);
+
+    // Read each of the <remote> blocks into the matching <local> buffer,
+    // with a single syscall per IOV_MAX blocks. False if any is unreadable
+    bool readMemoryBlocks(const std::vector<iovec> &local, const std::vector<iovec> &remote);
+
+    // Read up to <len> bytes at <address> with a single syscall and no
+    // word-by-word fallback. Return the number of bytes read
+    size_t readMemoryChunk(uint64_t address, void *buf, size_t len);
+
+    // Mappings of the current process
+    std::vector<MemoryRegion> memoryRegions();
+
+    // Print where <pattern> occurs in the readable memory of [start, end)
+    void findInMemory(uint64_t start, uint64_t end, const std::vector<uint8_t> &pattern);
+
+    // Write [start, start + len) of the debuggee's memory to <file>
+    void dumpMemory(uint64_t start, uint64_t len, const std::string &file);
+
+    // Write <len> bytes starting at <address> (works on read-only text too)
+    void writeMemoryBlock(uint64_t address, const void *buf, size_t len);
+
+    // Execute system call <nr> inside the stopped debuggee.
+    // Return its result (-errno on failure)
+    int64_t injectSyscall(uint64_t nr, uint64_t arg0 = 0, uint64_t arg1 = 0,
+                          uint64_t arg2 = 0, uint64_t arg3 = 0,
+                          uint64_t arg4 = 0, uint64_t arg5 = 0);
+
+    // Same, inside the stopped tracee <pid>
+    int64_t injectSyscallInto(pid_t pid, uint64_t nr, uint64_t arg0 = 0,
+                              uint64_t arg1 = 0, uint64_t arg2 = 0,
+                              uint64_t arg3 = 0, uint64_t arg4 = 0,
+                              uint64_t arg5 = 0);
+
+    // Copy-on-write clone of the stopped tracee <pid>, left stopped with
+    // <pid>'s registers. Return -1 on failure
+    pid_t forkStopped(pid_t pid);
+
+    // mmap <size> bytes inside the debuggee, preferably at <hint>.
+    // Return 0 on failure
+    uint64_t allocateInferiorMemory(size_t size, int prot, uint64_t hint = 0);
+
+    // mmap <size> bytes inside the debuggee within rel32 reach of <anchor>.
+    // Return 0 on failure
+    uint64_t allocateInferiorMemoryNear(uint64_t anchor, size_t size, int prot);
+
+    std::unordered_map<intptr_t, Breakpoint> &getBreakpoints() { return breakpoints_; }
+
+    // Is any breakpoint placed in [begin, end)?
+    bool hasBreakpointInRange(uint64_t begin, uint64_t end);
+
+    pid_t getPid() const { return pid_; }
+
+    // Debug info of the current program
+    const std::shared_ptr<ProgramIndex> &program() const { return program_; }
+
     // return Progam Counter (PC)
     uint64_t get_pc();
 
@@ -49,8 +171,106 @@ public:
     // Step over a line if on a breakpoint
     void stepOverBreakpoint();
 
-    // Wait for signal of debugee 
-    void waitForSignal();
+    // Execute the instruction under <bp> out of line, leaving the int3
+    // in place. Return false if it can't be displaced
+    bool displacedStep(const Breakpoint &bp);
+
+    // Relocated copy of the instruction under <bp>, built on first use
+    const DisplacedCopy *getDisplacedCopy(const Breakpoint &bp);
+
+    // Wait for signal of debugee. Stops of other inferiors are
+    // left queued unless <any_inferior>
+    void waitForSignal(bool any_inferior = false);
+
+    // Register tracee/interrupt event sources with the event loop
+    void initEventSources();
+
+    // Collect the pending wait statuses of all tracees
+    void pollTracee();
+
+    // Take the next queued stop to report, handling forks, execs and
+    // exits of other inferiors on the way
+    bool nextStopEvent(bool any_inferior, pid_t *pid, int *status);
+
+    // Bookkeeping for a wait status. Return true if it was consumed
+    bool handleInferiorEvent(pid_t pid, int status);
+
+    // Child <pid> was forked off traced process <parent>
+    void addForkedInferior(pid_t pid, pid_t parent);
+
+    // <pid> replaced its program image
+    void handleExec(pid_t pid);
+
+    // Make <pid> the current inferior
+    void switchInferior(pid_t pid, bool current_running);
+
+    // List the traced processes
+    void listInferiors();
+
+    // Select inferior with id <id>
+    void selectInferior(unsigned id);
+
+    // Snapshot the current inferior
+    void createCheckpoint();
+
+    // List the checkpoints
+    void listCheckpoints();
+
+    // Kill checkpoint <id>
+    void deleteCheckpoint(unsigned id);
+
+    // Replace the current process with a fresh fork of checkpoint <id>
+    void restartCheckpoint(unsigned id);
+
+    // Bookkeeping of the current process, as for a checkpoint of it
+    Checkpoint currentProcessState();
+
+    // Make the stopped fork <pid> of <origin> the current process; its
+    // int3s are swapped for the current breakpoints. The previous
+    // process is killed if <kill_previous>
+    void adoptProcess(pid_t pid, const Checkpoint &origin, bool kill_previous);
+
+    // Print the source around the PC
+    void printCurrentLocation();
+
+    // Record the current inferior for reverse execution
+    void startRecording();
+
+    // Drop the recording, back to the live process
+    void stopRecording();
+
+    // Watch <pid> for exit with a pidfd
+    void watchPid(pid_t pid);
+
+    // Stop watching <pid>
+    void unwatchPid(pid_t pid);
+
+    // Drain signalfd (SIGCHLD, SIGINT)
+    void handleSignalFd();
+
+    // Debuggee exited or was killed
+    void handleExit();
+
+    // Has the debuggee exited
+    bool hasExited() const { return exited_; }
+
+    // waitpid status of the last stop or exit
+    int waitStatus() const { return wait_status_; }
+
+    // Reactor the debugger blocks in while the debuggee runs
+    EventLoop &eventLoop() { return event_loop_; }
+
+    // Print the files mapped in the debuggee & where
+    void printSharedLibraries();
+
+    // `handle <sig> [stop|nostop|print|noprint|pass|nopass]...`
+    void handleSignalCommand(const std::vector<std::string> &args);
+
+    // `perf on [events]`, `perf off`, or `perf` for the totals
+    void perfCommand(const std::vector<std::string> &args);
+
+    // Move the counters to pid_ once it changed: totals start over
+    void rebindPerfCounters();
 
     // Which function I am currently at?
     void whichFunction();
@@ -76,7 +296,8 @@ public:
                                unsigned line,
                                unsigned n_lines_context = 2);
 
-    siginfo_t getSignalInfo(); 
+    // False if the stop has no siginfo (group-stop)
+    bool getSignalInfo(siginfo_t *info);
 
     void handleSigtrap(siginfo_t info); 
 
@@ -98,21 +319,92 @@ public:
 
 		std::vector<Symbol> lookupSymbol(const std::string &name);
 
-		void loadSymbols();
-
 		void printBacktrace();
 
+		// Print the instructions of the function around PC, of function
+		// <what> or at address <what> (0xADDRESS)
+		void disassemble(const std::string &what = "");
+
+		// Decoded instructions of the current process
+		Disassembler &disassembler() { return disassembler_; }
+
+		// Print the variables visible at the PC, innermost block first
 		void readVariables();
 
+		// Print variable <name> as resolved from the PC: enclosing blocks,
+		// parameters, then globals
 		void readVariable(std::string name);
+
+		// Print the raw value of the variable DIE <die>. A location that
+		// uses no register (global, static) is relocated by the load address
+		void printVariable(const dwarf::die &die);
+
+		void setTracepointAtAddress(uint64_t addr);
+
+		void setTracepointAtFunction(const std::string &f_name);
+
+		TraceAgent &traceAgent();
+
+		// Catchpoints whose filter was installed when the debuggee was
+		// launched (`--catch-syscall`)
+		void addSyscallCatchpoints(const std::vector<SyscallCatchpoint> &catchpoints);
+
+		// Stop on the calls selected by <cp>: a filter for it is installed
+		// in the current inferior (and inherited by its children), unless
+		// a deleted catchpoint left one for the same calls
+		void catchSyscall(SyscallCatchpoint cp);
+
+		void listSyscallCatchpoints();
+
+		// Filters can't be removed: stops of deleted catchpoints are
+		// resumed straight away, without being reported
+		void deleteSyscallCatchpoint(unsigned id);
 private:
+		// Print which catchpoint the debuggee stopped at
+		void reportSyscallCatch();
+
+		// Print how the remote debuggee stopped
+		void reportRemoteStop();
+
     std::unordered_map<intptr_t, Breakpoint> breakpoints_;
     std::string prog_name_;
     pid_t pid_;
     uint64_t load_addr_{0};
-    elf::elf elf_;
-    dwarf::dwarf dwarf_;
-		std::unordered_map<std::string, std::vector<Symbol>> symbols_;
+		std::shared_ptr<ProgramIndex> program_;
+		std::unique_ptr<TraceAgent> trace_agent_;
+		std::unique_ptr<CoreFile> core_;
+		std::unique_ptr<RemoteTarget> remote_;
+		std::unique_ptr<Recorder> recorder_;
+		EventLoop event_loop_;
+		Disassembler disassembler_ {*this};
+		DisplayList displays_ {*this};
+		int signal_fd_{-1};
+		std::unordered_map<pid_t, int> pid_fds_;
+		std::deque<std::pair<pid_t, int>> pending_statuses_;
+		int wait_status_{0};
+		FpRegisters fp_regs_{};
+		bool fp_regs_valid_{false};
+		uint64_t generation_{0};
+		bool exited_{false};
+		__ptrace_request last_resume_{PTRACE_CONT};
+		unsigned inferior_id_{1};
+		unsigned next_inferior_id_{2};
+		std::map<pid_t, Inferior> inferiors_; // all but the current one
+		std::set<pid_t> new_children_; // forked, first stop not seen yet
+		std::set<pid_t> unannounced_children_; // stopped before their parent's fork event
+		std::map<unsigned, Checkpoint> checkpoints_;
+		unsigned next_checkpoint_id_{1};
+		uint64_t displaced_area_{0}; // scratch code for displaced stepping
+		size_t displaced_used_{0};
+		std::unordered_map<intptr_t, DisplacedCopy> displaced_copies_;
+		std::map<unsigned, SyscallCatchpoint> syscall_catchpoints_;
+		std::map<unsigned, SyscallCatchpoint> syscall_filters_; // installed, deleted or not
+		SignalTable signals_;
+		std::unique_ptr<PerfCounters> perf_;
+		int pending_signal_{0}; // stop signal to deliver on resume
+		bool displacing_{false}; // a displaced copy is being stepped
+		bool trace_hit_{false}; // the stop is an int3 tracepoint's
+		unsigned next_catchpoint_id_{1};
 };
 
 #endif
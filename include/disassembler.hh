@@ -0,0 +1,52 @@
+#ifndef DISASSEMBLER_HH
+#define DISASSEMBLER_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "x86-decode.hh"
+
+class Debugger;
+
+// Decoded ranges kept at most; beyond, the cache starts over
+constexpr std::size_t max_cached_ranges = 1024;
+
+// Decoded instructions of the current process, cached per address
+// range. Each range is fetched with a single memory read. The bytes of
+// enabled breakpoints are swapped back for the original ones, so
+// planting & lifting breakpoints never makes the cache stale; anything
+// else writing code has to call invalidate()
+class Disassembler {
+public:
+    explicit Disassembler(Debugger &dbg) : dbg_{dbg} {}
+
+    Disassembler(const Disassembler &) = delete;
+    Disassembler &operator=(const Disassembler &) = delete;
+
+    // Instructions starting in [begin, end). An undecodable byte gives an
+    // invalid one-byte instruction. Empty if the memory can't be read.
+    // Valid until the next call
+    const std::vector<Instruction> &decodeRange(uint64_t begin, uint64_t end);
+
+    // Instruction starting at <address>, nullptr if unreadable
+    const Instruction *instructionAt(uint64_t address);
+
+    // Code in [begin, end) was overwritten
+    void invalidate(uint64_t begin, uint64_t end);
+
+    // Another process (or program image) became current
+    void clear() { ranges_.clear(); }
+
+private:
+    struct Range {
+        uint64_t end;
+        std::vector<Instruction> insns;
+    };
+
+    Debugger &dbg_;
+    std::map<uint64_t, Range> ranges_; // by start address
+};
+
+#endif
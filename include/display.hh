@@ -0,0 +1,57 @@
+#ifndef DISPLAY_HH
+#define DISPLAY_HH
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "expression.hh"
+
+class Debugger;
+
+// Expressions printed after every stop (`display <expr>`). Each is
+// compiled once per scope; on a stop all of them are evaluated first,
+// then the memory they need is fetched in one batched read. Only the
+// values that changed since the last stop are printed, highlighted
+class DisplayList {
+public:
+    explicit DisplayList(Debugger &dbg) : dbg_{dbg} {}
+
+    DisplayList(const DisplayList &) = delete;
+    DisplayList &operator=(const DisplayList &) = delete;
+
+    // Add <text> & print its current value
+    void add(const std::string &text);
+
+    // Drop display <id>. Return false if there's none
+    bool remove(unsigned id);
+
+    void clear() { displays_.clear(); }
+
+    bool empty() const { return displays_.empty(); }
+
+    // Print the displays after a stop: the changed ones, or all of them
+    // if <all>
+    void refresh(bool all = false) { show(0, all); }
+
+private:
+    struct Display {
+        unsigned id;
+        std::string text;
+        std::unique_ptr<Expression> expr; // nullptr while not in scope
+        std::string shown;  // last printed value
+        bool printed {false};
+    };
+
+    // Evaluate & print the displays from index <first> on
+    void show(size_t first, bool all);
+
+    // Compiled for the current PC, or nullptr if some name isn't in scope
+    void compile(Display &d, uint64_t pc);
+
+    Debugger &dbg_;
+    std::vector<Display> displays_;
+    unsigned next_id_ {1};
+};
+
+#endif
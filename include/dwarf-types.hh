@@ -0,0 +1,95 @@
+#ifndef DWARF_TYPES_HH
+#define DWARF_TYPES_HH
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dwarf++.hh"
+
+// Type of a debuggee value, flattened from its DWARF DIEs: typedefs &
+// const/volatile are looked through
+struct Type {
+    enum class Kind {
+        void_, integer, floating, boolean, pointer, reference,
+        array, structure, enumeration, function
+    };
+
+    struct Member {
+        std::string name;       // empty for anonymous structs/unions
+        uint64_t offset;        // bytes from the start of the aggregate
+        const Type *type;
+        unsigned bit_size;      // 0 unless a bit-field
+        unsigned bit_offset;    // from the least significant bit
+        bool base_class;        // DW_TAG_inheritance
+    };
+
+    Kind kind {Kind::void_};
+    std::string name;           // "int", "struct node"; empty if anonymous
+    uint64_t size {0};
+    bool is_signed {false};
+    bool is_char {false};       // printed as characters
+    const Type *target {nullptr}; // pointee, referent or element
+    uint64_t count {0};         // array elements
+    std::vector<Member> members;
+    std::vector<std::pair<std::string, int64_t>> enumerators;
+
+    // Integer, boolean or enumeration
+    bool isInteger() const {
+        return kind == Kind::integer || kind == Kind::boolean
+               || kind == Kind::enumeration;
+    }
+
+    // Usable in arithmetic & conditions
+    bool isScalar() const {
+        return isInteger() || kind == Kind::floating || kind == Kind::pointer;
+    }
+};
+
+// Member <name> of the struct/union <type>, searched through anonymous
+// members & base classes. <offset> gets its offset in <type>
+const Type::Member *findMember(const Type &type, const std::string &name,
+                               uint64_t *offset);
+
+// C spelling of <type> ("struct node *", "int [10]")
+std::string typeName(const Type &type);
+
+// Types of one program, converted from DWARF on first use. Types are
+// owned by the table & never move
+class TypeTable {
+public:
+    // Type described by the DIE <die>
+    const Type *fromDie(const dwarf::die &die);
+
+    // Type called <name> ("node", "struct node", a typedef) in any
+    // compilation unit of <dw>. nullptr if none
+    const Type *findNamed(const dwarf::dwarf &dw, const std::string &name);
+
+    // Base type that needn't exist in the debug info
+    const Type *builtin(Type::Kind kind, uint64_t size, bool is_signed,
+                        const std::string &name);
+
+    const Type *voidType() { return builtin(Type::Kind::void_, 1, false, "void"); }
+
+    const Type *pointerTo(const Type *target);
+
+    const Type *arrayOf(const Type *element, uint64_t count);
+
+private:
+    Type *add() { types_.emplace_back(); return &types_.back(); }
+    void convert(const dwarf::die &die, Type *type);
+
+    std::deque<Type> types_;
+    std::unordered_map<dwarf::section_offset, const Type*> by_die_;
+    std::unordered_map<std::string, const Type*> builtins_;
+    std::unordered_map<const Type*, const Type*> pointers_;
+    std::map<std::pair<const Type*, uint64_t>, const Type*> arrays_;
+    std::unordered_map<std::string, dwarf::die> named_; // filled on first lookup
+    bool named_indexed_ {false};
+};
+
+#endif
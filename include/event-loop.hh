@@ -0,0 +1,40 @@
+#ifndef EVENT_LOOP_HH
+#define EVENT_LOOP_HH
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+// Single-threaded epoll reactor. Everything mdb waits on (tracee state
+// changes, user interrupts, stdin) is a file descriptor here, so
+// no source can starve another
+class EventLoop {
+public:
+    using Callback = std::function<void(uint32_t events)>;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // Watch <fd> for <events> (EPOLLIN, ...). Return false if <fd>
+    // can't be polled (e.g. a regular file)
+    bool addFd(int fd, uint32_t events, Callback cb);
+
+    // Stop watching <fd>. It is not closed
+    void removeFd(int fd);
+
+    // Dispatch events until <done> holds. <done> is checked before
+    // blocking, so already satisfied conditions don't wait
+    void runUntil(const std::function<bool()> &done);
+
+    // Dispatch the events ready within <timeout_ms> (-1 blocks)
+    void runOnce(int timeout_ms);
+
+private:
+    int epoll_fd_;
+    std::unordered_map<int, Callback> callbacks_;
+};
+
+#endif
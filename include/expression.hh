@@ -0,0 +1,83 @@
+#ifndef EXPRESSION_HH
+#define EXPRESSION_HH
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "dwarf-types.hh"
+#include "inferior.hh"
+
+class Debugger;
+
+// Syntax error, unknown name or operands of the wrong type
+class ExpressionError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Bytes of a <type> value that get printed: all of them, but only the
+// first elements of a long array
+uint64_t printedSize(const Type &type);
+
+// A value of the debuggee. An lvalue's bytes are only read on demand,
+// see loadValue()
+struct Value {
+    const Type *type {nullptr};
+    std::vector<uint8_t> bytes;
+    bool lvalue {false};       // lives in memory at <address>
+    uint64_t address {0};
+    std::shared_ptr<const Type> temporary; // <type> of an '@' array
+
+    bool loaded() const { return !lvalue || bytes.size() == printedSize(*type); }
+};
+
+// A C expression compiled for one scope: names are resolved to their
+// DIEs & types checked once, evaluating it in a stop only runs the
+// location expressions and reads memory.
+// Supports the usual C operators, casts, sizeof, member access through
+// structs & pointers, indexing and <lvalue>@<count> (array of <count>
+// elements starting at <lvalue>)
+class Expression {
+public:
+    // Compile <text> in the scope of the DWARF address <pc> of <program>.
+    // Names are looked up in the enclosing blocks & function, then the
+    // globals of its compilation unit, then of every other one
+    Expression(const std::string &text, std::shared_ptr<ProgramIndex> program,
+               uint64_t pc);
+    ~Expression();
+
+    Expression(const Expression &) = delete;
+    Expression &operator=(const Expression &) = delete;
+
+    const std::string &text() const { return text_; }
+
+    const std::shared_ptr<ProgramIndex> &program() const { return program_; }
+
+    // Type of the result (arrays made with @ have 0 elements here)
+    const Type *type() const;
+
+    // Is <pc> (DWARF address) still in the block it was compiled for?
+    bool validAt(uint64_t pc) const;
+
+    // Value in the current stop of <dbg>. A resulting lvalue is not read
+    Value evaluate(Debugger &dbg) const;
+
+    struct Node;
+
+private:
+    std::string text_;
+    std::shared_ptr<ProgramIndex> program_;
+    std::unique_ptr<Node> root_;
+    const Scope *scope_ {nullptr}; // innermost block the names were resolved in
+};
+
+// Read the printed bytes of <v> if it is an lvalue not read yet
+void loadValue(Debugger &dbg, Value &v);
+
+// Printable form of <v>: "42", "{next = 0x0, data = 3}", "0x4006f4 \"text\""
+std::string formatValue(Debugger &dbg, Value v);
+
+#endif
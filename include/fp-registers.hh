@@ -0,0 +1,61 @@
+#ifndef FP_REGISTERS_HH
+#define FP_REGISTERS_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/user.h>
+
+// Offset of the AVX state (upper halves of ymm0-15) in the standard
+// XSAVE layout; the XSAVE header follows the 512-byte FXSAVE area
+constexpr std::size_t xsave_header_offset = 512;
+constexpr std::size_t xsave_avx_offset = 576;
+constexpr std::size_t xsave_avx_size = 256;
+
+// x87, SSE & AVX state of a thread: the FXSAVE area plus the upper
+// halves of the ymm registers
+struct FpRegisters {
+    user_fpregs_struct fx;
+    uint8_t ymm_hi[16][16];
+    bool has_avx;               // ymm_hi was part of the saved state
+};
+
+enum class FpReg {
+    xmm, ymm, st, mxcsr, fcw, fsw, ftw
+};
+
+struct FpRegDescriptor {
+    FpReg kind;
+    unsigned index;  // xmm/ymm/st number
+    int dwarf_r;     // -1 <==> not applicable
+    std::string name;
+};
+
+// Floating-point & vector registers with their DWARF numbers
+// (xmm0-15: 17-32, st0-7: 33-40, mxcsr: 64, fcw: 65, fsw: 66)
+const std::vector<FpRegDescriptor> &fpRegisterDescriptors();
+
+// Descriptor named <name> (xmm3, ymm0, st1, mxcsr...), nullptr if none
+const FpRegDescriptor *findFpRegister(const std::string &name);
+
+// Descriptor with DWARF number <regnum>, nullptr if none
+const FpRegDescriptor *findFpDwarfRegister(unsigned regnum);
+
+// Low 64 bits of a register: the scalar float/double held in an xmm
+uint64_t getFpRegisterValue(const FpRegisters &regs, const FpRegDescriptor &rd);
+
+// Register contents, hex & as float/double lanes
+std::string formatFpRegister(const FpRegisters &regs, const FpRegDescriptor &rd);
+
+// Fetch the state of <pid> with a single PTRACE_GETREGSET: NT_X86_XSTATE,
+// truncated right after the AVX component, or NT_PRFPREG without AVX
+bool readFpRegisters(pid_t pid, FpRegisters *out);
+
+// Fill <out> from an XSAVE image of <size> bytes (NT_X86_XSTATE)
+void fpRegistersFromXsave(const uint8_t *xsave, std::size_t size, FpRegisters *out);
+
+#endif
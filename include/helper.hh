@@ -6,6 +6,8 @@
 #include <sstream>
 #include <array>
 
+#include <sys/user.h>
+
 #include "elf++.hh"
 #include "dwarf++.hh"
 
@@ -86,7 +88,13 @@ Reg getRegisterFromName(const std::string &);
 // Given process id & Reg value, return value of that register
 uint64_t getRegisterValue(pid_t, Reg);
 
-// Given process id & dwarf_r, return value of that register
+// Value of register <r> in a saved register set
+uint64_t getRegisterValue(const user_regs_struct &regs, Reg r);
+
+// Reg with DWARF register number <regnum>
+Reg getRegisterFromDwarfRegister(unsigned regnum);
+
+// Given process id & dwarf_r, return value of that general-purpose register
 uint64_t getRegisterValueFromDwarfRegister(pid_t, unsigned);
 
 // Given process id and register, set its value to <value>
@@ -0,0 +1,73 @@
+#ifndef INFERIOR_HH
+#define INFERIOR_HH
+
+#include "dwarf++.hh"
+#include "elf++.hh"
+
+#include "breakpoint.hh"
+#include "completion.hh"
+#include "dwarf-types.hh"
+#include "helper.hh"
+#include "line-index.hh"
+#include "scope-index.hh"
+#include "tracepoint.hh"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+// Debug info & symbols of one executable. Every inferior running the
+// same file shares one ProgramIndex
+struct ProgramIndex {
+    explicit ProgramIndex(const std::string &path);
+
+    std::string path;
+    std::string debug_path; // separate debug file, empty if none
+    elf::elf elf;
+    dwarf::dwarf dwarf;
+    ScopeIndex scopes {dwarf};
+    LineIndex lines {dwarf};
+    std::unordered_map<std::string, std::vector<Symbol>> symbols;
+    TypeTable types;
+    CompletionIndex names {dwarf, symbols, lines};
+};
+
+// Index of the executable at <path>. Files with the same device, inode,
+// size and mtime are loaded only once
+std::shared_ptr<ProgramIndex> loadProgramIndex(const std::string &path);
+
+// A traced process other than the current one. The current inferior's
+// state lives directly in the Debugger
+struct Inferior {
+    unsigned id;
+    pid_t pid;
+    std::shared_ptr<ProgramIndex> program;
+    uint64_t load_addr{0};
+    std::unordered_map<intptr_t, Breakpoint> breakpoints;
+    uint64_t displaced_area{0};
+    size_t displaced_used{0};
+    std::unordered_map<intptr_t, DisplacedCopy> displaced_copies;
+    std::unique_ptr<TraceAgent> trace_agent;
+    int pending_signal{0};  // delivered on its next resume
+    bool running{false}; // resumed & not reported stopped since
+    bool exited{false};
+};
+
+// Frozen fork of an inferior. It never runs itself: restarting forks it
+// again, so a checkpoint can be restarted any number of times
+struct Checkpoint {
+    unsigned id;
+    pid_t pid;
+    unsigned inferior_id;
+    std::shared_ptr<ProgramIndex> program;
+    uint64_t load_addr{0};
+    uint64_t pc{0};
+    std::unordered_map<intptr_t, Breakpoint> breakpoints; // int3s in its memory
+    uint64_t displaced_area{0};
+    size_t displaced_used{0};
+    std::unordered_map<intptr_t, DisplacedCopy> displaced_copies;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef LINE_INDEX_HH
+#define LINE_INDEX_HH
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dwarf++.hh"
+
+// (file, line) -> addresses of a program, from all of its line tables,
+// built on first use. Files are numbered by normalized full path, so a
+// header included by many CUs is one file; rows are sorted by (file,
+// line, address) and a line is found with a binary search
+class LineIndex {
+public:
+    explicit LineIndex(const dwarf::dwarf &dw) : dw_{dw} {}
+
+    LineIndex(const LineIndex &) = delete;
+    LineIndex &operator=(const LineIndex &) = delete;
+
+    // Full paths of the files named <spec>: the path itself, or any path
+    // ending in /<spec> ("file.cc", "src/file.cc")
+    std::vector<std::string> matchFiles(const std::string &spec);
+
+    // Full paths of all files, by id
+    const std::vector<std::string> &files();
+
+    // DWARF addresses of <line> of file <path>: every place a run of its
+    // statements begins (templates, inlined copies, loop headers...). A
+    // line without code moves to the next one that has some, returned
+    // in <actual>. Empty if there's none
+    std::vector<uint64_t> addresses(const std::string &path, unsigned line, unsigned *actual);
+
+private:
+    struct Row {
+        uint32_t file;
+        uint32_t line;
+        uint64_t address;
+    };
+
+    void build();
+
+    const dwarf::dwarf &dw_;
+    bool built_ {false};
+    std::vector<std::string> files_;                        // id -> full path
+    std::unordered_map<std::string, uint32_t> file_ids_;
+    std::unordered_multimap<std::string, uint32_t> by_basename_;
+    std::vector<Row> rows_;
+};
+
+#endif
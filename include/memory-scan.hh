@@ -0,0 +1,49 @@
+#ifndef MEMORY_SCAN_HH
+#define MEMORY_SCAN_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+// Bytes fetched per read when scanning or dumping memory
+constexpr std::size_t memory_chunk_size = 1 << 20;
+
+// A mapping of the debuggee's address space
+struct MemoryRegion {
+    uint64_t start;
+    uint64_t end;
+    bool readable;
+    std::string path;   // backing file or [heap], [stack]...; may be empty
+};
+
+// A file mapped into the debuggee, at the lowest address it occupies
+struct LoadedLibrary {
+    std::string path;
+    uint64_t base;
+};
+
+// Mappings listed in /proc/<pid>/maps, by address
+std::vector<MemoryRegion> readProcMaps(pid_t pid);
+
+// Readable parts of [start, end) in <regions>, adjacent mappings merged
+std::vector<std::pair<uint64_t, uint64_t>> readableRanges(
+    const std::vector<MemoryRegion> &regions, uint64_t start, uint64_t end);
+
+// Files mapped in <regions> (absolute paths only), in load order
+std::vector<LoadedLibrary> mappedLibraries(const std::vector<MemoryRegion> &regions);
+
+// Bytes to search for: 0xVALUE (little-endian, as wide as its digits
+// rounded up to 1/2/4/8 bytes), "text", or hex:BYTES in memory order.
+// Return false if <text> is none of them
+bool parsePattern(const std::string &text, std::vector<uint8_t> *out);
+
+// Call <found> with the offset of each occurrence of <pattern> that
+// lies entirely in [data, data + size). Stop early if it returns false
+bool scanBuffer(const uint8_t *data, std::size_t size, const std::vector<uint8_t> &pattern,
+                const std::function<bool(std::size_t)> &found);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef PERF_COUNTERS_HH
+#define PERF_COUNTERS_HH
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+// `perf on <events>`: perf_event_open counters on the debuggee, read at
+// every stop. What ran between two prompts (a step, a next, a continue
+// from breakpoint to breakpoint) is reported as one interval. Only user
+// mode is counted, so mdb's own traps & ptrace work don't show up
+class PerfCounters {
+public:
+    // Count <events> (cycles, instructions, cache-misses, ..., task-clock,
+    // page-faults) in each thread of <pid>; threads & children it creates
+    // later inherit them. Hardware events the machine lacks (VMs) fall
+    // back to task-clock & page-faults. Throw std::runtime_error if
+    // nothing can be counted
+    PerfCounters(pid_t pid, const std::vector<std::string> &events);
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    pid_t pid() const { return pid_; }
+
+    // Events being counted, to count the same in another process
+    std::vector<std::string> events() const;
+
+    // Read the counters; what they advanced goes to the current interval
+    void sample();
+
+    // Print the current interval & start a new one. Nothing if the
+    // debuggee didn't run
+    void reportInterval(std::ostream &os);
+
+    // Print the counts since `perf on`
+    void reportTotals(std::ostream &os) const;
+
+private:
+    struct Counter {
+        std::string name;
+        bool nanoseconds;       // task-clock
+        std::vector<int> fds;   // one per thread
+        uint64_t last {0};
+        uint64_t interval {0};
+        uint64_t total {0};
+    };
+
+    // Open <name> for every thread. False if it can't be counted
+    bool addCounter(const std::string &name, const std::vector<pid_t> &threads);
+
+    void print(std::ostream &os, bool interval) const;
+
+    pid_t pid_;
+    std::vector<Counter> counters_;
+    bool ran_ {false};
+};
+
+// Names `perf on` accepts, comma separated
+std::string perfEventNames();
+
+#endif
@@ -2,7 +2,11 @@
 #define PTRACE_EXPR_CONTEXT_HH
 
 #include "dwarf++.hh"
+#include "fp-registers.hh"
 #include "helper.hh"
+#include "stats.hh"
+
+#include <functional>
 
 #include <sys/user.h>
 #include <sys/ptrace.h>
@@ -10,24 +14,30 @@
 
 class PtraceExprContext : public dwarf::expr_context {
 public:
-		PtraceExprContext(pid_t pid) : pid_{pid} { }
+		// <fp_regs>: the debugger's cached FP register set, read on first use
+		PtraceExprContext(pid_t pid, std::function<const FpRegisters &()> fp_regs)
+				: pid_{pid}, fp_regs_{std::move(fp_regs)} { }
 		
+		// xmm/st registers: the low 64 bits, where a scalar float/double is kept
 		dwarf::taddr reg(unsigned regnum) override {
+				if (auto rd = findFpDwarfRegister(regnum))
+						return getFpRegisterValue(fp_regs_(), *rd);
 				return getRegisterValueFromDwarfRegister(pid_, regnum);
 		}
 
 		dwarf::taddr pc() override {
 				struct user_regs_struct regs;
-				ptrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+				countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
 				return regs.rip;
 		}
 
 		dwarf::taddr deref_size(dwarf::taddr address, unsigned size) override {
 				//TODO take size into account
-				return ptrace(PTRACE_PEEKDATA, pid_, address, nullptr);
+				return countedPtrace(PTRACE_PEEKDATA, pid_, address, nullptr);
 		}
 private:
 		pid_t pid_;
+		std::function<const FpRegisters &()> fp_regs_;
 };
 
 #endif
@@ -0,0 +1,165 @@
+#ifndef RECORDER_HH
+#define RECORDER_HH
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include "inferior.hh"
+
+class Debugger;
+
+// Upper bound of the syscall log; recording stops beyond it
+constexpr std::size_t max_record_log_size = 64 << 20;
+
+// Frozen snapshots kept at most; beyond, every other one is dropped
+constexpr std::size_t max_record_snapshots = 32;
+
+// A point of the recorded execution: <event> syscalls completed, then
+// the first time the registers equal <regs>
+struct ReplayPosition {
+    std::size_t event;
+    user_regs_struct regs;
+};
+
+// Record & replay of the current inferior. While recording, syscall
+// results (and the memory they wrote) and the points where signals were
+// delivered are appended to a log, and fork snapshots are taken every so
+// often. Going backwards forks the nearest snapshot and replays it with
+// the logged syscalls & signals fed back in
+class Recorder {
+public:
+    // Start recording the current inferior
+    explicit Recorder(Debugger &dbg);
+    ~Recorder();
+
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    // Request to really resume the current process with instead of
+    // <request>: syscalls have to stop while it's recorded or replayed
+    __ptrace_request mapResume(__ptrace_request request) const;
+
+    // Current process stopped at a syscall entry/exit. Return true if the
+    // stop was consumed (the process resumed)
+    bool handleSyscallStop();
+
+    // Current process is resumed with <signo> delivered: log where
+    void logSignal(int signo);
+
+    // Signal to deliver as the replayed process resumes: the one the
+    // recording delivered at this position, with its siginfo, else 0
+    int signalToDeliver();
+
+    // Is the current process a replayed copy rather than the live one
+    bool isReplaying() const { return replaying_; }
+
+    // Did the replayed copy stop matching the log? It's stopped then,
+    // for returnToLive()
+    bool hasDiverged() const { return diverged_; }
+
+    // Go back to the start of the previously executed line
+    void reverseStep();
+
+    // Go back to the previous breakpoint hit
+    void reverseContinue();
+
+    // Make the live process current again
+    void returnToLive();
+
+    // Print log size, snapshots & recording overhead
+    void printStatus() const;
+
+private:
+    struct SyscallRecord {
+        uint64_t nr;
+        int64_t result;
+        // memory written by the syscall: address, offset into log_
+        std::vector<std::pair<uint64_t, std::pair<std::size_t, std::size_t>>> writes;
+    };
+
+    // Is the process driven by the recorder the current one
+    bool isCurrent() const;
+
+    void onSyscallEntry();
+    void onSyscallExit();
+
+    // Append the result of the syscall that just completed
+    void logSyscall(const user_regs_struct &regs);
+
+    SyscallRecord syscallRecord(std::size_t event) const;
+
+    struct SignalRecord {
+        int signo;
+        std::size_t event;
+        user_regs_struct regs;
+        siginfo_t info;
+    };
+
+    SignalRecord signalRecord(std::size_t i) const;
+
+    // Get the next signal to replay into <record>. False unless it's due
+    // before the next syscall completes; missed ones are skipped
+    bool nextSignal(SignalRecord *record);
+
+    // Plant <bp> where the next signal was delivered, if it's due before
+    // the next syscall: asynchronous signals have no stop of their own
+    void armSignalBreakpoint(Breakpoint *bp);
+
+    // Freeze a fork of the live process at the current event
+    void takeSnapshot();
+
+    // Tracee CPU time, the budget between two snapshots
+    std::chrono::nanoseconds traceeCpuTime() const;
+
+    // Fork the latest snapshot at or before <event> and make it current
+    bool startReplay(std::size_t event);
+
+    // Run the replayed process forward. Stop after <event> syscalls when
+    // <target> is null, else at the first point after them where the
+    // registers equal <target>. Breakpoint hits are added to <hits>
+    bool replayForward(std::size_t event, const user_regs_struct *target,
+                       std::vector<ReplayPosition> *hits);
+
+    // Single-step the replayed process, syscall instructions included
+    bool stepInstruction();
+
+    // Move the current position to <pos>
+    bool replayTo(const ReplayPosition &pos);
+
+    // Position of the current process
+    ReplayPosition currentPosition() const;
+
+    Debugger &dbg_;
+
+    pid_t pid_;                  // process driven: live or replayed copy
+    std::size_t event_{0};       // syscalls completed by pid_
+    bool in_syscall_{false};     // pid_ is between entry & exit stops
+    user_regs_struct entry_regs_{};
+    bool emulated_{false};       // the syscall in progress is skipped
+    bool diverged_{false};       // the copy left the recorded execution
+
+    Checkpoint live_;            // the live process, while replaying
+    bool replaying_{false};
+    bool full_{false};           // log limit reached, no more recording
+
+    std::vector<uint8_t> log_;
+    std::vector<std::size_t> index_; // log_ offset of each syscall record
+    std::vector<std::size_t> signal_index_; // log_ offset of each signal record
+    std::size_t next_signal_{0}; // first signal record not replayed yet
+    std::vector<std::pair<std::size_t, Checkpoint>> snapshots_; // by event
+
+    std::chrono::nanoseconds snapshot_interval_{std::chrono::milliseconds{100}};
+    std::chrono::nanoseconds last_snapshot_cpu_{0};
+    std::size_t syscall_stops_{0};
+    std::chrono::nanoseconds overhead_{0}; // spent in mdb on syscall stops
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef REGISTER_USE_CONTEXT_HH
+#define REGISTER_USE_CONTEXT_HH
+
+#include "dwarf++.hh"
+
+// Forwards to <inner>, noting whether the location depends on registers.
+// If not, it is a link-time address that has to be relocated
+class RegisterUseContext : public dwarf::expr_context {
+public:
+    explicit RegisterUseContext(dwarf::expr_context &inner) : inner_{inner} {}
+
+    dwarf::taddr reg(unsigned regnum) override {
+        used_registers = true;
+        return inner_.reg(regnum);
+    }
+
+    dwarf::taddr pc() override { return inner_.pc(); }
+
+    dwarf::taddr deref_size(dwarf::taddr address, unsigned size) override {
+        return inner_.deref_size(address, size);
+    }
+
+    bool used_registers {false};
+
+private:
+    dwarf::expr_context &inner_;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef REMOTE_EXPR_CONTEXT_HH
+#define REMOTE_EXPR_CONTEXT_HH
+
+#include "dwarf++.hh"
+#include "helper.hh"
+#include "remote-target.hh"
+
+#include <algorithm>
+
+
+// Evaluate DWARF expressions against a debuggee behind a remote server;
+// reads are served from the target's per-stop caches
+class RemoteExprContext : public dwarf::expr_context {
+public:
+		RemoteExprContext(RemoteTarget &remote) : remote_{remote} { }
+
+		dwarf::taddr reg(unsigned regnum) override {
+				if (auto rd = findFpDwarfRegister(regnum))
+						return getFpRegisterValue(remote_.fpRegisters(), *rd);
+				return remote_.getRegister(getRegisterFromDwarfRegister(regnum));
+		}
+
+		dwarf::taddr pc() override {
+				return remote_.getRegister(Reg::rip);
+		}
+
+		dwarf::taddr deref_size(dwarf::taddr address, unsigned size) override {
+				uint64_t value = 0;
+				remote_.read(address, &value, std::min(size, 8u));
+				return value;
+		}
+private:
+		RemoteTarget &remote_;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef REMOTE_TARGET_HH
+#define REMOTE_TARGET_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include "fp-registers.hh"
+#include "helper.hh"
+#include "memory-scan.hh"
+#include "rsp.hh"
+
+// How the remote debuggee last stopped
+struct RemoteStop {
+    bool exited {false};
+    int signal {0};     // Linux number: the stop signal, or the fatal one
+    int code {0};       // exit code, if it exited normally
+};
+
+// `mdb --remote`: a debuggee behind a GDB remote protocol server.
+// Everything read is cached until the debuggee runs again: registers
+// come from a single 'g' (rip, rsp & rbp straight from the stop reply),
+// memory by whole pages, the missing pages of a read requested together
+class RemoteTarget {
+public:
+    // Take over the connected socket <fd>: negotiate features & no-ack
+    // mode, then fetch the current stop. Throw std::runtime_error if the
+    // server doesn't answer
+    explicit RemoteTarget(int fd);
+    ~RemoteTarget();
+
+    RemoteTarget(const RemoteTarget &) = delete;
+    RemoteTarget &operator=(const RemoteTarget &) = delete;
+
+    pid_t pid() const { return pid_; }
+
+    const RemoteStop &lastStop() const { return stop_; }
+
+    uint64_t getRegister(Reg r);
+
+    void setRegister(Reg r, uint64_t value);
+
+    const FpRegisters &fpRegisters();
+
+    // Copy [address, address + len) into <buf>. False if any of it is
+    // unreadable
+    bool read(uint64_t address, void *buf, size_t len);
+
+    // Read up to <len> bytes at <address>, up to the first unreadable
+    // page. Return the number of bytes read
+    size_t readPartial(uint64_t address, void *buf, size_t len);
+
+    // Fetch the pages of all [start, end) <ranges> not cached yet, in
+    // one batch of requests
+    void prefetch(const std::vector<std::pair<uint64_t, uint64_t>> &ranges);
+
+    bool write(uint64_t address, const void *buf, size_t len);
+
+    // Software breakpoints kept by the server (Z0/z0)
+    bool insertBreakpoint(uint64_t address);
+
+    bool removeBreakpoint(uint64_t address);
+
+    // Resume & wait for the next stop. ^C interrupts the debuggee
+    void resume();
+
+    void step();
+
+    // Step until the PC leaves [start, end), in a single request
+    void rangeStep(uint64_t start, uint64_t end);
+
+    // Files mapped in the debuggee (qXfer:libraries:read)
+    std::vector<LoadedLibrary> libraries();
+
+    // Value of auxiliary vector entry <type> (AT_ENTRY...), 0 if none
+    uint64_t auxv(uint64_t type);
+
+    void kill();
+
+private:
+    static constexpr size_t page_size = 4096;
+
+    std::string request(const std::string &packet);
+
+    // Whole object read with qXfer:<object>:read
+    std::string transfer(const std::string &object);
+
+    // Send the resume <packet> & wait for its stop reply
+    void waitForStop(const std::string &packet);
+
+    void parseStop(const std::string &reply);
+
+    // Drop what the debuggee may have changed by running
+    void invalidate();
+
+    void fetchRegisters();
+
+    RspConnection conn_;
+    int interrupt_fd_ {-1};     // signalfd for SIGINT while it runs
+    bool binary_upload_ {false};
+    bool range_stepping_ {false};
+    size_t max_read_ {page_size};
+    pid_t pid_ {0};
+    RemoteStop stop_;
+
+    user_regs_struct regs_ {};
+    FpRegisters fp_regs_ {};
+    bool regs_valid_ {false};
+    std::map<unsigned, uint64_t> expedited_;    // GDB number -> value
+
+    // page address -> its bytes; empty if unreadable
+    std::unordered_map<uint64_t, std::vector<uint8_t>> pages_;
+    std::vector<uint8_t> auxv_;
+};
+
+#endif
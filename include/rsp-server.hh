@@ -0,0 +1,72 @@
+#ifndef RSP_SERVER_HH
+#define RSP_SERVER_HH
+
+#include <functional>
+#include <string>
+
+#include "rsp.hh"
+
+class Debugger;
+
+// `mdb --server`: the ptrace half of mdb behind GDB's remote protocol,
+// for a client holding the debug info elsewhere. Memory moves in binary
+// ('x'/'X'), `vCont;r` steps through a whole line range in one request
+// and stop replies carry rip, rsp & rbp, so a stop costs few round trips
+class RspServer {
+public:
+    RspServer(Debugger &dbg, RspConnection &conn) : dbg_{dbg}, conn_{conn} {}
+
+    // Answer requests until the client kills or detaches the debuggee.
+    // If the client hangs up, the debuggee is killed
+    void serve();
+
+private:
+    // Reply to <packet>, empty if it isn't supported
+    std::string handle(const std::string &packet);
+
+    // T/W/X packet for the current stop
+    std::string stopReply();
+
+    std::string readRegisters();
+
+    std::string writeRegisters(const std::string &hex);
+
+    std::string readRegister(unsigned regno);
+
+    std::string writeRegister(unsigned regno, const std::string &hex);
+
+    // <addr>,<length>: hex ('m') or binary ('x') reply
+    std::string readMemory(const std::string &args, bool binary);
+
+    // <addr>,<length>:<data>, hex ('M') or binary ('X')
+    std::string writeMemory(const std::string &args, bool binary);
+
+    // <type>,<addr>,<kind>; software breakpoints only
+    std::string breakpoint(const std::string &args, bool insert);
+
+    // vCont action: c, s or r<start>,<end>
+    std::string resume(const std::string &action);
+
+    // q packets, qXfer included
+    std::string query(const std::string &packet);
+
+    // <object>:read:<annex>:<offset>,<length>
+    std::string transfer(const std::string &args);
+
+    // <library-list> of the files mapped in the debuggee
+    std::string libraryList();
+
+    // Remove the breakpoints & let the debuggee run on its own
+    void detach();
+
+    // Run <step>, a resume & wait of the debuggee; a ^C from the client
+    // meanwhile interrupts it
+    void runInterruptible(const std::function<void()> &step);
+
+    Debugger &dbg_;
+    RspConnection &conn_;
+    bool done_ {false};
+    bool hung_up_ {false};
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef RSP_HH
+#define RSP_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/user.h>
+
+#include "helper.hh"
+
+// GDB remote serial protocol pieces shared by `mdb --server` and
+// `mdb --remote`: packet framing, encodings, amd64 register layout
+
+// Largest packet either side sends, advertised as PacketSize
+constexpr std::size_t rsp_packet_size = 0x20000;
+
+// A peer, over a socket or a pair of pipes. Packets are $payload#xx;
+// once no-ack mode is on, the +/- acknowledgements are dropped and
+// several packets can be written back to back
+class RspConnection {
+public:
+    // Read from <in_fd>, write to <out_fd> (may be the same socket).
+    // Both are closed on destruction
+    RspConnection(int in_fd, int out_fd);
+    ~RspConnection();
+
+    RspConnection(const RspConnection &) = delete;
+    RspConnection &operator=(const RspConnection &) = delete;
+
+    int inFd() const { return in_fd_; }
+
+    // Next payload, run-length decoded (binary data still escaped).
+    // Throw std::runtime_error if the peer hangs up
+    std::string receive();
+
+    // Send <payload>; in ack mode, until the peer acknowledges it
+    void send(const std::string &payload);
+
+    // Send <payloads> with one write and return their replies, in order.
+    // In ack mode they go one at a time
+    std::vector<std::string> exchange(const std::vector<std::string> &payloads);
+
+    // Is a whole packet buffered?
+    bool hasPacket() const;
+
+    // Read whatever is available without blocking. False on hangup
+    bool poll();
+
+    // Was a ^C (0x03) received since the last call?
+    bool takeInterrupt();
+
+    // Send a ^C
+    void sendInterrupt();
+
+    void setNoAck(bool no_ack) { no_ack_ = no_ack; }
+
+    // Run-length encode outgoing packets (replies only)
+    void setCompress(bool compress) { compress_ = compress; }
+
+private:
+    // Wait for more input. False on hangup
+    bool fill();
+
+    void write(const std::string &data);
+
+    // $<payload>#xx
+    std::string frame(const std::string &payload) const;
+
+    int in_fd_;
+    int out_fd_;
+    std::string buf_;
+    bool no_ack_ {false};
+    bool compress_ {false};
+    bool interrupted_ {false};
+};
+
+// Hex digits of <len> bytes, in memory order
+std::string toHex(const void *data, std::size_t len);
+
+// Bytes of the hex digits in <text>, "xx" (unavailable) reads as 0.
+// False if <text> isn't hex
+bool fromHex(const std::string &text, std::vector<uint8_t> *out);
+
+// Hex number at <*pos> of <text>; <*pos> is moved past it. False if
+// there are no digits there
+bool parseHex(const std::string &text, std::size_t *pos, uint64_t *out);
+
+// Binary data with '#', '$', '}' & '*' escaped as '}' + (byte ^ 0x20)
+std::string escapeBinary(const void *data, std::size_t len);
+
+std::vector<uint8_t> unescapeBinary(const std::string &text, std::size_t pos = 0);
+
+// GDB's amd64 register numbers: rax rbx rcx rdx rsi rdi rbp rsp r8-r15
+// (0-15), rip, eflags, cs ss ds es fs gs (16-23), st0-7 (24-31), fctrl
+// fstat ftag fiseg fioff foseg fooff fop (32-39), xmm0-15 (40-55), mxcsr
+constexpr unsigned rsp_register_count = 57;
+
+// Size of a 'g' packet's data
+constexpr std::size_t rsp_registers_size = 536;
+
+// Bytes of register <regno> in a 'g' packet, 0 if there's no such one
+unsigned rspRegisterSize(unsigned regno);
+
+// Number of <r> in the 'g' packet, -1 if it isn't part of it
+int rspRegisterNumber(Reg r);
+
+// Register <regno> in its 'g' packet form
+void rspPackRegister(const user_regs_struct &regs, const user_fpregs_struct &fp,
+                     unsigned regno, uint8_t *out);
+
+void rspUnpackRegister(user_regs_struct *regs, user_fpregs_struct *fp,
+                       unsigned regno, const uint8_t *in);
+
+// GDB's signal numbers differ from Linux's past SIGABRT
+int rspSignalFromLinux(int sig);
+
+int linuxSignalFromRsp(int sig);
+
+// Accept a single connection on "[host:]port", or use stdin & stdout
+// for "-". Throw std::runtime_error on failure
+void rspListen(const std::string &address, int *in_fd, int *out_fd);
+
+// Connect to "host:port", or run "|command" with a socket as its stdin
+// & stdout. Return the socket. Throw std::runtime_error on failure
+int rspConnect(const std::string &target);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef SCOPE_INDEX_HH
+#define SCOPE_INDEX_HH
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dwarf++.hh"
+
+// DW_AT_name of <d>, or of the declaration it defines (out-of-class
+// members). Empty if anonymous
+std::string dieName(const dwarf::die &d);
+
+// A function or one of its {} blocks, with the variables it declares.
+// Blocks without a PC range are merged into their parent
+struct Scope {
+    dwarf::die die;                     // subprogram or lexical_block
+    dwarf::die cu;                      // root of its compilation unit
+    const Scope *parent {nullptr};      // nullptr for the function
+    std::vector<std::pair<uint64_t, uint64_t>> ranges; // DWARF addresses
+    std::vector<dwarf::die> variables;  // variables & parameters
+    std::vector<std::unique_ptr<Scope>> blocks;
+
+    bool contains(uint64_t pc) const;
+};
+
+// Functions of a program keyed by PC range, each with its tree of
+// lexical scopes, and its global variables keyed by name. Both are built
+// on first use; a function's scope tree when a PC first falls into it
+class ScopeIndex {
+public:
+    explicit ScopeIndex(const dwarf::dwarf &dw) : dw_{dw} {}
+
+    ScopeIndex(const ScopeIndex &) = delete;
+    ScopeIndex &operator=(const ScopeIndex &) = delete;
+
+    // Function containing the DWARF address <pc>, nullptr if none
+    const Scope *function(uint64_t pc);
+
+    // Innermost block (or the function) containing <pc>, nullptr if none
+    const Scope *innermost(uint64_t pc);
+
+    // Variable <name> declared in <scope> or around it, innermost first:
+    // shadowed names resolve to the nearest declaration
+    static bool findLocal(const Scope *scope, const std::string &name, dwarf::die *out);
+
+    // Global variable <name> ("x" or "ns::x"), from the compilation unit
+    // <cu> if it defines one
+    bool findGlobal(const std::string &name, const dwarf::die &cu, dwarf::die *out);
+
+private:
+    struct FunctionRange {
+        uint64_t low, high;
+        size_t function;
+    };
+
+    struct Function {
+        dwarf::die die;
+        dwarf::die cu;
+        std::unique_ptr<Scope> tree;
+    };
+
+    void indexFunctions();
+    void indexGlobals();
+
+    const dwarf::dwarf &dw_;
+    bool functions_indexed_ {false};
+    bool globals_indexed_ {false};
+    std::vector<FunctionRange> ranges_; // sorted by low
+    std::vector<Function> functions_;
+    // name -> (definition, offset of its compilation unit)
+    std::unordered_multimap<std::string, std::pair<dwarf::die, dwarf::section_offset>> globals_;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef SIGNAL_TABLE_HH
+#define SIGNAL_TABLE_HH
+
+#include <array>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+
+// What a signal of the debuggee does (`handle <sig> ...`)
+struct SignalDisposition {
+    bool stop {true};   // back to the prompt
+    bool print {true};  // say it arrived
+    bool pass {true};   // deliver it on resume
+};
+
+// Per-signal dispositions, with gdb's defaults: timers, SIGCHLD, SIGWINCH
+// & co neither stop nor print, SIGINT (mdb's own ^C) isn't passed on
+class SignalTable {
+public:
+    SignalTable();
+
+    const SignalDisposition &operator[](int sig) const { return table_.at(sig); }
+
+    // Apply `handle` keywords (stop, nostop, print, noprint, pass,
+    // nopass) to <sig>. False on an unknown keyword
+    bool set(int sig, const std::vector<std::string> &keywords);
+
+    // Table lines of <sig>, or of all signals if 0
+    void print(std::ostream &os, int sig = 0) const;
+
+private:
+    std::array<SignalDisposition, NSIG> table_;
+};
+
+// Number of "SIGUSR1", "USR1" or "10"; 0 if there's no such signal
+int signalNumber(const std::string &name);
+
+// "SIGUSR1", "SIG40" for the real-time ones
+std::string signalName(int sig);
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef STATS_HH
+#define STATS_HH
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include <sys/ptrace.h>
+#include <sys/types.h>
+
+// Latency histogram with power-of-two nanosecond buckets
+class Histogram {
+public:
+    void add(std::chrono::nanoseconds d);
+
+    uint64_t count() const { return count_; }
+    uint64_t totalNs() const { return total_ns_; }
+    uint64_t maxNs() const { return max_ns_; }
+
+    // Upper bound of the bucket holding the <p>th percentile (0 < p <= 1)
+    uint64_t percentileNs(double p) const;
+
+private:
+    std::array<uint64_t, 48> buckets_{};
+    uint64_t count_{0};
+    uint64_t total_ns_{0};
+    uint64_t max_ns_{0};
+};
+
+// mdb's own work: ptrace & waitpid calls, time blocked waiting for the
+// debuggee, DWARF/symbol lookups and commands. See the `stats` command
+class Stats {
+public:
+    // Running sums, diffed around a command for its trace line
+    struct Totals {
+        uint64_t ptrace_calls;
+        uint64_t ptrace_ns;
+        uint64_t waits;
+        uint64_t wait_ns;
+        uint64_t lookups;
+        uint64_t lookup_ns;
+    };
+
+    Histogram &ptraceCalls(int request) { return ptrace_[request]; }
+
+    // waitpids outside a stop wait
+    Histogram &waitpidCalls() { return waitpid_; }
+
+    // blocked until the debuggee stops, waitpids included
+    Histogram &stopWait() { return stop_wait_; }
+    bool inStopWait() const { return stop_wait_depth_ > 0; }
+
+    Histogram &lookup(const std::string &what) { return lookups_[what]; }
+
+    Histogram &command(const std::string &name) { return commands_[name]; }
+
+    Totals totals() const;
+
+    void print(std::ostream &os) const;
+
+    void reset();
+
+    // Print the cost of each command after it
+    bool trace{false};
+
+private:
+    std::map<int, Histogram> ptrace_;
+    Histogram waitpid_;
+    Histogram stop_wait_;
+    std::map<std::string, Histogram> lookups_;
+    std::map<std::string, Histogram> commands_;
+    int stop_wait_depth_{0};
+
+    friend class StopWaitTimer;
+};
+
+// The process-wide counters
+Stats &stats();
+
+// Add the lifetime of the enclosing scope to <h>
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram &h)
+        : histogram_{h}, start_{std::chrono::steady_clock::now()} {}
+    ~ScopedTimer() { histogram_.add(std::chrono::steady_clock::now() - start_); }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    Histogram &histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Time one command; with tracing on, print what it cost when done
+class CommandScope {
+public:
+    CommandScope();
+    ~CommandScope();
+
+    // nothing is recorded until the command is known to have run
+    void setName(const std::string &name) { name_ = name; }
+
+private:
+    std::string name_;
+    Stats::Totals before_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Time a wait for the debuggee to stop into Stats::stopWait()
+class StopWaitTimer {
+public:
+    StopWaitTimer() : timer_{stats().stopWait()} { ++stats().stop_wait_depth_; }
+    ~StopWaitTimer() { --stats().stop_wait_depth_; }
+
+    StopWaitTimer(const StopWaitTimer &) = delete;
+    StopWaitTimer &operator=(const StopWaitTimer &) = delete;
+
+private:
+    ScopedTimer timer_;
+};
+
+// ptrace(2), counted & timed per request
+template <typename Addr, typename Data>
+long countedPtrace(__ptrace_request request, pid_t pid, Addr addr, Data data) {
+    ScopedTimer timer {stats().ptraceCalls(request)};
+    return ptrace(request, pid, addr, data);
+}
+
+// waitpid(2), counted & timed
+pid_t countedWaitpid(pid_t pid, int *status, int options);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SYSCALL_CATCH_HH
+#define SYSCALL_CATCH_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <linux/filter.h>
+
+// `catch syscall <name|nr> [if argN==X]`: stop when the debuggee enters
+// a system call. A seccomp filter in the debuggee returns
+// SECCOMP_RET_TRACE, with the catchpoint id as data, for the selected
+// calls only: they become PTRACE_EVENT_SECCOMP stops while every other
+// syscall runs without a stop (unlike PTRACE_SYSCALL)
+struct SyscallCatchpoint {
+    unsigned id {0};
+    int nr {-1};
+    int arg {-1};       // argument compared to <value>, -1 for any call
+    uint64_t value {0};
+};
+
+// x86-64 number of syscall <name> (or a plain number), -1 if unknown
+int syscallNumber(const std::string &name);
+
+// Name of syscall <nr>, the number itself if unknown
+std::string syscallName(int nr);
+
+// Parse "<name|nr> [if argN==X]" from <args>. False if malformed
+bool parseSyscallCatchpoint(const std::vector<std::string> &args, SyscallCatchpoint *out);
+
+// "write if arg0==1"
+std::string describe(const SyscallCatchpoint &cp);
+
+// BPF program tracing the calls selected by <catchpoints>, allowing
+// everything else
+std::vector<sock_filter> buildSyscallFilter(const std::vector<SyscallCatchpoint> &catchpoints);
+
+// Install <filter> in the calling process (setting no_new_privs, so no
+// privilege is needed). False on failure
+bool installSyscallFilter(const std::vector<sock_filter> &filter);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef TRACEPOINT_HH
+#define TRACEPOINT_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "x86-decode.hh"
+
+class Debugger;
+
+// Max number of tracepoints (ids index the hit counters)
+constexpr std::size_t max_tracepoints = 256;
+
+// One hit, written by a trampoline into the shared ring
+struct TraceEvent {
+    uint64_t tsc;      // rdtsc at the time of the hit
+    uint32_t id;       // tracepoint id
+    uint32_t reserved;
+};
+
+// Header of the memory shared between mdb and the debuggee.
+// The event ring starts at trace_events_offset
+struct TraceBufferHeader {
+    uint64_t head;                      // number of events ever written
+    uint64_t capacity;                  // ring slots, power of 2
+    uint64_t hits[max_tracepoints];     // exact per-tracepoint counters
+};
+
+constexpr std::size_t trace_events_offset = 4096;
+constexpr std::size_t trace_ring_capacity = 1 << 16;
+
+struct Tracepoint {
+    unsigned id;
+    uint64_t address;           // first probed instruction
+    uint64_t trampoline;        // out-of-line code
+    uint64_t trampoline_end;
+    std::vector<uint8_t> saved; // original bytes replaced by the jump
+    std::string description;
+    bool trap {false};          // an int3 instead, logged by mdb at the stop
+};
+
+// Fast tracepoints: the probed instructions are replaced by a jump to a
+// trampoline that logs the hit into shared memory, runs the relocated
+// instructions and jumps back. The debuggee never stops on a hit.
+// Where a branch lands inside the jump's bytes, an int3 is used instead:
+// mdb logs the hit into the same buffer and resumes
+class TraceAgent {
+public:
+    explicit TraceAgent(Debugger &dbg) : dbg_{dbg} {}
+    ~TraceAgent();
+
+    TraceAgent(const TraceAgent &) = delete;
+    TraceAgent &operator=(const TraceAgent &) = delete;
+
+    // Is the agent buffer injected into the debuggee
+    bool isInstalled() const { return header_ != nullptr; }
+
+    // Inject code & shared buffers into the debuggee, within jump
+    // range of <anchor>
+    bool install(uint64_t anchor);
+
+    // Patch a jump to a new trampoline at <address>, or an int3 if the
+    // jump can't go there
+    bool addTracepoint(uint64_t address, const std::string &description);
+
+    // Log a hit if <address> is an int3 tracepoint. False if it isn't
+    bool logTrapHit(uint64_t address);
+
+    // Restore the original bytes of tracepoint <id>
+    bool removeTracepoint(unsigned id);
+
+    // Does any tracepoint patch the byte at <address>
+    bool isPatched(uint64_t address) const;
+
+    // Is <address> inside agent code
+    bool isTrampoline(uint64_t address) const;
+
+    // Print tracepoints with their hit counts
+    void printStatus() const;
+
+    // Print the last <n> events of the ring
+    void printEvents(std::size_t n) const;
+
+private:
+    // Emit the logging prologue + relocated code + jump back
+    bool buildTrampoline(const Tracepoint &tp,
+                         const std::vector<Instruction> &insns,
+                         std::vector<uint8_t> *code) const;
+
+    // Add the int3 tracepoint at <address>
+    bool addTrapTracepoint(uint64_t address, const std::string &description);
+
+    // Can a direct branch of the function around <address> land inside
+    // [address, address + length)? Assumed if the function is unknown
+    bool isBranchedInto(uint64_t address, std::size_t length);
+
+    void logEvent(unsigned id);
+
+    const TraceEvent *events() const;
+
+    Debugger &dbg_;
+
+    uint64_t code_base_{0};      // trampolines, mapped r-x in the debuggee
+    uint64_t code_used_{0};
+    uint64_t data_remote_{0};    // shared buffer as seen by the debuggee
+    TraceBufferHeader *header_{nullptr}; // the same buffer mapped in mdb
+    std::size_t data_size_{0};
+
+    std::vector<Tracepoint> tracepoints_;
+    unsigned next_id_{1};
+};
+
+#endif
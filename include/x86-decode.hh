@@ -0,0 +1,68 @@
+#ifndef X86_DECODE_HH
+#define X86_DECODE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Longest legal x86 instruction
+constexpr std::size_t max_instruction_length = 15;
+
+// Control-flow class of a decoded instruction
+enum class FlowType {
+    none,           // falls through to the next instruction
+    jump,           // jmp rel8/rel32
+    cond_jump,      // jcc, loop, jrcxz
+    call,           // call rel32
+    ret,            // ret, retf, iret
+    indirect_jump,  // jmp r/m, jmp far
+    indirect_call,  // call r/m, call far
+    syscall,        // syscall, sysenter
+    interrupt,      // int3, int n, int1, ud2, hlt
+};
+
+struct Instruction {
+    uint64_t address;   // where the instruction was decoded from
+    bool valid;         // false: undecodable byte, kept with length 1
+    uint8_t length;
+    uint8_t bytes[max_instruction_length];
+
+    uint8_t map;        // 0: one byte, 1: 0F, 2: 0F38, 3: 0F3A
+    uint8_t opcode;
+    uint8_t opcode_offset;
+    uint8_t rex;        // 0 if absent
+    bool vex;           // VEX/EVEX encoded
+    bool operand16;     // 0x66 prefix
+    bool has_modrm;
+    uint8_t modrm;
+    bool has_sib;
+    uint8_t sib;
+
+    uint8_t disp_offset; // 0 if no displacement
+    uint8_t disp_size;
+    uint8_t imm_offset;  // 0 if no immediate
+    uint8_t imm_size;
+
+    bool rip_relative;   // memory operand is [rip + disp32]
+    FlowType flow;
+    uint64_t target;     // branch target (direct branches) or
+                         // memory operand address (rip_relative)
+};
+
+// Decode one x86-64 instruction from at most <len> bytes.
+// Return false on an invalid or truncated encoding
+bool decodeInstruction(const uint8_t *bytes, std::size_t len,
+                       uint64_t address, Instruction *out);
+
+// Re-encode <insn> so that it behaves identically when executed
+// at <new_address>: RIP-relative displacements are re-based and
+// short branches are widened to rel32.
+// Return false if the instruction can't be moved (loop/jrcxz,
+// target out of +-2GB range)
+bool relocateInstruction(const Instruction &insn, uint64_t new_address,
+                         std::vector<uint8_t> *out);
+
+// Does a rel32 displacement from <from> reach <to>?
+bool fitsRel32(uint64_t from, uint64_t to);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef X86_FORMAT_HH
+#define X86_FORMAT_HH
+
+#include <string>
+
+#include "x86-decode.hh"
+
+// Intel-syntax text of a decoded instruction ("mov rbp, rsp").
+// Branch targets & RIP-relative operands are printed as absolute
+// addresses. Opcodes without a known mnemonic print as "(unknown)"
+std::string formatInstruction(const Instruction &insn);
+
+#endif
@@ -0,0 +1,67 @@
+#include <algorithm>
+
+#include "completion.hh"
+#include "scope-index.hh"
+#include "stats.hh"
+
+namespace {
+
+// Globals of <parent> & of the namespaces in it, as "ns::x"
+void addVariables(const dwarf::die &parent, const std::string &scope,
+                  std::vector<std::string> *out) {
+    for (const auto &die : parent) {
+        if (die.tag == dwarf::DW_TAG::namespace_) {
+            auto name = dieName(die);
+            addVariables(die, scope + (name.empty() ? "" : name + "::"), out);
+        }
+        else if (die.tag == dwarf::DW_TAG::variable && die.has(dwarf::DW_AT::name)) {
+            out->push_back(scope + at_name(die));
+        }
+    }
+}
+
+} // namespace
+
+void completeSorted(const std::vector<std::string> &names, const std::string &prefix,
+                    size_t max, std::vector<std::string> *out) {
+    for (auto it = std::lower_bound(names.begin(), names.end(), prefix);
+            it != names.end() && out->size() < max
+            && it->compare(0, prefix.size(), prefix) == 0; ++it)
+        out->push_back(*it);
+}
+
+void CompletionIndex::build() {
+    built_ = true;
+    ScopedTimer timer {stats().lookup("completion-index")};
+    auto &functions = names_[static_cast<int>(NameKind::function)];
+    auto &variables = names_[static_cast<int>(NameKind::variable)];
+    auto &files = names_[static_cast<int>(NameKind::file)];
+
+    for (const auto &sym : symbols_) {
+        for (const auto &s : sym.second) {
+            if (s.type == SymbolType::func) functions.push_back(sym.first);
+            else if (s.type == SymbolType::object) variables.push_back(sym.first);
+        }
+    }
+    // the functions `break` resolves: named top-level subprograms
+    for (const auto &cu : dw_.compilation_units()) {
+        for (const auto &die : cu.root())
+            if (die.tag == dwarf::DW_TAG::subprogram && die.has(dwarf::DW_AT::name))
+                functions.push_back(at_name(die));
+        addVariables(cu.root(), "", &variables);
+    }
+    for (const auto &path : lines_.files())
+        files.push_back(path.substr(path.rfind('/') + 1));
+
+    for (auto &names : names_) {
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        names.shrink_to_fit();
+    }
+}
+
+void CompletionIndex::complete(NameKind kind, const std::string &prefix, size_t max,
+                               std::vector<std::string> *out) {
+    if (!built_) build();
+    completeSorted(names_[static_cast<int>(kind)], prefix, max, out);
+}
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/procfs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "core-file.hh"
+
+namespace {
+
+// mmap a whole file read-only, nullptr on failure
+const uint8_t *mapWholeFile(const std::string &path, size_t *size) {
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    // pages are only touched on access: a huge core maps instantly
+    auto p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return nullptr;
+
+    *size = st.st_size;
+    return static_cast<const uint8_t *>(p);
+}
+
+size_t align4(size_t n) { return (n + 3) & ~size_t{3}; }
+
+std::string realPath(const std::string &path) {
+    char buf[PATH_MAX];
+    return realpath(path.c_str(), buf) ? std::string{buf} : path;
+}
+
+} // namespace
+
+CoreFile::CoreFile(const std::string &path) {
+    data_ = mapWholeFile(path, &size_);
+    if (!data_) throw std::runtime_error("Can't map core file " + path);
+    // the destructor won't run for a half-built CoreFile
+    try {
+        parse(path);
+    } catch (...) {
+        munmap(const_cast<uint8_t *>(data_), size_);
+        throw;
+    }
+}
+
+void CoreFile::parse(const std::string &path) {
+    if (size_ < sizeof(Elf64_Ehdr)) throw std::runtime_error("Core file too small");
+    auto ehdr = reinterpret_cast<const Elf64_Ehdr *>(data_);
+    if (std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0
+            || ehdr->e_ident[EI_CLASS] != ELFCLASS64
+            || ehdr->e_type != ET_CORE
+            || ehdr->e_machine != EM_X86_64) {
+        throw std::runtime_error(path + " is not an x86-64 ELF core file");
+    }
+    if (ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) > size_)
+        throw std::runtime_error("Truncated core file");
+
+    auto phdrs = reinterpret_cast<const Elf64_Phdr *>(data_ + ehdr->e_phoff);
+    for (unsigned i = 0; i < ehdr->e_phnum; ++i) {
+        const auto &ph = phdrs[i];
+        // a truncated core keeps whatever part of the segment made it
+        auto filesz = ph.p_offset < size_
+                    ? std::min<uint64_t>(ph.p_filesz, size_ - ph.p_offset) : 0;
+
+        if (ph.p_type == PT_LOAD && ph.p_memsz) {
+            segments_[ph.p_vaddr + ph.p_memsz] =
+                Segment{ph.p_vaddr, ph.p_memsz, ph.p_offset, filesz};
+        }
+        else if (ph.p_type == PT_NOTE) {
+            parseNotes(data_ + ph.p_offset, filesz);
+        }
+    }
+
+    if (!has_regs_) throw std::runtime_error("Core file has no NT_PRSTATUS note");
+}
+
+CoreFile::~CoreFile() {
+    munmap(const_cast<uint8_t *>(data_), size_);
+    for (auto &image : file_images_)
+        if (image.second.first)
+            munmap(const_cast<uint8_t *>(image.second.first), image.second.second);
+}
+
+void CoreFile::parseNotes(const uint8_t *notes, size_t size) {
+    size_t pos = 0;
+    unsigned prstatus_count = 0;
+    while (pos + sizeof(Elf64_Nhdr) <= size) {
+        auto nhdr = reinterpret_cast<const Elf64_Nhdr *>(notes + pos);
+        pos += sizeof(Elf64_Nhdr);
+        auto desc = notes + pos + align4(nhdr->n_namesz);
+        pos += align4(nhdr->n_namesz) + align4(nhdr->n_descsz);
+        if (pos > size) break;
+
+        switch (nhdr->n_type) {
+            case NT_PRSTATUS: {
+                ++prstatus_count;
+                // first one is the thread that got the fatal signal
+                if (has_regs_ || nhdr->n_descsz < sizeof(elf_prstatus)) break;
+                elf_prstatus status;
+                std::memcpy(&status, desc, sizeof(status));
+                static_assert(sizeof(status.pr_reg) == sizeof(user_regs_struct),
+                              "elf_gregset_t layout differs from user_regs_struct");
+                std::memcpy(&regs_, &status.pr_reg, sizeof(regs_));
+                pid_ = status.pr_pid;
+                signal_ = status.pr_cursig;
+                has_regs_ = true;
+                break;
+            }
+            case NT_PRFPREG:
+                // notes of a thread follow its NT_PRSTATUS
+                if (!has_regs_ || prstatus_count > 1 || has_xstate_) break;
+                std::memcpy(&fp_regs_.fx, desc,
+                            std::min<size_t>(nhdr->n_descsz, sizeof(fp_regs_.fx)));
+                break;
+            case NT_X86_XSTATE:
+                if (!has_regs_ || prstatus_count > 1 || has_xstate_) break;
+                fpRegistersFromXsave(desc, nhdr->n_descsz, &fp_regs_);
+                has_xstate_ = true;
+                break;
+            case NT_FILE:
+                parseFileNote(desc, nhdr->n_descsz);
+                break;
+        }
+    }
+}
+
+// count, page size, count * {start, end, page offset}, count file names
+void CoreFile::parseFileNote(const uint8_t *desc, size_t size) {
+    if (size < 16) return;
+    uint64_t count, page_size;
+    std::memcpy(&count, desc, 8);
+    std::memcpy(&page_size, desc + 8, 8);
+
+    auto entries = desc + 16;
+    auto end = desc + size;
+    // count is read from the core: don't let count * 24 wrap
+    if (count > static_cast<uint64_t>(end - entries) / 24) return;
+    auto names = entries + count * 24;
+
+    for (uint64_t i = 0; i < count && names < end; ++i) {
+        uint64_t range[3];
+        std::memcpy(range, entries + i * 24, sizeof(range));
+        auto len = strnlen(reinterpret_cast<const char *>(names), end - names);
+        std::string name {reinterpret_cast<const char *>(names), len};
+        names += len + 1;
+
+        files_[range[1]] = FileMapping{range[0], range[1], range[2] * page_size, name};
+    }
+}
+
+const uint8_t *CoreFile::mapFile(const std::string &path, size_t *size) const {
+    auto it = file_images_.find(path);
+    if (it == file_images_.end()) {
+        size_t image_size = 0;
+        auto image = mapWholeFile(path, &image_size);
+        it = file_images_.emplace(path, std::make_pair(image, image_size)).first;
+    }
+    *size = it->second.second;
+    return it->second.first;
+}
+
+const uint8_t *CoreFile::map(uint64_t address, size_t len) const {
+    auto seg = segments_.upper_bound(address);
+    if (seg != segments_.end() && seg->second.vaddr <= address) {
+        const auto &s = seg->second;
+        if (address + len <= s.vaddr + s.filesz)
+            return data_ + s.offset + (address - s.vaddr);
+    }
+
+    // Read-only file mappings (.text, .rodata) are usually not dumped:
+    // serve them from the mapped file itself
+    auto file = files_.upper_bound(address);
+    if (file == files_.end() || file->second.start > address
+            || address + len > file->second.end)
+        return nullptr;
+
+    size_t image_size;
+    auto image = mapFile(file->second.path, &image_size);
+    auto offset = file->second.file_offset + (address - file->second.start);
+    if (!image || offset + len > image_size) return nullptr;
+    return image + offset;
+}
+
+bool CoreFile::read(uint64_t address, void *buf, size_t len) const {
+    auto out = static_cast<uint8_t *>(buf);
+    while (len) {
+        auto seg = segments_.upper_bound(address);
+        if (seg == segments_.end() || seg->second.vaddr > address) return false;
+
+        const auto &s = seg->second;
+        size_t n = std::min<uint64_t>(len, s.vaddr + s.memsz - address);
+        if (address < s.vaddr + s.filesz)
+            n = std::min<uint64_t>(n, s.vaddr + s.filesz - address);
+
+        if (auto p = map(address, n)) std::memcpy(out, p, n);
+        else std::memset(out, 0, n); // omitted from the dump
+
+        address += n;
+        out += n;
+        len -= n;
+    }
+    return true;
+}
+
+std::vector<MemoryRegion> CoreFile::regions() const {
+    std::vector<MemoryRegion> out;
+    for (const auto &seg : segments_) {
+        MemoryRegion region {seg.second.vaddr, seg.first, true, ""};
+        auto file = files_.upper_bound(region.start);
+        if (file != files_.end() && file->second.start <= region.start)
+            region.path = file->second.path;
+        out.push_back(region);
+    }
+    return out;
+}
+
+uint64_t CoreFile::loadAddress(const std::string &file) const {
+    auto path = realPath(file);
+    uint64_t lowest = 0;
+    for (const auto &f : files_) {
+        if (f.second.path != path) continue;
+        if (!lowest || f.second.start < lowest) lowest = f.second.start;
+    }
+    return lowest;
+}
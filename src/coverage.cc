@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "coverage.hh"
+#include "debugger.hh"
+#include "stats.hh"
+
+namespace {
+
+// Sites closer than this share one read & one write
+constexpr uint64_t span_gap = 64;
+
+struct Span {
+    uint64_t start;
+    std::vector<uint8_t> bytes;
+};
+
+} // namespace
+
+size_t CoverageRun::plant(const std::vector<std::string> &filters) {
+    ScopedTimer timer {stats().lookup("coverage-plant")};
+
+    for (const auto &cu : dbg_.program()->dwarf.compilation_units()) {
+        if (!cu.root().has(dwarf::DW_AT::stmt_list)) continue;
+        auto name = cu.root().has(dwarf::DW_AT::name) ? at_name(cu.root()) : "";
+        if (!filters.empty() && std::none_of(filters.begin(), filters.end(),
+                [&name](const std::string &f) { return name.find(f) != std::string::npos; }))
+            continue;
+
+        for (const auto &entry : cu.get_line_table()) {
+            if (!entry.is_stmt || entry.end_sequence || !entry.line) continue;
+            auto &site = sites_[dbg_.offsetDwarfAddress(entry.address)];
+            std::pair<std::string, unsigned> line {entry.file->path, entry.line};
+            if (std::find(site.lines.begin(), site.lines.end(), line) == site.lines.end())
+                site.lines.push_back(line);
+            hits_[line.first][line.second];   // found, not hit yet
+        }
+    }
+
+    // group nearby sites into spans, all read in one batch
+    std::vector<uint64_t> addrs;
+    for (const auto &s : sites_) addrs.push_back(s.first);
+    std::sort(addrs.begin(), addrs.end());
+    std::vector<Span> spans;
+    for (auto addr : addrs) {
+        if (spans.empty() || addr >= spans.back().start + spans.back().bytes.size() + span_gap)
+            spans.push_back({addr, {}});
+        spans.back().bytes.resize(addr - spans.back().start + 1);
+    }
+    std::vector<iovec> local, remote;
+    for (auto &span : spans) {
+        local.push_back({span.bytes.data(), span.bytes.size()});
+        remote.push_back({reinterpret_cast<void*>(span.start), span.bytes.size()});
+    }
+    bool all_read = dbg_.readMemoryBlocks(local, remote);
+
+    // patch in the int3s & write each span back with a single pwrite
+    auto pid = dbg_.getPid();
+    int mem_fd = open(("/proc/" + std::to_string(pid) + "/mem").c_str(), O_RDWR | O_CLOEXEC);
+    for (auto &span : spans) {
+        auto end = span.start + span.bytes.size();
+        if (!all_read && !dbg_.readMemoryBlock(span.start, span.bytes.data(), span.bytes.size())) {
+            std::cerr << "Can't read code at 0x" << std::hex << span.start << std::endl;
+            for (auto it = sites_.begin(); it != sites_.end();) {
+                if (it->first >= span.start && it->first < end) it = sites_.erase(it);
+                else ++it;
+            }
+            continue;
+        }
+        for (auto it = std::lower_bound(addrs.begin(), addrs.end(), span.start);
+                it != addrs.end() && *it < end; ++it) {
+            auto &byte = span.bytes[*it - span.start];
+            sites_[*it].original = byte;
+            byte = 0xcc;
+        }
+        // /proc/<pid>/mem writes through read-only text like POKEDATA
+        if (mem_fd < 0 || pwrite(mem_fd, span.bytes.data(), span.bytes.size(), span.start)
+                != static_cast<ssize_t>(span.bytes.size()))
+            dbg_.writeMemoryBlock(span.start, span.bytes.data(), span.bytes.size());
+    }
+    if (mem_fd >= 0) close(mem_fd);
+    return sites_.size();
+}
+
+int CoverageRun::run() {
+    auto main_pid = dbg_.getPid();
+    std::set<pid_t> live {main_pid};
+    std::set<pid_t> starting;   // announced by their parent, first stop not seen yet
+    std::set<pid_t> early;      // first stop seen before their parent's event
+    int exit_code = 0;
+
+    // threads run the same int3s: they're traced too
+    countedPtrace(PTRACE_SETOPTIONS, main_pid, nullptr,
+                  PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE
+                  | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL | PTRACE_O_TRACESYSGOOD);
+    countedPtrace(PTRACE_CONT, main_pid, nullptr, nullptr);
+    while (!live.empty()) {
+        int status;
+        auto pid = countedWaitpid(-1, &status, __WALL);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            live.erase(pid);
+            if (pid == main_pid)
+                exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            continue;
+        }
+        if (!WIFSTOPPED(status)) continue;
+
+        int signal = WSTOPSIG(status);
+        int event = status >> 16;
+        if (!live.count(pid) || starting.erase(pid)) {
+            // first stop (SIGSTOP) of a thread, or of a forked child
+            // carrying its parent's int3s
+            if (live.insert(pid).second) early.insert(pid);
+            signal = 0;
+        }
+        else if (signal == SIGTRAP && event) {
+            if (event == PTRACE_EVENT_EXEC) exec_pids_.insert(pid);
+            if (event == PTRACE_EVENT_CLONE || event == PTRACE_EVENT_FORK
+                    || event == PTRACE_EVENT_VFORK) {
+                // live from now on, so that the run doesn't end before it
+                unsigned long child = 0;
+                countedPtrace(PTRACE_GETEVENTMSG, pid, nullptr, &child);
+                if (!early.erase(child)) {
+                    live.insert(child);
+                    starting.insert(child);
+                }
+            }
+            signal = 0;
+        }
+        else if (signal == (SIGTRAP | 0x80)) {
+            signal = 0;
+        }
+        else if (signal == SIGTRAP && !exec_pids_.count(pid)) {
+            user_regs_struct regs;
+            countedPtrace(PTRACE_GETREGS, pid, nullptr, &regs);
+            // the site stays known: another thread may have trapped on it
+            // before the byte came back
+            if (sites_.count(regs.rip - 1)) {
+                regs.rip -= 1;
+                restore(pid, regs.rip);
+                countedPtrace(PTRACE_SETREGS, pid, nullptr, &regs);
+                signal = 0;
+            }
+        }
+        // anything else is the debuggee's own signal: pass it on
+        countedPtrace(PTRACE_CONT, pid, nullptr, static_cast<long>(signal));
+    }
+    return exit_code;
+}
+
+// Threads share the code, so the byte is back for all of them before
+// any is resumed
+void CoverageRun::restore(pid_t pid, uint64_t addr) {
+    auto &site = sites_[addr];
+    auto word_addr = addr & ~uint64_t{sizeof(long) - 1};
+    auto word = countedPtrace(PTRACE_PEEKDATA, pid, word_addr, nullptr);
+    auto &byte = reinterpret_cast<uint8_t*>(&word)[addr - word_addr];
+    if (byte != 0xcc) return;   // restored already, for a sibling thread
+
+    for (const auto &line : site.lines) ++hits_[line.first][line.second];
+    byte = site.original;
+    countedPtrace(PTRACE_POKEDATA, pid, word_addr, word);
+}
+
+bool CoverageRun::writeLcov(const std::string &path) const {
+    std::ofstream out {path};
+    if (!out) return false;
+    out << "TN:\n";
+    for (const auto &file : hits_) {
+        size_t hit = 0;
+        out << "SF:" << file.first << "\n";
+        for (const auto &line : file.second) {
+            out << "DA:" << line.first << "," << line.second << "\n";
+            if (line.second) ++hit;
+        }
+        out << "LF:" << file.second.size() << "\n"
+            << "LH:" << hit << "\n"
+            << "end_of_record\n";
+    }
+    return static_cast<bool>(out.flush());
+}
+
+std::pair<size_t, size_t> CoverageRun::lineCounts() const {
+    size_t found = 0, hit = 0;
+    for (const auto &file : hits_) {
+        found += file.second.size();
+        hit += std::count_if(file.second.begin(), file.second.end(),
+                             [](const auto &line) { return line.second > 0; });
+    }
+    return {found, hit};
+}
@@ -0,0 +1,335 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef MDB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "debug-info.hh"
+#include "helper.hh"
+#include "stats.hh"
+
+#ifndef SHF_COMPRESSED
+#define SHF_COMPRESSED (1 << 11)
+#endif
+#ifndef ELFCOMPRESS_ZLIB
+#define ELFCOMPRESS_ZLIB 1
+#endif
+#ifndef ELFCOMPRESS_ZSTD
+#define ELFCOMPRESS_ZSTD 2
+#endif
+
+namespace {
+
+// Legacy GNU compression of .zdebug_* sections: "ZLIB", big-endian
+// size, then the zlib stream
+constexpr uint32_t compress_gnu_zlib = ~0u;
+
+std::vector<std::string> debugDirectories() {
+    auto env = getenv("MDB_DEBUG_FILE_DIRECTORY");
+    if (!env || !*env) return {"/usr/lib/debug"};
+    return split(env, ':');
+}
+
+bool isFile(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+std::string realPath(const std::string &path) {
+    char buf[PATH_MAX];
+    return realpath(path.c_str(), buf) ? buf : path;
+}
+
+// CRC32 of the whole file, as stored in .gnu_debuglink
+bool fileCrc(const std::string &path, uint32_t *out) {
+    std::ifstream file {path, std::ios::binary};
+    if (!file) return false;
+    std::vector<char> buf(1 << 20);
+    uLong crc = crc32(0, nullptr, 0);
+    while (file.read(buf.data(), buf.size()) || file.gcount() > 0)
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(buf.data()), file.gcount());
+    *out = crc;
+    return true;
+}
+
+// ~/.cache/mdb/sections, empty if there's no home
+std::string cacheRoot() {
+    if (auto xdg = getenv("XDG_CACHE_HOME"); xdg && *xdg) return std::string{xdg} + "/mdb/sections";
+    if (auto home = getenv("HOME"); home && *home) return std::string{home} + "/.cache/mdb/sections";
+    return "";
+}
+
+bool makeDirectories(const std::string &path) {
+    for (size_t pos = 1; pos != std::string::npos;) {
+        pos = path.find('/', pos + 1);
+        auto dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) return false;
+    }
+    return true;
+}
+
+// A compressed section waiting to be inflated
+struct Pending {
+    dwarf::section_type type;
+    std::string name;
+    uint32_t format;            // ELFCOMPRESS_* or compress_gnu_zlib
+    const uint8_t *in;
+    size_t in_size;
+    std::vector<uint8_t> out;   // sized to the uncompressed size
+    std::string cache_file;     // empty if not cached
+    bool inflated {false};
+    bool cached {false};
+};
+
+bool inflateZlib(const uint8_t *in, size_t in_size, std::vector<uint8_t> *out) {
+    z_stream zs {};
+    if (inflateInit(&zs) != Z_OK) return false;
+    zs.next_in = const_cast<Bytef*>(in);
+    zs.next_out = out->data();
+    // avail_* are 32-bit: feed & drain in pieces
+    int ret = Z_OK;
+    size_t in_left = in_size, out_left = out->size();
+    while (ret == Z_OK) {
+        if (!zs.avail_in && in_left) {
+            zs.avail_in = std::min<size_t>(in_left, UINT_MAX);
+            in_left -= zs.avail_in;
+        }
+        if (!zs.avail_out && out_left) {
+            zs.avail_out = std::min<size_t>(out_left, UINT_MAX);
+            out_left -= zs.avail_out;
+        }
+        ret = inflate(&zs, Z_NO_FLUSH);
+    }
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END && zs.total_out == out->size();
+}
+
+bool inflateSection(Pending *p) {
+    switch (p->format) {
+        case ELFCOMPRESS_ZLIB:
+        case compress_gnu_zlib:
+            return inflateZlib(p->in, p->in_size, &p->out);
+        case ELFCOMPRESS_ZSTD:
+#ifdef MDB_HAVE_ZSTD
+        {
+            auto n = ZSTD_decompress(p->out.data(), p->out.size(), p->in, p->in_size);
+            return !ZSTD_isError(n) && n == p->out.size();
+        }
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+// Write through a temporary name so that a reader never maps half a file
+bool writeCacheFile(const std::string &path, const std::vector<uint8_t> &data) {
+    auto tmp = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file {tmp, std::ios::binary | std::ios::trunc};
+        if (!file.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+            unlink(tmp.c_str());
+            return false;
+        }
+    }
+    if (rename(tmp.c_str(), path.c_str()) < 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// deflate can't do better than 1032:1. zstd can, but not on DWARF
+constexpr uint64_t max_inflate_ratio = 2048;
+
+// Header of compressed section <sec>: fills the format, the payload &
+// its uncompressed size. False if it isn't compressed in a known way, or
+// claims an uncompressed size no payload of its size could have
+bool parseCompressed(const elf::section &sec, bool legacy, Pending *p) {
+    auto data = static_cast<const uint8_t*>(sec.data());
+    auto size = sec.size();
+    uint64_t out_size = 0;
+
+    if (legacy) {
+        if (size < 12 || std::memcmp(data, "ZLIB", 4) != 0) return false;
+        for (int i = 4; i < 12; ++i) out_size = out_size << 8 | data[i];
+        p->format = compress_gnu_zlib;
+        p->in = data + 12;
+        p->in_size = size - 12;
+    }
+    else {
+        Elf64_Chdr chdr;
+        if (size < sizeof(chdr)) return false;
+        std::memcpy(&chdr, data, sizeof(chdr));
+        out_size = chdr.ch_size;
+        p->format = chdr.ch_type;
+        p->in = data + sizeof(chdr);
+        p->in_size = size - sizeof(chdr);
+    }
+    // the size comes from the file: don't allocate whatever it says
+    if (out_size > max_inflate_ratio * p->in_size) return false;
+    p->out.resize(out_size);
+    return true;
+}
+
+} // namespace
+
+std::string buildId(const elf::elf &f) {
+    const auto &sec = f.get_section(".note.gnu.build-id");
+    if (!sec.valid()) return "";
+
+    // namesz, descsz, type, "GNU\0", id
+    auto data = static_cast<const uint8_t*>(sec.data());
+    auto size = sec.size();
+    for (size_t pos = 0; pos + 12 <= size;) {
+        uint32_t note[3];
+        std::memcpy(note, data + pos, sizeof(note));
+        auto name = pos + 12, desc = name + ((note[0] + 3) & ~3u);
+        if (desc + note[1] > size) break;
+        if (note[2] == NT_GNU_BUILD_ID && note[0] == 4 && std::memcmp(data + name, "GNU", 4) == 0) {
+            static const char digits[] = "0123456789abcdef";
+            std::string id;
+            for (size_t i = 0; i < note[1]; ++i) {
+                id += digits[data[desc + i] >> 4];
+                id += digits[data[desc + i] & 0xf];
+            }
+            return id;
+        }
+        pos = desc + ((note[1] + 3) & ~3u);
+    }
+    return "";
+}
+
+std::string findSeparateDebugFile(const elf::elf &f, const std::string &path) {
+    if (f.get_section(".debug_info").valid() || f.get_section(".zdebug_info").valid()) return "";
+
+    auto dirs = debugDirectories();
+    auto id = buildId(f);
+    if (id.size() > 2) {
+        for (const auto &dir : dirs) {
+            auto file = dir + "/.build-id/" + id.substr(0, 2) + "/" + id.substr(2) + ".debug";
+            if (isFile(file)) return file;
+        }
+    }
+
+    // file name, padded to 4 bytes, then the file's CRC32
+    const auto &link = f.get_section(".gnu_debuglink");
+    if (!link.valid() || link.size() < 8) return "";
+    auto data = static_cast<const char*>(link.data());
+    std::string name {data, strnlen(data, link.size())};
+    auto crc_offset = (name.size() + 4) & ~size_t{3};
+    if (name.empty() || crc_offset + 4 > link.size()) return "";
+    uint32_t crc;
+    std::memcpy(&crc, data + crc_offset, sizeof(crc));
+
+    auto exe = realPath(path);
+    auto exe_dir = exe.substr(0, exe.rfind('/'));
+    std::vector<std::string> candidates {exe_dir + "/" + name, exe_dir + "/.debug/" + name};
+    for (const auto &dir : dirs) candidates.push_back(dir + exe_dir + "/" + name);
+
+    for (const auto &file : candidates) {
+        uint32_t file_crc;
+        if (!isFile(file) || realPath(file) == exe) continue;
+        if (fileCrc(file, &file_crc) && file_crc == crc) return file;
+        std::cerr << "Ignoring " << file << ": CRC mismatch" << std::endl;
+    }
+    return "";
+}
+
+DebugSectionLoader::DebugSectionLoader(const elf::elf &f, const std::string &cache_key)
+    : elf_{f} {
+    ScopedTimer timer {stats().lookup("debug-sections")};
+
+    std::string cache_dir;
+    if (!cache_key.empty() && !cacheRoot().empty()) {
+        cache_dir = cacheRoot() + "/" + cache_key;
+        if (!makeDirectories(cache_dir)) cache_dir.clear();
+    }
+
+    std::deque<Pending> pending;
+    for (const auto &sec : elf_.sections()) {
+        const auto &name = sec.get_name();
+        bool legacy = name.compare(0, 8, ".zdebug_") == 0;
+        auto dwarf_name = legacy ? "." + name.substr(2) : name;
+        dwarf::section_type type;
+        if (!dwarf::elf::section_name_to_type(dwarf_name.c_str(), &type)) continue;
+        if (sections_.count(type) || sec.get_hdr().type == elf::sht::nobits) continue;
+
+        bool compressed = static_cast<uint64_t>(sec.get_hdr().flags) & SHF_COMPRESSED;
+        if (!compressed && !legacy) {
+            sections_[type] = {sec.data(), sec.size()};
+            continue;
+        }
+
+        Pending p {type, name};
+        if (!parseCompressed(sec, legacy, &p)) {
+            std::cerr << "Unknown or corrupt compression of " << name << std::endl;
+            continue;
+        }
+        if (!cache_dir.empty()) {
+            p.cache_file = cache_dir + "/" + dwarf_name;
+            if (mapCached(p.cache_file, p.out.size(), type)) continue;
+        }
+        pending.push_back(std::move(p));
+    }
+
+    // inflate & write out each section on its own thread
+    std::vector<std::thread> workers;
+    for (auto &p : pending) {
+        workers.emplace_back([&p] {
+            p.inflated = inflateSection(&p);
+            p.cached = p.inflated && !p.cache_file.empty() && writeCacheFile(p.cache_file, p.out);
+        });
+    }
+    for (auto &w : workers) w.join();
+
+    for (auto &p : pending) {
+        if (!p.inflated) {
+            std::cerr << "Can't decompress " << p.name
+                      << (p.format == ELFCOMPRESS_ZSTD ? " (zstd)" : "") << std::endl;
+            continue;
+        }
+        if (p.cached && mapCached(p.cache_file, p.out.size(), p.type)) continue;
+        buffers_.push_back(std::move(p.out));
+        sections_[p.type] = {buffers_.back().data(), buffers_.back().size()};
+    }
+}
+
+DebugSectionLoader::~DebugSectionLoader() {
+    for (const auto &m : mappings_) munmap(m.first, m.second);
+}
+
+bool DebugSectionLoader::mapCached(const std::string &file, size_t size, dwarf::section_type type) {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == size && size > 0)
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    mappings_.emplace_back(data, size);
+    sections_[type] = {data, size};
+    return true;
+}
+
+const void *DebugSectionLoader::load(dwarf::section_type section, size_t *size_out) {
+    auto it = sections_.find(section);
+    if (it == sections_.end()) return nullptr;
+    *size_out = it->second.second;
+    return it->second.first;
+}
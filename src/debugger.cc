@@ -1,60 +1,234 @@
 #include "debugger.hh"
 #include "helper.hh"
 #include "ptrace-expr-context.hh"
+#include "register-use-context.hh"
+#include "core-expr-context.hh"
+#include "remote-expr-context.hh"
+#include "expression.hh"
+#include "stats.hh"
+#include "x86-decode.hh"
+#include "x86-format.hh"
 
 #include "linenoise.h"
-#include "cwalk.h"
 
 #include <sys/wait.h>
 #include <sys/ptrace.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+#include <sys/auxv.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <linux/seccomp.h>
+#include <sched.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <iomanip>
 #include <iostream>
 #include <algorithm>
 #include <fstream>
 #include <functional>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+namespace {
+
+// sorted, for completion
+const std::vector<std::string> command_names {
+    "allvars", "backtrace", "break", "catch", "checkpoint", "clear", "continue",
+    "disassemble", "display", "dump", "exit", "find", "finish", "handle",
+    "inferior", "memory", "next", "perf", "print", "record", "register",
+    "restart", "reverse-continue", "reverse-step", "sharedlibrary", "stats",
+    "step", "symbol", "trace", "undisplay", "var",
+};
+
+// linenoise cycles through them on each Tab
+constexpr size_t max_completions = 200;
+
+Debugger *completing = nullptr;
+
+void completionCallback(const char *buf, linenoiseCompletions *lc) {
+    std::vector<std::string> lines;
+    try {
+        completing->complete(buf, &lines);
+    } catch (std::exception &) {
+        // no registers or debug info: nothing to offer
+    }
+    for (const auto &line : lines) linenoiseAddCompletion(lc, line.c_str());
+}
+
+// SIGSTOPs mdb causes itself: kill() to stop a running inferior, and the
+// one a traced fork child starts with (no sender). Never the debuggee's
+bool isDebuggerStop(const siginfo_t &info) {
+    return info.si_signo == SIGSTOP && info.si_code == SI_USER
+        && (info.si_pid == getpid() || info.si_pid == 0);
+}
+
+} // namespace
 
 Debugger::Debugger (std::string prog_name, pid_t pid)
     : prog_name_(std::move(prog_name)), pid_(pid) {
-    auto fd = open(prog_name_.c_str(), O_RDONLY);
-    this->elf_ = elf::elf(elf::create_mmap_loader(fd));
-    this->dwarf_  = dwarf::dwarf(dwarf::elf::create_loader(elf_));
-		loadSymbols();
+    program_ = loadProgramIndex(prog_name_);
+		initEventSources();
+}
+
+// No process behind a core: pid_ stays 0 so that a stray ptrace fails
+Debugger::Debugger (std::string prog_name, std::unique_ptr<CoreFile> core)
+    : prog_name_(std::move(prog_name)), pid_(0), core_(std::move(core)) {
+    program_ = loadProgramIndex(prog_name_);
+}
+
+// Same for a remote debuggee: the server traces it
+Debugger::Debugger (std::string prog_name, std::unique_ptr<RemoteTarget> remote)
+    : prog_name_(std::move(prog_name)), pid_(0), remote_(std::move(remote)) {
+    program_ = loadProgramIndex(prog_name_);
+}
+
+void Debugger::initEventSources() {
+    // SIGCHLD reports tracee state changes; SIGINT no longer kills mdb
+    // but interrupts the debuggee. Blocked here, after the fork, so the
+    // debuggee keeps default dispositions
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+    signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    event_loop_.addFd(signal_fd_, EPOLLIN, [this](uint32_t) { handleSignalFd(); });
+
+    watchPid(pid_);
+}
+
+// pidfd turns readable when <pid> exits (Linux >= 5.3)
+void Debugger::watchPid(pid_t pid) {
+    int fd = syscall(SYS_pidfd_open, pid, 0);
+    if (fd < 0) return;
+    event_loop_.addFd(fd, EPOLLIN, [this](uint32_t) { pollTracee(); });
+    pid_fds_[pid] = fd;
+}
+
+void Debugger::unwatchPid(pid_t pid) {
+    auto it = pid_fds_.find(pid);
+    if (it == pid_fds_.end()) return;
+    event_loop_.removeFd(it->second);
+    close(it->second);
+    pid_fds_.erase(it);
 }
 
 void Debugger::run() {
-    waitForSignal();
-    initLoadAddress();
+    if (core_) {
+        initLoadAddress();
+        std::cout << "Core was generated by process " << std::dec << core_->pid()
+                  << ", terminated with signal " << core_->signal()
+                  << " (" << strsignal(core_->signal()) << ")" << std::endl;
+        try {
+            auto line_entry = getLineEntryFromPC(getOffsetPC());
+            printSource(line_entry->file->path, line_entry->line);
+        } catch (std::out_of_range &) {
+            std::cout << "PC 0x" << std::hex << get_pc()
+                      << " has no line information" << std::endl;
+        }
+    }
+    else if (remote_) {
+        initLoadAddress();
+        std::cout << "Remote debugging process " << std::dec << remote_->pid() << std::endl;
+        reportRemoteStop();
+    }
+    else {
+        startInferior();
+    }
     
+    completing = this;
+    linenoiseSetCompletionCallback(completionCallback);
+
     char *line = nullptr;
     while ((line = linenoise("(mdb) ")) != nullptr) {
-        handleCommand(line);
+        auto generation = generation_;
+        try {
+            handleCommand(line);
+            if (recorder_ && recorder_->hasDiverged()) {
+                std::cerr << "Replay stopped, back to the live process" << std::endl;
+                recorder_->returnToLive();
+                printCurrentLocation();
+            }
+            // the debuggee ran: show the displays that changed & what
+            // it cost
+            if (generation_ != generation && !exited_) displays_.refresh();
+            if (generation_ != generation && perf_) perf_->reportInterval(std::cout);
+        } catch (std::exception &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
         linenoiseHistoryAdd(line);
         linenoiseFree(line);
     }
 }
 
+void Debugger::startInferior() {
+    waitForSignal();
+    initLoadAddress();
+
+    // follow forked children & exec'd images; stop where syscall
+    // catchpoint filters ask to
+    countedPtrace(PTRACE_SETOPTIONS, pid_, nullptr,
+           PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACEEXEC
+           | PTRACE_O_EXITKILL | PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACESECCOMP);
+}
+
 void Debugger::initLoadAddress() {
     //TODO look into it in the future
     // if it's dynamic library
-    if (elf_.get_hdr().type == elf::et::dyn) {
+    load_addr_ = 0;
+    if (program_->elf.get_hdr().type == elf::et::dyn && core_) {
+        load_addr_ = core_->loadAddress(prog_name_);
+    }
+    else if (program_->elf.get_hdr().type == elf::et::dyn && remote_) {
+        // the entry point moved by the load address
+        if (auto entry = remote_->auxv(AT_ENTRY))
+            load_addr_ = entry - program_->elf.get_hdr().entry;
+    }
+    else if (program_->elf.get_hdr().type == elf::et::dyn) {
         std::ifstream map_info("/proc/" + std::to_string(pid_) + "/maps");
 
         std::string addr;
         std::getline(map_info, addr, '-'); // read first line
         // <8bit> - <8bit>
-        load_addr_ = std::stoi(addr, 0, 16);
+        load_addr_ = std::stoull(addr, 0, 16);
     }
 }
 
+void Debugger::resume(__ptrace_request request) {
+    last_resume_ = request;
+    invalidateRegisterCache();
+    if (recorder_ && recorder_->isReplaying()) pending_signal_ = recorder_->signalToDeliver();
+    else if (recorder_ && pending_signal_) recorder_->logSignal(pending_signal_);
+    if (recorder_) request = recorder_->mapResume(request);
+    countedPtrace(request, pid_, nullptr, static_cast<long>(pending_signal_));
+    pending_signal_ = 0;
+}
+
 void Debugger::singleStep() {
-    ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr);
+    if (remote_) {
+        invalidateRegisterCache();
+        remote_->step();
+        if (remote_->lastStop().exited || remote_->lastStop().signal != SIGTRAP)
+            reportRemoteStop();
+        return;
+    }
+    resume(PTRACE_SINGLESTEP);
     waitForSignal();
 }
 
 void Debugger::singleStepWithBreakpointCheck() {
-    if (breakpoints_.count(get_pc())) stepOverBreakpoint();
+    if (breakpoints_.count(get_pc()) && !remote_) stepOverBreakpoint();
     else singleStep();
 }
 
@@ -73,11 +247,52 @@ uint64_t Debugger::getOffsetPC() {
 void Debugger::handleCommand(const std::string& line) {
     auto args = split(line, ' ');
     auto command = args[0];
+    CommandScope scope;
+
+    // only inspection works on a core dump
+    if (core_ && (isPrefix(command, "continue") || isPrefix(command, "break")
+            || isPrefix(command, "step") || isPrefix(command, "next")
+            || isPrefix(command, "finish") || isPrefix(command, "trace")
+            || isPrefix(command, "inferior") || isPrefix(command, "checkpoint")
+            || isPrefix(command, "restart") || isPrefix(command, "record")
+            || isPrefix(command, "reverse-step") || isPrefix(command, "reverse-continue")
+            || isPrefix(command, "catch") || isPrefix(command, "perf")
+            || (args.size() > 2 && isPrefix(args[1], "write")))) {
+        std::cerr << "Not available when debugging a core file" << std::endl;
+        return;
+    }
 
-    if (isPrefix(command, "continue")) {
-        continueExecution();
+    // the server only steps, continues & sets breakpoints
+    if (remote_ && (isPrefix(command, "trace") || isPrefix(command, "inferior")
+            || isPrefix(command, "checkpoint") || isPrefix(command, "restart")
+            || isPrefix(command, "record") || isPrefix(command, "reverse-step")
+            || isPrefix(command, "reverse-continue") || isPrefix(command, "find")
+            || isPrefix(command, "dump") || isPrefix(command, "catch")
+            || isPrefix(command, "perf"))) {
+        std::cerr << "Not available when debugging remotely" << std::endl;
+        return;
+    }
+
+    if (exited_ && !isPrefix(command, "exit") && !isPrefix(command, "symbol")
+            && !isPrefix(command, "clear") && !isPrefix(command, "inferior")
+            && !isPrefix(command, "restart") && !isPrefix(command, "handle")
+            && !(isPrefix(command, "checkpoint") && args.size() > 1)) {
+        std::cerr << "The program is not being run" << std::endl;
+        return;
+    }
+
+    // the full name of the command that runs, for the stats
+    std::string matched;
+    auto is = [&](const char *name) {
+        if (!isPrefix(command, name)) return false;
+        matched = name;
+        return true;
+    };
+
+    if (is("continue")) {
+        continueExecution(true);
     } 
-    else if (isPrefix(command, "break")) {
+    else if (is("break")) {
         if (isHexNum(args[1])) {
             std::string addr {args[1], 2}; // 0xNUMSEQ->NUMSEQ
             setBreakpointAtAddress(std::stol(addr, 0, 16));
@@ -90,30 +305,38 @@ void Debugger::handleCommand(const std::string& line) {
 						setBreakpointAtFunction(args[1]);
 				}
     }
-    else if (isPrefix(command, "register")) {
+    else if (is("register")) {
         if (isPrefix(args[1], "dump")) {
             dumpRegisters();
         }
+        else if (isPrefix(args[1], "read") && findFpRegister(args[2])) {
+            std::cout << args[2] << " "
+                      << formatFpRegister(getFpRegisters(), *findFpRegister(args[2]))
+                      << std::endl;
+        }
         else if (isPrefix(args[1], "read")) {
             std::cout << args[1] << " 0x"
                       << std::setfill('0') << std::setw(16) << std::hex
-                      << getRegisterValue(pid_, getRegisterFromName(args[2])) 
+                      << getRegister(getRegisterFromName(args[2])) 
                       << std::endl;
         }
         else if (isPrefix(args[1], "write")) {
             if (isHexNum(args[3])) {
                 std::string val {args[3], 2};
                 //TODO CHECKIF args[2] is a valid name for a register?
-                setRegisterValue(pid_, 
-                                 getRegisterFromName(args[2]),
-                                 std::stol(val, 0, 16)); 
+                if (remote_)
+                    remote_->setRegister(getRegisterFromName(args[2]), std::stol(val, 0, 16));
+                else
+                    setRegisterValue(pid_, 
+                                     getRegisterFromName(args[2]),
+                                     std::stol(val, 0, 16)); 
             } else {
                 std::cerr << "Invalid number format. Should be 0xNUMSEQ"
                           << std::endl;
             }
         }
     }
-    else if (isPrefix(command, "memory")) {
+    else if (is("memory")) {
         if (isHexNum(args[2])) {
             std::string addr {args[2], 2};
 
@@ -126,42 +349,203 @@ void Debugger::handleCommand(const std::string& line) {
                       << std::endl;
         }
     }
-		else if (isPrefix(command, "step")) {
+		else if (is("step")) {
 				stepIn();
 		}
-		else if (isPrefix(command, "next")) {
+		else if (is("next")) {
 				stepOver();
 		}
-		else if (isPrefix(command, "finish")) {
+		else if (is("finish")) {
 				stepOut();
 		}
-		else if (isPrefix(command, "symbol")) {
+		else if (is("symbol")) {
 				auto syms = lookupSymbol(args[1]);
 				for (auto &&s : syms) {
 						std::cout << s.name << " " << toString(s.type) << " 0x" 
 										  << std::hex << s.addr << std::endl;
 				}
 		}
-		else if (isPrefix(command, "backtrace")) {
+		else if (is("backtrace")) {
 				printBacktrace();
 		}
-		else if (isPrefix(command, "var")) {
+		else if (is("find")) {
+				std::vector<uint8_t> pattern;
+				if (args.size() < 4 || !parsePattern(args[3], &pattern)) {
+						std::cerr << "Usage: find <start> <end> <0xVALUE|\"text\"|hex:BYTES>" << std::endl;
+				}
+				else {
+						findInMemory(std::stoull(args[1], 0, 0), std::stoull(args[2], 0, 0), pattern);
+				}
+		}
+		else if (is("dump")) {
+				if (args.size() < 4) std::cerr << "Usage: dump <start> <length> <file>" << std::endl;
+				else dumpMemory(std::stoull(args[1], 0, 0), std::stoull(args[2], 0, 0), args[3]);
+		}
+		else if (is("sharedlibrary")) {
+				printSharedLibraries();
+		}
+		else if (is("disassemble")) {
+				disassemble(args.size() > 1 ? args[1] : "");
+		}
+		else if (is("print")) {
+				auto text = line.substr(line.find(command) + command.size());
+				if (text.find_first_not_of(' ') == std::string::npos) {
+						std::cerr << "Usage: print <expression>" << std::endl;
+				}
+				else {
+						Expression expr {text.substr(text.find_first_not_of(' ')), program_, getOffsetPC()};
+						std::cout << expr.text() << " = " << formatValue(*this, expr.evaluate(*this))
+										  << std::endl;
+				}
+		}
+		else if (is("display")) {
+				auto text = line.substr(line.find(command) + command.size());
+				if (text.find_first_not_of(' ') == std::string::npos) displays_.refresh(true);
+				else displays_.add(text.substr(text.find_first_not_of(' ')));
+		}
+		else if (is("undisplay")) {
+				if (args.size() < 2) displays_.clear();
+				else if (!displays_.remove(std::stoul(args[1])))
+						std::cerr << "No display number " << args[1] << std::endl;
+		}
+		else if (is("var")) {
 				std::string var_name = args[1];
 				readVariable(var_name);
 		}
-		else if (isPrefix(command, "allvars")) {
+		else if (is("allvars")) {
 				readVariables();
 		}
-		else if (isPrefix(command, "clear")) {
+		else if (is("trace")) {
+				if (args.size() < 2) {
+						std::cerr << "Usage: trace <function|0xADDRESS|status|events [n]|delete <id>>"
+										  << std::endl;
+				}
+				else if (args[1] == "status") {
+						traceAgent().printStatus();
+				}
+				else if (args[1] == "events") {
+						traceAgent().printEvents(args.size() > 2 ? std::stoul(args[2]) : 20);
+				}
+				else if (args[1] == "delete" && args.size() > 2) {
+						traceAgent().removeTracepoint(std::stoul(args[2]));
+				}
+				else if (isHexNum(args[1])) {
+						std::string addr {args[1], 2};
+						setTracepointAtAddress(std::stol(addr, 0, 16));
+				}
+				else {
+						setTracepointAtFunction(args[1]);
+				}
+		}
+		else if (is("clear")) {
 				linenoiseClearScreen();
 		}
-		else if (isPrefix(command, "exit")) {
-				kill(pid_, SIGTERM);
+		else if (is("inferior")) {
+				if (args.size() < 2) listInferiors();
+				else selectInferior(std::stoul(args[1]));
+		}
+		else if (is("checkpoint")) {
+				if (args.size() < 2) createCheckpoint();
+				else if (isPrefix(args[1], "list")) listCheckpoints();
+				else if (isPrefix(args[1], "delete") && args.size() > 2)
+						deleteCheckpoint(std::stoul(args[2]));
+				else std::cerr << "Usage: checkpoint [list|delete <n>]" << std::endl;
+		}
+		else if (is("record")) {
+				if (args.size() < 2) startRecording();
+				else if (isPrefix(args[1], "stop")) stopRecording();
+				else if (isPrefix(args[1], "status") && recorder_) recorder_->printStatus();
+				else std::cerr << "Usage: record [stop|status]" << std::endl;
+		}
+		else if (is("reverse-step") || is("reverse-continue")) {
+				if (!recorder_) std::cerr << "Not recording, see `record`" << std::endl;
+				else if (is("reverse-step")) recorder_->reverseStep();
+				else recorder_->reverseContinue();
+		}
+		else if (is("restart")) {
+				if (recorder_) std::cerr << "Stop recording first" << std::endl;
+				else if (args.size() < 2) std::cerr << "Usage: restart <n>" << std::endl;
+				else restartCheckpoint(std::stoul(args[1]));
+		}
+		else if (is("catch")) {
+				SyscallCatchpoint cp;
+				if (args.size() < 2) listSyscallCatchpoints();
+				else if (isPrefix(args[1], "delete") && args.size() > 2)
+						deleteSyscallCatchpoint(std::stoul(args[2]));
+				else if (isPrefix(args[1], "syscall")
+								 && parseSyscallCatchpoint({args.begin() + 2, args.end()}, &cp))
+						catchSyscall(cp);
+				else std::cerr << "Usage: catch [syscall <name|nr> [if argN==X]|delete <n>]" << std::endl;
+		}
+		else if (is("perf")) {
+				perfCommand(args);
+		}
+		else if (is("handle")) {
+				handleSignalCommand(args);
+		}
+		else if (is("stats")) {
+				if (args.size() < 2) stats().print(std::cout);
+				else if (isPrefix(args[1], "reset")) stats().reset();
+				else if (isPrefix(args[1], "trace"))
+						stats().trace = args.size() < 3 || args[2] != "off";
+				else std::cerr << "Usage: stats [reset|trace [on|off]]" << std::endl;
+		}
+		else if (is("exit")) {
+				for (const auto &cp : checkpoints_) kill(cp.second.pid, SIGKILL);
+				for (const auto &inf : inferiors_)
+						if (!inf.second.exited) kill(inf.first, SIGTERM);
+				if (!exited_ && remote_) remote_->kill();
+				else if (!exited_ && !core_) kill(pid_, SIGTERM);
 				exit(0);
 		}
     else {
         std::cerr << "Invalid command" << std::endl;
     }
+    scope.setName(matched);
+}
+
+void Debugger::complete(const std::string &line, std::vector<std::string> *out) {
+    auto start = line.rfind(' ') + 1;   // 0 if there's no space
+    std::vector<std::string> names;
+    if (start == 0) {
+        completeSorted(command_names, line, max_completions, &names);
+        for (const auto &n : names) out->push_back(n + " ");
+        return;
+    }
+
+    auto command = split(line, ' ')[0];
+    bool code = isPrefix(command, "break") || isPrefix(command, "trace")
+        || isPrefix(command, "disassemble");
+    bool data = isPrefix(command, "var") || isPrefix(command, "print")
+        || isPrefix(command, "display");
+    // the identifier at the end of an expression ("*p->na")
+    auto word_start = line.find_last_not_of(
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_:.", std::string::npos);
+    word_start = word_start == std::string::npos || word_start < start ? start : word_start + 1;
+    if (!data) word_start = start;
+    auto head = line.substr(0, word_start), prefix = line.substr(word_start);
+
+    if (data && !exited_) {
+        // locals & parameters, innermost first
+        std::vector<std::string> locals;
+        for (auto scope = program_->scopes.innermost(getOffsetPC()); scope; scope = scope->parent)
+            for (const auto &var : scope->variables) {
+                auto name = dieName(var);
+                if (name.compare(0, prefix.size(), prefix) == 0
+                        && std::find(locals.begin(), locals.end(), name) == locals.end())
+                    locals.push_back(name);
+            }
+        names.insert(names.end(), locals.begin(), locals.end());
+    }
+    if (data) program_->names.complete(NameKind::variable, prefix, max_completions, &names);
+    else program_->names.complete(NameKind::function, prefix, max_completions, &names);
+    if (code) program_->names.complete(NameKind::file, prefix, max_completions, &names);
+    if (isPrefix(command, "symbol"))
+        program_->names.complete(NameKind::variable, prefix, max_completions, &names);
+
+    for (size_t i = 0; i < names.size(); ++i)
+        if (std::find(names.begin(), names.begin() + i, names[i]) == names.begin() + i)
+            out->push_back(head + names[i]);
 }
 
 void Debugger::printSource(const std::string &file_name,
@@ -204,21 +588,42 @@ void Debugger::dumpRegisters() {
     for (const auto &rd : g_register_descriptors) {
         std::cout << rd.name << " 0x"
                   << std::setfill('0') << std::setw(16) << std::hex
-                  << getRegisterValue(pid_, rd.r) 
+                  << getRegister(rd.r) 
                   << std::endl;
     }
 }
 
-void Debugger::continueExecution() {
-    stepOverBreakpoint();
-    ptrace(PTRACE_CONT, pid_, nullptr, nullptr);
-    waitForSignal();
+void Debugger::continueExecution(bool any_inferior) {
+    if (remote_) {
+        // the server steps over its own breakpoints
+        invalidateRegisterCache();
+        remote_->resume();
+        reportRemoteStop();
+        return;
+    }
+    do {
+        trace_hit_ = false;
+        stepOverBreakpoint();
+        if (exited_) return;
+        resume(PTRACE_CONT);
+        waitForSignal(any_inferior);
+    } while (trace_hit_ && !exited_);
 }
 
 
 void Debugger::setBreakpointAtAddress(intptr_t at_addr) {
+    if (trace_agent_ && trace_agent_->isPatched(at_addr)) {
+        std::cerr << "Address 0x" << std::hex << at_addr
+                  << " is patched by a tracepoint" << std::endl;
+        return;
+    }
     Breakpoint bp {pid_, at_addr};
-    bp.enable();
+    // a remote one stays disabled here: the server plants the int3
+    if (remote_ && !remote_->insertBreakpoint(at_addr)) {
+        std::cerr << "Can't set breakpoint at address 0x" << std::hex << at_addr << std::endl;
+        return;
+    }
+    if (!remote_) bp.enable();
     breakpoints_[at_addr] = bp;
 		std::cout << "Set breakpoint at address 0x" 
 							<< std::hex << at_addr << std::endl;
@@ -227,43 +632,458 @@ void Debugger::setBreakpointAtAddress(intptr_t at_addr) {
 //TODO try process_vm_readv, process_vm_writev or /proc/<pid>/mem instead
 // --- to look at larger chunks of data
 uint64_t Debugger::readMemory(uint64_t address) {
-    return ptrace(PTRACE_PEEKDATA, pid_, address, nullptr);
+    if (core_) {
+        uint64_t value = 0;
+        core_->read(address, &value, sizeof(value));
+        return value;
+    }
+    if (remote_) {
+        uint64_t value = 0;
+        remote_->read(address, &value, sizeof(value));
+        return value;
+    }
+    return countedPtrace(PTRACE_PEEKDATA, pid_, address, nullptr);
 }
 //TODO try process_vm_readv, process_vm_writev or /proc/<pid>/mem instead 
 // --- to look at larger chunks of data
 //because writeMemory writes only a word at a time
 void Debugger::writeMemory(uint64_t address, uint64_t value) {
-    ptrace(PTRACE_POKEDATA, pid_, address, value);
+    if (remote_) remote_->write(address, &value, sizeof(value));
+    else countedPtrace(PTRACE_POKEDATA, pid_, address, value);
+    disassembler_.invalidate(address, address + sizeof(value));
+}
+
+bool Debugger::readMemoryBlock(uint64_t address, void *buf, size_t len) {
+    if (core_) return core_->read(address, buf, len);
+    if (remote_) return remote_->read(address, buf, len);
+
+    iovec local {buf, len};
+    iovec remote {reinterpret_cast<void*>(address), len};
+    if (process_vm_readv(pid_, &local, 1, &remote, 1, 0) == static_cast<ssize_t>(len))
+        return true;
+
+    // fall back to word-sized reads (e.g. process_vm_readv not permitted)
+    auto out = static_cast<uint8_t*>(buf);
+    for (size_t done = 0; done < len; done += sizeof(long)) {
+        errno = 0;
+        auto word = countedPtrace(PTRACE_PEEKDATA, pid_, address + done, nullptr);
+        if (errno) return false;
+        std::memcpy(out + done, &word, std::min(sizeof(long), len - done));
+    }
+    return true;
+}
+
+bool Debugger::readMemoryBlocks(const std::vector<iovec> &local,
+                                const std::vector<iovec> &remote) {
+    if (core_) {
+        for (size_t i = 0; i < remote.size(); ++i)
+            if (!core_->read(reinterpret_cast<uint64_t>(remote[i].iov_base),
+                             local[i].iov_base, local[i].iov_len))
+                return false;
+        return true;
+    }
+    if (remote_) {
+        // all missing pages in one batch of requests
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        for (const auto &r : remote) {
+            auto start = reinterpret_cast<uint64_t>(r.iov_base);
+            ranges.emplace_back(start, start + r.iov_len);
+        }
+        remote_->prefetch(ranges);
+        for (size_t i = 0; i < remote.size(); ++i)
+            if (!remote_->read(ranges[i].first, local[i].iov_base, local[i].iov_len))
+                return false;
+        return true;
+    }
+
+    for (size_t i = 0; i < remote.size(); i += IOV_MAX) {
+        auto n = std::min<size_t>(IOV_MAX, remote.size() - i);
+        ssize_t expected = 0;
+        for (size_t j = i; j < i + n; ++j) expected += remote[j].iov_len;
+        // a fault stops the transfer short
+        if (process_vm_readv(pid_, &local[i], n, &remote[i], n, 0) != expected) return false;
+    }
+    return true;
+}
+
+size_t Debugger::readMemoryChunk(uint64_t address, void *buf, size_t len) {
+    if (core_) return core_->read(address, buf, len) ? len : 0;
+    if (remote_) return remote_->readPartial(address, buf, len);
+
+    iovec local {buf, len};
+    iovec remote {reinterpret_cast<void*>(address), len};
+    auto n = process_vm_readv(pid_, &local, 1, &remote, 1, 0);
+    return n > 0 ? n : 0;
+}
+
+std::vector<MemoryRegion> Debugger::memoryRegions() {
+    if (core_) return core_->regions();
+    return readProcMaps(pid_);
+}
+
+// Chunks are scanned in place when they come straight from the core
+// mapping; consecutive chunks overlap by the pattern length - 1
+void Debugger::findInMemory(uint64_t start, uint64_t end, const std::vector<uint8_t> &pattern) {
+    constexpr size_t max_printed = 256;
+    std::vector<uint8_t> buf(memory_chunk_size);
+    size_t matches = 0;
+    uint64_t scanned = 0;
+
+    for (const auto &range : readableRanges(memoryRegions(), start, end)) {
+        auto pos = range.first;
+        while (pos < range.second) {
+            size_t n = std::min<uint64_t>(memory_chunk_size, range.second - pos);
+            auto data = core_ ? core_->map(pos, n) : nullptr;
+            if (!data) {
+                n = readMemoryChunk(pos, buf.data(), n);
+                data = buf.data();
+            }
+            if (n < pattern.size()) break;
+
+            scanBuffer(data, n, pattern, [&](size_t offset) {
+                if (++matches <= max_printed)
+                    std::cout << "0x" << std::hex << pos + offset << std::endl;
+                return true;
+            });
+            scanned += n;
+            pos += n - (pattern.size() - 1);
+            if (pos + pattern.size() - 1 >= range.second) break;
+        }
+    }
+    if (matches > max_printed) std::cout << "..." << std::endl;
+    std::cout << std::dec << matches << " match" << (matches == 1 ? "" : "es") << " in "
+              << scanned << " bytes" << std::endl;
+}
+
+void Debugger::dumpMemory(uint64_t start, uint64_t len, const std::string &file) {
+    std::ofstream out(file, std::ios::binary);
+    if (!out) {
+        std::cerr << "Can't open " << file << std::endl;
+        return;
+    }
+
+    std::vector<uint8_t> buf(memory_chunk_size);
+    uint64_t done = 0;
+    while (done < len) {
+        size_t n = std::min<uint64_t>(memory_chunk_size, len - done);
+        auto data = core_ ? core_->map(start + done, n) : nullptr;
+        size_t got = n;
+        if (!data) {
+            got = readMemoryChunk(start + done, buf.data(), n);
+            data = buf.data();
+        }
+        out.write(reinterpret_cast<const char *>(data), got);
+        done += got;
+        if (got < n) {
+            std::cerr << "Can't read memory at 0x" << std::hex << start + done << std::endl;
+            break;
+        }
+    }
+    std::cout << "Wrote " << std::dec << done << " bytes to " << file << std::endl;
+}
+
+// PTRACE_POKEDATA (unlike process_vm_writev) can write into read-only
+// mappings such as .text
+void Debugger::writeMemoryBlock(uint64_t address, const void *buf, size_t len) {
+    if (remote_) {
+        if (!remote_->write(address, buf, len))
+            throw std::runtime_error("Can't write remote memory");
+        disassembler_.invalidate(address, address + len);
+        return;
+    }
+    auto in = static_cast<const uint8_t*>(buf);
+    size_t done = 0;
+    while (done < len) {
+        auto word_addr = (address + done) & ~uint64_t{sizeof(long) - 1};
+        auto offset = (address + done) - word_addr;
+        auto n = std::min(sizeof(long) - offset, len - done);
+
+        long word = 0;
+        if (offset != 0 || n != sizeof(long))
+            word = countedPtrace(PTRACE_PEEKDATA, pid_, word_addr, nullptr);
+        std::memcpy(reinterpret_cast<uint8_t*>(&word) + offset, in + done, n);
+        countedPtrace(PTRACE_POKEDATA, pid_, word_addr, word);
+        done += n;
+    }
+    disassembler_.invalidate(address, address + len);
+}
+
+// Temporarily put a syscall instruction at PC, load the arguments
+// and single-step over it
+int64_t Debugger::injectSyscall(uint64_t nr, uint64_t arg0, uint64_t arg1,
+                                uint64_t arg2, uint64_t arg3,
+                                uint64_t arg4, uint64_t arg5) {
+    return injectSyscallInto(pid_, nr, arg0, arg1, arg2, arg3, arg4, arg5);
+}
+
+int64_t Debugger::injectSyscallInto(pid_t pid, uint64_t nr, uint64_t arg0,
+                                    uint64_t arg1, uint64_t arg2,
+                                    uint64_t arg3, uint64_t arg4,
+                                    uint64_t arg5) {
+    user_regs_struct saved_regs;
+    countedPtrace(PTRACE_GETREGS, pid, nullptr, &saved_regs);
+
+    auto pc = saved_regs.rip;
+    auto saved_code = countedPtrace(PTRACE_PEEKDATA, pid, pc, nullptr);
+    auto syscall_code = (saved_code & ~0xffff) | 0x050f; // syscall
+    countedPtrace(PTRACE_POKEDATA, pid, pc, syscall_code);
+
+    auto regs = saved_regs;
+    regs.rax = nr;
+    regs.orig_rax = -1; // don't restart an interrupted syscall
+    regs.rdi = arg0;
+    regs.rsi = arg1;
+    regs.rdx = arg2;
+    regs.r10 = arg3;
+    regs.r8 = arg4;
+    regs.r9 = arg5;
+    countedPtrace(PTRACE_SETREGS, pid, nullptr, &regs);
+
+    // fork/clone report a ptrace event before the syscall returns
+    int wait_status;
+    do {
+        countedPtrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+        countedWaitpid(pid, &wait_status, __WALL);
+    } while (WIFSTOPPED(wait_status) && (wait_status >> 16));
+
+    countedPtrace(PTRACE_GETREGS, pid, nullptr, &regs);
+    countedPtrace(PTRACE_POKEDATA, pid, pc, saved_code);
+    countedPtrace(PTRACE_SETREGS, pid, nullptr, &saved_regs);
+
+    return static_cast<int64_t>(regs.rax);
+}
+
+pid_t Debugger::forkStopped(pid_t pid) {
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, pid, nullptr, &regs);
+    auto saved_code = countedPtrace(PTRACE_PEEKDATA, pid, regs.rip, nullptr);
+
+    // CLONE_PARENT: the copy is a sibling, reaped by mdb rather than
+    // left a zombie of a process that never runs
+    auto child = injectSyscallInto(pid, SYS_clone, CLONE_PARENT | SIGCHLD);
+    if (child <= 0) return -1;
+
+    // auto-attached through PTRACE_O_TRACEFORK, starts with a SIGSTOP
+    int status;
+    countedWaitpid(child, &status, __WALL);
+
+    // the copy was taken mid-injection: undo it there too
+    countedPtrace(PTRACE_POKEDATA, child, regs.rip, saved_code);
+    countedPtrace(PTRACE_SETREGS, child, nullptr, &regs);
+    return child;
+}
+
+uint64_t Debugger::allocateInferiorMemory(size_t size, int prot, uint64_t hint) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (hint) flags |= MAP_FIXED_NOREPLACE;
+
+    auto addr = injectSyscall(SYS_mmap, hint, size, prot, flags,
+                              static_cast<uint64_t>(-1), 0);
+    if (addr < 0) return 0;
+    return addr;
+}
+
+uint64_t Debugger::allocateInferiorMemoryNear(uint64_t anchor, size_t size, int prot) {
+    auto page = anchor & ~uint64_t{0xfff};
+    const uint64_t distances[] = {1ull << 21, 1ull << 24, 1ull << 28, 1ull << 30};
+    for (auto d : distances) {
+        uint64_t hints[] = {page > d ? page - d : 0, page + d};
+        for (auto hint : hints) {
+            if (!hint) continue;
+            auto addr = allocateInferiorMemory(size, prot, hint);
+            if (!addr) continue;
+            if (fitsRel32(anchor, addr) && fitsRel32(anchor, addr + size))
+                return addr;
+            // old kernels take MAP_FIXED_NOREPLACE as a mere hint
+            injectSyscall(SYS_munmap, addr, size);
+        }
+    }
+    return 0;
+}
+
+bool Debugger::hasBreakpointInRange(uint64_t begin, uint64_t end) {
+    for (const auto &bp : breakpoints_)
+        if (bp.first >= static_cast<intptr_t>(begin)
+                && bp.first < static_cast<intptr_t>(end))
+            return true;
+    return false;
 }
 
 uint64_t Debugger::get_pc() {
-    return getRegisterValue(pid_, Reg::rip);
+    return getRegister(Reg::rip);
+}
+
+uint64_t Debugger::getRegister(Reg r) {
+    if (core_) return getRegisterValue(core_->registers(), r);
+    if (remote_) return remote_->getRegister(r);
+    return getRegisterValue(pid_, r);
+}
+
+uint64_t Debugger::getDwarfRegister(unsigned regnum) {
+    if (auto rd = findFpDwarfRegister(regnum))
+        return getFpRegisterValue(getFpRegisters(), *rd);
+    return getRegister(getRegisterFromDwarfRegister(regnum));
+}
+
+const FpRegisters &Debugger::getFpRegisters() {
+    if (core_) return core_->fpRegisters();
+    if (remote_) return remote_->fpRegisters();
+    if (!fp_regs_valid_) {
+        if (!readFpRegisters(pid_, &fp_regs_))
+            throw std::runtime_error("Can't read floating-point registers");
+        fp_regs_valid_ = true;
+    }
+    return fp_regs_;
+}
+
+std::unique_ptr<dwarf::expr_context> Debugger::makeExprContext() {
+    if (core_) return std::make_unique<CoreExprContext>(*core_);
+    if (remote_) return std::make_unique<RemoteExprContext>(*remote_);
+    return std::make_unique<PtraceExprContext>(
+        pid_, [this]() -> const FpRegisters & { return getFpRegisters(); });
 }
 
 void Debugger::set_pc(uint64_t pc) {
-    setRegisterValue(pid_, Reg::rip, pc);
+    if (remote_) remote_->setRegister(Reg::rip, pc);
+    else setRegisterValue(pid_, Reg::rip, pc);
 }
 
 void Debugger::stepOverBreakpoint() {
-    if (!breakpoints_.count(get_pc())) return;
+    auto pc = get_pc();
+    if (!breakpoints_.count(pc)) return;
 
     // if on a breakpoint
-    auto& bp = breakpoints_[get_pc()];
-    if (bp.isEnabled()) {
+    auto& bp = breakpoints_[pc];
+    if (bp.isEnabled() && !displacedStep(bp)) {
         bp.disable();
-        ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr);
+        resume(PTRACE_SINGLESTEP);
         waitForSignal();
         bp.enable();
     }
 }
 
-void Debugger::waitForSignal() {
-    // waiting for signal
-    int wait_status, options = 0;
-    waitpid(pid_, &wait_status, options);
+const DisplacedCopy *Debugger::getDisplacedCopy(const Breakpoint &bp) {
+    auto addr = bp.getAddress();
+    auto it = displaced_copies_.find(addr);
+    if (it != displaced_copies_.end()) return &it->second;
+
+    constexpr size_t area_size = 1 << 16, slot_size = 32;
+    if (!displaced_area_) {
+        displaced_area_ = allocateInferiorMemoryNear(addr, area_size,
+                                                     PROT_READ | PROT_EXEC);
+        if (!displaced_area_) return nullptr;
+    }
+    if (displaced_used_ + slot_size > area_size) return nullptr;
+
+    // decoded from the original bytes, int3s undone
+    auto decoded = disassembler_.instructionAt(addr);
+    if (!decoded || !decoded->valid) return nullptr;
+    auto insn = *decoded;
+    // syscall leaves the out-of-line PC in rcx, traps must be reported
+    // at their real address
+    if (insn.flow == FlowType::syscall || insn.flow == FlowType::interrupt)
+        return nullptr;
+
+    auto slot = displaced_area_ + displaced_used_;
+    std::vector<uint8_t> code;
+    if (!relocateInstruction(insn, slot, &code)) return nullptr;
+    writeMemoryBlock(slot, code.data(), code.size());
+    displaced_used_ += slot_size;
+
+    DisplacedCopy copy {slot, insn.length, static_cast<uint8_t>(code.size()),
+                        insn.flow == FlowType::call
+                        || insn.flow == FlowType::indirect_call};
+    return &(displaced_copies_[addr] = copy);
+}
+
+// The copy is prepared once per breakpoint address, so stepping past a
+// hot breakpoint costs no memory writes: just moving PC there and back
+bool Debugger::displacedStep(const Breakpoint &bp) {
+    auto copy = getDisplacedCopy(bp);
+    if (!copy) return false;
+
+    uint64_t addr = bp.getAddress();
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+    regs.rip = copy->slot;
+    countedPtrace(PTRACE_SETREGS, pid_, nullptr, &regs);
+
+    // a handler run now would see RIP in the slot (and return there):
+    // signals are held until RIP is back in the original code
+    int held = pending_signal_;
+    pending_signal_ = 0;
+    displacing_ = true;
+    resume(PTRACE_SINGLESTEP);
+    waitForSignal();
+    displacing_ = false;
+    if (exited_) return true;
+
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+    bool fix_rip = true;
+    if (regs.rip == copy->slot) {
+        // stopped by a signal before the copy ran
+        regs.rip = addr;
+    }
+    else if (regs.rip == copy->slot + copy->copy_length) {
+        // fell through
+        regs.rip = addr + copy->orig_length;
+    }
+    else {
+        if (copy->is_call) writeMemory(regs.rsp, addr + copy->orig_length);
+        fix_rip = false; // otherwise jumped to an absolute target
+    }
+    if (fix_rip) countedPtrace(PTRACE_SETREGS, pid_, nullptr, &regs);
+
+    // one signal goes with the next resume, a second one is queued again
+    if (held && pending_signal_ && held != pending_signal_)
+        syscall(SYS_tgkill, pid_, pid_, pending_signal_);
+    if (held) pending_signal_ = held;
+    return true;
+}
+
+void Debugger::waitForSignal(bool any_inferior) {
+    // the stop may have happened before its SIGCHLD could be queued
+    pollTracee();
+
+    // stdin is watched for hangups only: its input belongs to the debuggee
+    // while it runs. Losing the terminal kills the session
+    bool watch_stdin = isatty(STDIN_FILENO)
+        && event_loop_.addFd(STDIN_FILENO, 0, [this](uint32_t) {
+            std::cerr << "Terminal hung up, killing debuggee" << std::endl;
+            kill(pid_, SIGKILL);
+            exit(1);
+        });
+    pid_t pid;
+    int status;
+    {
+        StopWaitTimer timer;
+        event_loop_.runUntil([&] { return nextStopEvent(any_inferior, &pid, &status); });
+    }
+    if (watch_stdin) event_loop_.removeFd(STDIN_FILENO);
+
+    if (pid != pid_) {
+        switchInferior(pid, true);
+        std::cout << "[Switching to inferior " << std::dec << inferior_id_
+                  << " (process " << pid_ << ")]" << std::endl;
+    }
+    wait_status_ = status;
+    invalidateRegisterCache();
+    if (perf_) perf_->sample();
+
+    if (WIFEXITED(wait_status_) || WIFSIGNALED(wait_status_)) {
+        handleExit();
+        return;
+    }
 
     // handling signal
-    auto siginfo = getSignalInfo();
+    siginfo_t siginfo;
+    if (!getSignalInfo(&siginfo)) {
+        // group-stop: nothing to deliver on resume
+        siginfo.si_signo = WSTOPSIG(wait_status_);
+    } else if (siginfo.si_signo != SIGTRAP && signals_[siginfo.si_signo].pass
+               && !isDebuggerStop(siginfo)) {
+        pending_signal_ = siginfo.si_signo;
+    }
 
     switch (siginfo.si_signo) {
         case SIGTRAP:
@@ -273,15 +1093,596 @@ void Debugger::waitForSignal() {
             std::cout << "Good old segfault. Why: " << siginfo.si_code
                       << std::endl;
             break;
-				case 0:
-						//std::cout << "Program finished" << std::endl;
-						exit(0);
 				default:
 						std::cout << "Got signal: " << strsignal(siginfo.si_signo)
                       << std::endl;
     }
 }
 
+void Debugger::pollTracee() {
+    int status;
+    pid_t pid;
+    while ((pid = countedWaitpid(-1, &status, WNOHANG | __WALL)) > 0)
+        pending_statuses_.emplace_back(pid, status);
+}
+
+bool Debugger::nextStopEvent(bool any_inferior, pid_t *pid, int *status) {
+    for (auto it = pending_statuses_.begin(); it != pending_statuses_.end(); ) {
+        auto event = *it;
+        if (handleInferiorEvent(event.first, event.second)) {
+            it = pending_statuses_.erase(it);
+            continue;
+        }
+        if (event.first == pid_ || any_inferior) {
+            *pid = event.first;
+            *status = event.second;
+            pending_statuses_.erase(it);
+            return true;
+        }
+        ++it; // another inferior's stop, reported later
+    }
+    return false;
+}
+
+bool Debugger::handleInferiorEvent(pid_t pid, int status) {
+    bool is_current = pid == pid_;
+    bool known = is_current || inferiors_.count(pid);
+
+    if (recorder_ && is_current && WIFSTOPPED(status)
+            && WSTOPSIG(status) == (SIGTRAP | 0x80))
+        return recorder_->handleSyscallStop();
+
+    // first stop (SIGSTOP) of a forked child its parent announced
+    if (new_children_.erase(pid) && WIFSTOPPED(status)) {
+        countedPtrace(PTRACE_CONT, pid, nullptr, nullptr);
+        return true;
+    }
+
+    // signals that don't stop go straight back to the debuggee, without
+    // reaching the prompt
+    siginfo_t stop_info {};
+    if (known && WIFSTOPPED(status) && WSTOPSIG(status) != SIGTRAP
+            && WSTOPSIG(status) != (SIGTRAP | 0x80) && !signals_[WSTOPSIG(status)].stop
+            && !(WSTOPSIG(status) == SIGSTOP
+                 && countedPtrace(PTRACE_GETSIGINFO, pid, nullptr, &stop_info) == 0
+                 && isDebuggerStop(stop_info))) {
+        ScopedTimer timer {stats().lookup("signal-forward")};
+        auto sig = WSTOPSIG(status);
+        if (signals_[sig].print)
+            std::cout << "Program received signal " << signalName(sig) << ", "
+                      << strsignal(sig) << std::endl;
+        auto deliver = signals_[sig].pass ? sig : 0;
+        if (is_current && displacing_ && deliver) {
+            // delivered once the displaced copy has run
+            pending_signal_ = deliver;
+            deliver = 0;
+        }
+        if (recorder_ && is_current && recorder_->isReplaying()) deliver = recorder_->signalToDeliver();
+        else if (recorder_ && is_current && deliver) recorder_->logSignal(deliver);
+        auto request = is_current ? last_resume_ : PTRACE_CONT;
+        if (recorder_ && is_current) request = recorder_->mapResume(request);
+        countedPtrace(request, pid, nullptr, static_cast<long>(deliver));
+        return true;
+    }
+
+    if (WIFSTOPPED(status) && WSTOPSIG(status) == SIGTRAP && (status >> 16)) {
+        switch (status >> 16) {
+            case PTRACE_EVENT_FORK:
+            case PTRACE_EVENT_VFORK: {
+                unsigned long child = 0;
+                countedPtrace(PTRACE_GETEVENTMSG, pid, nullptr, &child);
+                addForkedInferior(child, pid);
+                // a first stop that came earlier waited for this
+                if (unannounced_children_.erase(child))
+                    countedPtrace(PTRACE_CONT, child, nullptr, nullptr);
+                else
+                    new_children_.insert(child);
+                break;
+            }
+            case PTRACE_EVENT_EXEC:
+                handleExec(pid);
+                break;
+            case PTRACE_EVENT_SECCOMP: {
+                // reported, unless its catchpoint was deleted
+                unsigned long id = 0;
+                countedPtrace(PTRACE_GETEVENTMSG, pid, nullptr, &id);
+                if (syscall_catchpoints_.count(id)) return false;
+                break;
+            }
+            default:
+                return false;
+        }
+        auto request = is_current ? last_resume_ : PTRACE_CONT;
+        if (recorder_ && is_current) request = recorder_->mapResume(request);
+        countedPtrace(request, pid, nullptr, nullptr);
+        return true;
+    }
+
+    auto checkpoint = std::find_if(checkpoints_.begin(), checkpoints_.end(),
+                                   [pid](auto &&cp) { return cp.second.pid == pid; });
+    if (checkpoint != checkpoints_.end()) {
+        // killed from outside
+        if (WIFEXITED(status) || WIFSIGNALED(status)) checkpoints_.erase(checkpoint);
+        return true;
+    }
+
+    if (!known) {
+        // first stop of a forked child, ahead of its parent's fork event:
+        // it stays stopped until the event tells whose child it is
+        if (WIFSTOPPED(status)) unannounced_children_.insert(pid);
+        return true;
+    }
+
+    if (!is_current && (WIFEXITED(status) || WIFSIGNALED(status))) {
+        std::cout << "[Inferior " << std::dec << inferiors_[pid].id
+                  << " (process " << pid << ") ";
+        if (WIFEXITED(status)) std::cout << "exited with code " << WEXITSTATUS(status);
+        else                   std::cout << "killed by " << strsignal(WTERMSIG(status));
+        std::cout << "]" << std::endl;
+        inferiors_.erase(pid);
+        unwatchPid(pid);
+        return true;
+    }
+    return false;
+}
+
+void Debugger::addForkedInferior(pid_t pid, pid_t parent) {
+    Inferior inf;
+    inf.id = next_inferior_id_++;
+    inf.pid = pid;
+    inf.running = true;
+
+    // The child is a copy of its parent's memory: int3s and the displaced
+    // stepping area are already in place, only the bookkeeping is copied
+    auto inherit = [&inf, pid](const auto &program, uint64_t load_addr,
+                               const auto &breakpoints, uint64_t area,
+                               size_t used, const auto &copies) {
+        inf.program = program;
+        inf.load_addr = load_addr;
+        for (const auto &bp : breakpoints)
+            inf.breakpoints[bp.first] = bp.second.inheritedBy(pid);
+        inf.displaced_area = area;
+        inf.displaced_used = used;
+        inf.displaced_copies = copies;
+    };
+    if (parent == pid_ || !inferiors_.count(parent)) {
+        inherit(program_, load_addr_, breakpoints_, displaced_area_,
+                displaced_used_, displaced_copies_);
+    } else {
+        const auto &inf_parent = inferiors_[parent];
+        inherit(inf_parent.program, inf_parent.load_addr, inf_parent.breakpoints,
+                inf_parent.displaced_area, inf_parent.displaced_used,
+                inf_parent.displaced_copies);
+    }
+
+    std::cout << "[New inferior " << std::dec << inf.id << " (process " << pid
+              << ")]" << std::endl;
+    inferiors_[pid] = std::move(inf);
+    watchPid(pid);
+}
+
+// Memory was replaced: breakpoints and scratch areas are gone
+void Debugger::handleExec(pid_t pid) {
+    char path[PATH_MAX];
+    auto link = "/proc/" + std::to_string(pid) + "/exe";
+    auto len = readlink(link.c_str(), path, sizeof(path) - 1);
+    if (len < 0) return;
+    path[len] = '\0';
+
+    auto program = loadProgramIndex(path);
+
+    if (pid == pid_) {
+        std::cout << "Process " << std::dec << pid << " is executing " << path
+                  << std::endl;
+        program_ = program;
+        breakpoints_.clear();
+        displaced_area_ = 0;
+        displaced_used_ = 0;
+        displaced_copies_.clear();
+        disassembler_.clear();
+        invalidateRegisterCache();
+        trace_agent_.reset();
+        initLoadAddress();
+        return;
+    }
+
+    auto &inf = inferiors_[pid];
+    std::cout << "[Inferior " << std::dec << inf.id << " (process " << pid
+              << ") is executing " << path << "]" << std::endl;
+    inf.program = program;
+    inf.breakpoints.clear();
+    inf.displaced_area = 0;
+    inf.displaced_used = 0;
+    inf.displaced_copies.clear();
+    inf.trace_agent.reset();
+
+    // the load address has to be read while the image is mapped
+    std::swap(pid_, inf.pid);
+    std::swap(program_, inf.program);
+    std::swap(load_addr_, inf.load_addr);
+    initLoadAddress();
+    std::swap(pid_, inf.pid);
+    std::swap(program_, inf.program);
+    std::swap(load_addr_, inf.load_addr);
+}
+
+void Debugger::switchInferior(pid_t pid, bool current_running) {
+    auto target = std::move(inferiors_.at(pid));
+    inferiors_.erase(pid);
+
+    if (!exited_) {
+        Inferior parked;
+        parked.id = inferior_id_;
+        parked.pid = pid_;
+        parked.program = std::move(program_);
+        parked.load_addr = load_addr_;
+        parked.breakpoints = std::move(breakpoints_);
+        parked.displaced_area = displaced_area_;
+        parked.displaced_used = displaced_used_;
+        parked.displaced_copies = std::move(displaced_copies_);
+        parked.trace_agent = std::move(trace_agent_);
+        parked.pending_signal = pending_signal_;
+        parked.running = current_running;
+        inferiors_[pid_] = std::move(parked);
+    }
+
+    inferior_id_ = target.id;
+    pid_ = target.pid;
+    program_ = std::move(target.program);
+    load_addr_ = target.load_addr;
+    breakpoints_ = std::move(target.breakpoints);
+    displaced_area_ = target.displaced_area;
+    displaced_used_ = target.displaced_used;
+    displaced_copies_ = std::move(target.displaced_copies);
+    disassembler_.clear();
+    invalidateRegisterCache();
+    trace_agent_ = std::move(target.trace_agent);
+    pending_signal_ = target.pending_signal;
+    exited_ = target.exited;
+    rebindPerfCounters();
+}
+
+void Debugger::listInferiors() {
+    auto print = [](unsigned id, pid_t pid, const std::string &path,
+                    const char *state, bool current) {
+        std::cout << (current ? "* " : "  ") << std::dec << id << " process "
+                  << pid << " " << path << " (" << state << ")" << std::endl;
+    };
+    print(inferior_id_, pid_, program_->path, exited_ ? "exited" : "stopped", true);
+    for (const auto &inf : inferiors_)
+        print(inf.second.id, inf.first, inf.second.program->path,
+              inf.second.running ? "running" : "stopped", false);
+}
+
+void Debugger::createCheckpoint() {
+    // the trampolines' shared buffer & bookkeeping can't be forked along
+    if (trace_agent_) {
+        std::cerr << "Checkpoints are not supported once tracepoints are used"
+                  << std::endl;
+        return;
+    }
+
+    auto pid = forkStopped(pid_);
+    if (pid < 0) {
+        std::cerr << "Couldn't fork the debuggee" << std::endl;
+        return;
+    }
+
+    auto cp = currentProcessState();
+    cp.id = next_checkpoint_id_++;
+    cp.pid = pid;
+    std::cout << "Checkpoint " << std::dec << cp.id << ": process " << pid
+              << " at 0x" << std::hex << cp.pc << std::endl;
+    checkpoints_[cp.id] = std::move(cp);
+}
+
+void Debugger::listCheckpoints() {
+    for (const auto &cp : checkpoints_) {
+        std::cout << std::dec << cp.first << " process " << cp.second.pid
+                  << " (inferior " << cp.second.inferior_id << ") at 0x"
+                  << std::hex << cp.second.pc << std::endl;
+    }
+}
+
+void Debugger::deleteCheckpoint(unsigned id) {
+    auto it = checkpoints_.find(id);
+    if (it == checkpoints_.end()) {
+        std::cerr << "No checkpoint " << std::dec << id << std::endl;
+        return;
+    }
+    kill(it->second.pid, SIGKILL);
+    countedWaitpid(it->second.pid, nullptr, __WALL);
+    checkpoints_.erase(it);
+}
+
+void Debugger::restartCheckpoint(unsigned id) {
+    auto it = checkpoints_.find(id);
+    if (it == checkpoints_.end()) {
+        std::cerr << "No checkpoint " << std::dec << id << std::endl;
+        return;
+    }
+    const auto &cp = it->second;
+    if (cp.inferior_id != inferior_id_) {
+        std::cerr << "Checkpoint " << std::dec << id << " belongs to inferior "
+                  << cp.inferior_id << std::endl;
+        return;
+    }
+    if (trace_agent_) {
+        std::cerr << "Checkpoints are not supported once tracepoints are used"
+                  << std::endl;
+        return;
+    }
+
+    // the checkpoint itself stays frozen; a fresh copy of it runs
+    auto pid = forkStopped(cp.pid);
+    if (pid < 0) {
+        std::cerr << "Couldn't fork checkpoint " << std::dec << id << std::endl;
+        return;
+    }
+
+    adoptProcess(pid, cp, true);
+    std::cout << "Restarted checkpoint " << std::dec << id << " as process "
+              << pid_ << " at 0x" << std::hex << get_pc() << std::endl;
+    printCurrentLocation();
+}
+
+Checkpoint Debugger::currentProcessState() {
+    Checkpoint state;
+    state.id = 0;
+    state.pid = pid_;
+    state.inferior_id = inferior_id_;
+    state.program = program_;
+    state.load_addr = load_addr_;
+    state.pc = get_pc();
+    state.breakpoints = breakpoints_;
+    state.displaced_area = displaced_area_;
+    state.displaced_used = displaced_used_;
+    state.displaced_copies = displaced_copies_;
+    return state;
+}
+
+void Debugger::adoptProcess(pid_t pid, const Checkpoint &origin, bool kill_previous) {
+    if (kill_previous && !exited_) {
+        kill(pid_, SIGKILL);
+        countedWaitpid(pid_, nullptr, __WALL);
+    }
+    unwatchPid(pid_);
+    auto old_pid = pid_;
+    pending_statuses_.erase(
+        std::remove_if(pending_statuses_.begin(), pending_statuses_.end(),
+                       [old_pid](auto &&st) { return st.first == old_pid; }),
+        pending_statuses_.end());
+
+    pid_ = pid;
+    exited_ = false;
+    watchPid(pid_);
+    program_ = origin.program;
+    load_addr_ = origin.load_addr;
+    displaced_area_ = origin.displaced_area;
+    displaced_used_ = origin.displaced_used;
+    displaced_copies_ = origin.displaced_copies;
+    disassembler_.clear();
+    invalidateRegisterCache();
+
+    // Memory holds the int3s <origin> had: take those out, then place
+    // today's breakpoints
+    for (const auto &bp : origin.breakpoints) {
+        auto copy = bp.second.inheritedBy(pid_);
+        if (copy.isEnabled()) copy.disable();
+    }
+    for (auto &bp : breakpoints_) {
+        Breakpoint fresh {pid_, bp.first};
+        if (bp.second.isEnabled()) fresh.enable();
+        bp.second = fresh;
+    }
+    rebindPerfCounters();
+}
+
+void Debugger::printCurrentLocation() {
+    try {
+        auto line_entry = getLineEntryFromPC(getOffsetPC());
+        printSource(line_entry->file->path, line_entry->line);
+    } catch (std::out_of_range &) {
+        std::cout << "0x" << std::hex << get_pc() << " (no line information)"
+                  << std::endl;
+    }
+}
+
+void Debugger::addSyscallCatchpoints(const std::vector<SyscallCatchpoint> &catchpoints) {
+    for (const auto &cp : catchpoints) {
+        syscall_catchpoints_[cp.id] = cp;
+        syscall_filters_[cp.id] = cp;
+        next_catchpoint_id_ = std::max(next_catchpoint_id_, cp.id + 1);
+    }
+}
+
+void Debugger::catchSyscall(SyscallCatchpoint cp) {
+    // injecting a syscall now would lose the one it's stopped in
+    if (WIFSTOPPED(wait_status_) && (wait_status_ >> 16) == PTRACE_EVENT_SECCOMP) {
+        std::cerr << "Stopped entering a system call, continue first" << std::endl;
+        return;
+    }
+
+    // stacking another filter would slow down every syscall: bring back
+    // the deleted catchpoint that still has one for these calls
+    for (const auto &f : syscall_filters_) {
+        const auto &old = f.second;
+        if (syscall_catchpoints_.count(f.first) || old.nr != cp.nr || old.arg != cp.arg
+                || (cp.arg >= 0 && old.value != cp.value))
+            continue;
+        syscall_catchpoints_[f.first] = old;
+        std::cout << "Catchpoint " << std::dec << f.first << " (syscall " << describe(old)
+                  << ") enabled again" << std::endl;
+        return;
+    }
+
+    cp.id = next_catchpoint_id_;
+    auto filter = buildSyscallFilter({cp});
+
+    // struct sock_fprog, followed by the program it points to
+    auto size = sizeof(sock_fprog) + filter.size() * sizeof(sock_filter);
+    auto addr = allocateInferiorMemory(size, PROT_READ | PROT_WRITE);
+    if (!addr) {
+        std::cerr << "Can't allocate memory in the debuggee" << std::endl;
+        return;
+    }
+    sock_fprog prog {static_cast<unsigned short>(filter.size()),
+                     reinterpret_cast<sock_filter*>(addr + sizeof(sock_fprog))};
+    std::vector<uint8_t> image(size);
+    std::memcpy(image.data(), &prog, sizeof(prog));
+    std::memcpy(image.data() + sizeof(prog), filter.data(), filter.size() * sizeof(sock_filter));
+    writeMemoryBlock(addr, image.data(), image.size());
+
+    // no_new_privs lets an unprivileged process install it, TSYNC puts
+    // it on all of its threads. The kernel keeps a copy
+    auto result = injectSyscall(SYS_prctl, PR_SET_NO_NEW_PRIVS, 1);
+    if (result == 0)
+        result = injectSyscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER,
+                               SECCOMP_FILTER_FLAG_TSYNC, addr);
+    injectSyscall(SYS_munmap, addr, size);
+    if (result > 0) {
+        std::cerr << "Can't install the filter: thread " << std::dec << result
+                  << " has diverging filters" << std::endl;
+        return;
+    }
+    if (result < 0) {
+        std::cerr << "Can't install the filter: " << strerror(-result) << std::endl;
+        return;
+    }
+
+    syscall_catchpoints_[cp.id] = cp;
+    syscall_filters_[cp.id] = cp;
+    ++next_catchpoint_id_;
+    std::cout << "Catchpoint " << std::dec << cp.id << " (syscall " << describe(cp) << ")"
+              << std::endl;
+}
+
+void Debugger::listSyscallCatchpoints() {
+    for (const auto &cp : syscall_catchpoints_)
+        std::cout << std::dec << cp.first << " syscall " << describe(cp.second) << std::endl;
+}
+
+void Debugger::deleteSyscallCatchpoint(unsigned id) {
+    if (!syscall_catchpoints_.erase(id))
+        std::cerr << "No catchpoint " << std::dec << id << std::endl;
+    else
+        std::cout << "Its filter stays in the debuggee: the calls still stop mdb briefly"
+                  << std::endl;
+}
+
+void Debugger::reportSyscallCatch() {
+    unsigned long id = 0;
+    countedPtrace(PTRACE_GETEVENTMSG, pid_, nullptr, &id);
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+
+    std::cout << "Catchpoint " << std::dec << id << " (call to syscall "
+              << syscallName(regs.orig_rax) << "), arguments" << std::hex;
+    for (auto arg : {regs.rdi, regs.rsi, regs.rdx, regs.r10, regs.r8, regs.r9})
+        std::cout << " 0x" << arg;
+    std::cout << std::endl;
+    printCurrentLocation();
+}
+
+void Debugger::startRecording() {
+    if (recorder_) {
+        std::cerr << "Already recording" << std::endl;
+        return;
+    }
+    // trampolines write to shared memory behind the log's back
+    if (trace_agent_) {
+        std::cerr << "Recording is not supported once tracepoints are used"
+                  << std::endl;
+        return;
+    }
+    recorder_ = std::make_unique<Recorder>(*this);
+    std::cout << "Recording process " << std::dec << pid_ << std::endl;
+}
+
+void Debugger::stopRecording() {
+    if (!recorder_) {
+        std::cerr << "Not recording" << std::endl;
+        return;
+    }
+    recorder_->returnToLive();
+    recorder_.reset();
+}
+
+void Debugger::selectInferior(unsigned id) {
+    if (recorder_ && recorder_->isReplaying()) {
+        std::cerr << "Leave the replay first (record stop)" << std::endl;
+        return;
+    }
+    auto it = std::find_if(inferiors_.begin(), inferiors_.end(),
+                           [id](auto &&inf) { return inf.second.id == id; });
+    if (it == inferiors_.end()) {
+        if (id != inferior_id_) std::cerr << "No inferior " << std::dec << id << std::endl;
+        return;
+    }
+
+    bool running = it->second.running;
+    switchInferior(it->first, false);
+    std::cout << "[Switching to inferior " << std::dec << inferior_id_
+              << " (process " << pid_ << ")]" << std::endl;
+
+    // commands need a stopped process
+    if (running) {
+        kill(pid_, SIGSTOP);
+        waitForSignal();
+    }
+}
+
+void Debugger::handleSignalFd() {
+    signalfd_siginfo info;
+    while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+        // Ctrl-C from the terminal reaches the debuggee by itself
+        // (same process group); forward kill -INT sent to mdb
+        if (info.ssi_signo == SIGINT && info.ssi_code != SI_KERNEL && !exited_)
+            kill(pid_, SIGINT);
+    }
+    // SIGCHLDs coalesce, so always drain
+    pollTracee();
+}
+
+void Debugger::reportRemoteStop() {
+    const auto &stop = remote_->lastStop();
+    if (stop.exited) {
+        exited_ = true;
+        if (stop.signal)
+            std::cout << "Process " << std::dec << remote_->pid() << " terminated by signal "
+                      << strsignal(stop.signal) << std::endl;
+        else
+            std::cout << "Process " << std::dec << remote_->pid() << " exited with code "
+                      << stop.code << std::endl;
+        return;
+    }
+
+    if (stop.signal == SIGTRAP && breakpoints_.count(get_pc()))
+        std::cout << "Hit breakpoint at address 0x" << std::hex << get_pc() << std::endl;
+    else if (stop.signal != SIGTRAP)
+        std::cout << "Got signal: " << strsignal(stop.signal) << std::endl;
+    printCurrentLocation();
+}
+
+void Debugger::printSharedLibraries() {
+    auto libraries = remote_ ? remote_->libraries() : mappedLibraries(memoryRegions());
+    for (const auto &lib : libraries)
+        std::cout << "0x" << std::setfill('0') << std::setw(16) << std::hex << lib.base
+                  << "  " << lib.path << std::endl;
+}
+
+void Debugger::handleExit() {
+    exited_ = true;
+    if (WIFEXITED(wait_status_))
+        std::cout << "Process " << std::dec << pid_ << " exited with code "
+                  << WEXITSTATUS(wait_status_) << std::endl;
+    else
+        std::cout << "Process " << std::dec << pid_ << " terminated by signal "
+                  << strsignal(WTERMSIG(wait_status_)) << std::endl;
+
+    unwatchPid(pid_);
+}
+
 void Debugger::handleSigtrap(siginfo_t info) {
     switch (info.si_code) {
         // either of these signals will be sent when hitting breakpoint
@@ -289,16 +1690,25 @@ void Debugger::handleSigtrap(siginfo_t info) {
         case TRAP_BRKPT: {
             set_pc(get_pc() - 1); // Since assynchronous auto increment
                                   // of PC
+            // an int3 tracepoint: logged, then continueExecution goes on
+            if (trace_agent_ && trace_agent_->logTrapHit(get_pc())) {
+                trace_hit_ = true;
+                return;
+            }
             std::cout << "Hit breakpoint at address 0x"
                       << std::hex << get_pc() << std::endl;
-            // offset pc for querying DWARF
-            auto offset_pc = offsetLoadAddress(get_pc());
-            auto line_entry = getLineEntryFromPC(offset_pc);
-            printSource(line_entry->file->path, line_entry->line);
+            // no line information is no error (e.g. a stripped server copy)
+            printCurrentLocation();
+            return;
+        }
+        case SIGTRAP | (PTRACE_EVENT_SECCOMP << 8): {
+            reportSyscallCatch();
             return;
         }
 				// single stepping signal
         case TRAP_TRACE:
+				// syscall-exit-stop ending a step over a syscall (record mode)
+				case SIGTRAP | 0x80:
 				// when debugger&debuggee start
 				case SI_USER: {
 						return;
@@ -311,12 +1721,78 @@ void Debugger::handleSigtrap(siginfo_t info) {
     }
 }
 
+void Debugger::perfCommand(const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+        if (perf_) perf_->reportTotals(std::cout);
+        else std::cerr << "Not counting, see `perf on`" << std::endl;
+    }
+    else if (isPrefix(args[1], "off")) {
+        perf_.reset();
+    }
+    else if (args[1] == "on") {
+        // "cycles,instructions" or "cycles instructions"
+        std::vector<std::string> events;
+        for (size_t i = 2; i < args.size(); ++i)
+            for (const auto &e : split(args[i], ','))
+                if (!e.empty()) events.push_back(e);
+        if (events.empty()) events = {"cycles", "instructions", "cache-misses"};
+        perf_.reset();
+        perf_ = std::make_unique<PerfCounters>(pid_, events);
+        std::cout << "Counting in process " << std::dec << pid_ << std::endl;
+    }
+    else {
+        std::cerr << "Usage: perf [on [" << perfEventNames() << "]|off]" << std::endl;
+    }
+}
+
+void Debugger::rebindPerfCounters() {
+    if (!perf_ || perf_->pid() == pid_) return;
+    // replay runs throwaway copies under syscall stops & single steps
+    if (exited_ || recorder_) {
+        perf_.reset();
+        std::cout << "[perf] off: " << (exited_ ? "the process exited" : "recording")
+                  << std::endl;
+        return;
+    }
+    auto events = perf_->events();
+    perf_.reset();
+    try {
+        perf_ = std::make_unique<PerfCounters>(pid_, events);
+        std::cout << "[perf] counting in process " << std::dec << pid_ << std::endl;
+    } catch (std::runtime_error &e) {
+        std::cerr << "[perf] off: " << e.what() << std::endl;
+    }
+}
+
+void Debugger::handleSignalCommand(const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+        signals_.print(std::cout);
+        return;
+    }
+    auto sig = signalNumber(args[1]);
+    if (!sig) {
+        std::cerr << "Unknown signal " << args[1] << std::endl;
+        return;
+    }
+    // mdb's own breakpoints & steps
+    if (sig == SIGTRAP && args.size() > 2) {
+        std::cerr << "SIGTRAP is used by the debugger" << std::endl;
+        return;
+    }
+    if (!signals_.set(sig, {args.begin() + 2, args.end()})) {
+        std::cerr << "Usage: handle <signal> [stop|nostop|print|noprint|pass|nopass]..."
+                  << std::endl;
+        return;
+    }
+    signals_.print(std::cout, sig);
+}
+
 void Debugger::whichFunction() {
     dwarf::taddr pc = get_pc();
 
     // Find the CU containing pc
     // XXX Use .debug_aranges
-    for (auto &cu : dwarf_.compilation_units()) {
+    for (auto &cu : program_->dwarf.compilation_units()) {
         if (!die_pc_range(cu.root()).contains(pc)) continue;
         // Map PC to a line
         auto &lt = cu.get_line_table();
@@ -346,7 +1822,7 @@ void Debugger::whichFunction() {
 }
 
 void Debugger::stepOut() {
-    auto frame_ptr = getRegisterValue(pid_, Reg::rbp);
+    auto frame_ptr = getRegister(Reg::rbp);
     // return address is store 8 bytes after start of stack frame
     auto return_addr = readMemory(frame_ptr + 8);
 
@@ -358,12 +1834,13 @@ void Debugger::stepOut() {
 
     continueExecution();
 
-    if (shouldRemoveBreakpoint) {
+    if (shouldRemoveBreakpoint && !exited_) {
         removeBreakpoint(return_addr);
     }
 }
 
 void Debugger::removeBreakpoint(std::intptr_t addr) {
+    if (remote_) remote_->removeBreakpoint(addr);
     if (breakpoints_.at(addr).isEnabled()) 
         breakpoints_.at(addr).disable();
     breakpoints_.erase(addr); 
@@ -372,23 +1849,34 @@ void Debugger::removeBreakpoint(std::intptr_t addr) {
 void Debugger::stepIn() {
     auto line = getLineEntryFromPC(getOffsetPC())->line;
 
-    while (getLineEntryFromPC(getOffsetPC())->line == line)
+    // remotely, one request steps through the whole address range of the
+    // current line table row instead of a round trip per instruction
+    while (remote_ && getLineEntryFromPC(getOffsetPC())->line == line) {
+        auto row = getLineEntryFromPC(getOffsetPC());
+        auto next = row;
+        ++next;
+        invalidateRegisterCache();
+        remote_->rangeStep(offsetDwarfAddress(row->address), offsetDwarfAddress(next->address));
+        if (remote_->lastStop().exited || remote_->lastStop().signal != SIGTRAP) {
+            reportRemoteStop();
+            return;
+        }
+    }
+
+    while (getLineEntryFromPC(getOffsetPC())->line == line) {
         singleStepWithBreakpointCheck();
+        if (exited_) return;
+    }
 
     auto line_entry = getLineEntryFromPC(getOffsetPC());
     printSource(line_entry->file->path, line_entry->line);
 }
 
 dwarf::die Debugger::getFunctionFromPC(uint64_t pc) {
-		//TODO add recursion for an actual search
-		for (auto &cu : dwarf_.compilation_units()) {
-				if (die_pc_range(cu.root()).contains(pc)) {
-						for (auto &d : cu.root()) 
-								if (die_pc_range(d).contains(pc))
-										return d;
-				}
-		}
-   throw std::out_of_range("Cannot find function in getFunctionFromPC");
+		ScopedTimer timer {stats().lookup("function")};
+		auto function = program_->scopes.function(pc);
+		if (!function) throw std::out_of_range("Cannot find function in getFunctionFromPC");
+		return function->die;
 }
 
 // simple solution to step over --- put breakpoint
@@ -415,7 +1903,7 @@ void Debugger::stepOver() {
        ++line;
     }
 
-    auto frame_ptr = getRegisterValue(pid_, Reg::rbp);
+    auto frame_ptr = getRegister(Reg::rbp);
     auto return_addr = readMemory(frame_ptr + 8);
     if (!breakpoints_.count(return_addr)) {
 				setBreakpointAtAddress(return_addr);
@@ -423,6 +1911,7 @@ void Debugger::stepOver() {
     }
 
 		continueExecution();
+		if (exited_) return;
 
 		for (auto addr : to_delete) {
 				removeBreakpoint(addr);
@@ -433,7 +1922,7 @@ void Debugger::whichLine() {
     dwarf::taddr pc = get_pc();
     // Find the CU containing pc
     // XXX Use .debug_aranges
-    for (auto &cu : dwarf_.compilation_units()) {
+    for (auto &cu : program_->dwarf.compilation_units()) {
         if (!die_pc_range(cu.root()).contains(pc)) continue;
         // Map PC to a line
         auto &lt = cu.get_line_table();
@@ -453,7 +1942,8 @@ void Debugger::whichLine() {
     
 
 dwarf::line_table::iterator Debugger::getLineEntryFromPC(uint64_t pc) {
-    for (auto &cu : dwarf_.compilation_units()) {
+    ScopedTimer timer {stats().lookup("line")};
+    for (auto &cu : program_->dwarf.compilation_units()) {
         if (!die_pc_range(cu.root()).contains(pc)) continue;
 
         auto &lt = cu.get_line_table();
@@ -465,7 +1955,7 @@ dwarf::line_table::iterator Debugger::getLineEntryFromPC(uint64_t pc) {
 }
 
 void Debugger::setBreakpointAtFunction(std::string f_name) {
-    for (auto &cu : dwarf_.compilation_units()) {
+    for (auto &cu : program_->dwarf.compilation_units()) {
         for (auto &die : cu.root()) {
             if (!die.has(dwarf::DW_AT::name) || at_name(die) != f_name) continue;
             auto low_pc = at_low_pc(die);
@@ -481,58 +1971,43 @@ void Debugger::setBreakpointAtFunction(std::string f_name) {
 
 void Debugger::setBreakpointAtLine(const std::string &filename,
 																   unsigned b_line)  {
-		bool noFile = true;
-    for (const auto &cu : dwarf_.compilation_units()) {
-				const char *p; size_t length;
-				cwk_path_get_basename(at_name(cu.root()).c_str(), &p, &length);
-				if (p != filename) continue;
-				noFile = false;	
-
-        const auto& lt = cu.get_line_table();
-
-        for (const auto &entry : lt) {
-            if (!entry.is_stmt || entry.line != b_line) continue;
-            setBreakpointAtAddress(offsetDwarfAddress(entry.address));
-            return;
-        }
-     }
-		if (noFile)
+		auto files = program_->lines.matchFiles(filename);
+		if (files.empty()) {
 				std::cerr << "File doesn't exist" << std::endl;
-		else
+				return;
+		}
+		if (files.size() > 1) {
+				std::cerr << filename << " is ambiguous, give more of its path:" << std::endl;
+				for (const auto &f : files) std::cerr << "  " << f << std::endl;
+				return;
+		}
+
+		unsigned line = 0;
+		auto addrs = program_->lines.addresses(files[0], b_line, &line);
+		if (addrs.empty()) {
 				std::cerr << "Line out of range" << std::endl;
+				return;
+		}
+		for (auto addr : addrs) {
+				auto at_addr = offsetDwarfAddress(addr);
+				if (!breakpoints_.count(at_addr)) setBreakpointAtAddress(at_addr);
+		}
+		std::cout << "Breakpoint at " << files[0] << ":" << std::dec << line;
+		if (addrs.size() > 1) std::cout << ", " << addrs.size() << " locations";
+		std::cout << std::endl;
 }
 
-siginfo_t Debugger::getSignalInfo() {
-    siginfo_t info;
-    ptrace(PTRACE_GETSIGINFO, pid_, nullptr, &info);
-    return info;
+bool Debugger::getSignalInfo(siginfo_t *info) {
+    *info = siginfo_t{};
+    return countedPtrace(PTRACE_GETSIGINFO, pid_, nullptr, info) == 0;
 }
 
 std::vector<Symbol> Debugger::lookupSymbol(const std::string &name) {
-		if (symbols_.count(name)) return symbols_[name];
+		ScopedTimer timer {stats().lookup("symbol")};
+		if (program_->symbols.count(name)) return program_->symbols[name];
 		return {};
 }
 
-void Debugger::loadSymbols() {
-
-		auto isSymbolTable = [](const elf::section &sec) {
-				return sec.get_hdr().type == elf::sht::symtab || 
-						   sec.get_hdr().type == elf::sht::dynsym;
-		};
-
-		for (auto &sec : elf_.sections()) {
-				if (!isSymbolTable(sec)) continue;
-
-				for (auto sym : sec.as_symtab()) {
-						auto &data = sym.get_data();
-						Symbol my_sym{toSymbolType(data.type()),
-												  sym.get_name(),
-													data.value};
-						symbols_[sym.get_name()].push_back(my_sym);
-				}
-		}
-}
-
 void Debugger::printBacktrace() {
 		auto outputFrame = [frame_number = 0] (auto &&func) mutable {
 				std::cout << "frame #" << frame_number++ << ": 0x" << dwarf::at_low_pc(func)
@@ -542,7 +2017,7 @@ void Debugger::printBacktrace() {
 		auto current_func = getFunctionFromPC(offsetLoadAddress(get_pc()));
 		outputFrame(current_func);
 
-		auto frame_ptr = getRegisterValue(pid_, Reg::rbp);
+		auto frame_ptr = getRegister(Reg::rbp);
 		auto return_addr = readMemory(frame_ptr + 8);
 		
 		while (dwarf::at_name(current_func) != "main") {
@@ -553,72 +2028,159 @@ void Debugger::printBacktrace() {
 		}
 }
 
-void Debugger::readVariables() {
-		using namespace dwarf;
-
-		auto func = getFunctionFromPC(getOffsetPC());
-		for (const auto &die : func) {
-				if (die.tag != DW_TAG::variable) continue;
-
-				auto loc_val = die[DW_AT::location];
-				if (loc_val.get_type() != value::type::exprloc) continue;
-
-				PtraceExprContext context {pid_};
-				auto result = loc_val.as_exprloc().evaluate(&context);
-				
-				switch(result.location_type) {
-				case expr_result::type::address: {
-						auto value = readMemory(result.value);
-						std::cout << at_name(die) << " (0x" << std::hex << result.value
-										  << ") = " << value << std::endl;
-						break;
+void Debugger::disassemble(const std::string &what) {
+		uint64_t begin, end;
+		std::string name;
+		uint64_t pc = isHexNum(what) ? std::stoull(what, 0, 16) : get_pc();
+		try {
+				dwarf::die func;
+				if (what.empty() || isHexNum(what)) {
+						func = getFunctionFromPC(offsetLoadAddress(pc));
 				}
-				case expr_result::type::reg: {
-						auto value = getRegisterValueFromDwarfRegister(pid_, result.value);
-						std::cout << at_name(die) << " (reg " << result.value << ") = "
-										  << value << std::endl;
-						break;
+				else {
+						bool found = false;
+						for (auto &cu : program_->dwarf.compilation_units()) {
+								for (auto &die : cu.root()) {
+										if (die.tag != dwarf::DW_TAG::subprogram || !die.has(dwarf::DW_AT::name)
+														|| at_name(die) != what || !die.has(dwarf::DW_AT::low_pc)) continue;
+										func = die;
+										found = true;
+										break;
+								}
+								if (found) break;
+						}
+						if (!found) {
+								std::cerr << "Couldn't find function with name " << what << std::endl;
+								return;
+						}
 				}
-				default:
-						throw std::runtime_error("Unhandled variable location");
+				begin = offsetDwarfAddress(at_low_pc(func));
+				end = offsetDwarfAddress(at_high_pc(func));
+				name = at_name(func);
+		} catch (std::out_of_range &) {
+				// not in any function: a few instructions from the address
+				begin = pc;
+				end = pc + 64;
+		}
+
+		// "<function+offset>" of a branch target or RIP-relative operand
+		auto describe = [this](uint64_t addr) -> std::string {
+				try {
+						auto func = getFunctionFromPC(offsetLoadAddress(addr));
+						std::stringstream ss;
+						ss << "  <" << at_name(func) << "+"
+						   << std::dec << addr - offsetDwarfAddress(at_low_pc(func)) << ">";
+						return ss.str();
+				} catch (std::exception &) {
+						return "";
 				}
+		};
+
+		auto &insns = disassembler_.decodeRange(begin, end);
+		if (insns.empty()) {
+				std::cerr << "Can't read memory at 0x" << std::hex << begin << std::endl;
+				return;
+		}
+		if (!name.empty()) std::cout << "Dump of assembler code for function " << name << ":" << std::endl;
+		for (const auto &insn : insns) {
+				std::stringstream bytes;
+				for (unsigned i = 0; i < insn.length; ++i)
+						bytes << std::setfill('0') << std::setw(2) << std::hex << unsigned{insn.bytes[i]} << ' ';
+
+				std::cout << (insn.address == get_pc() ? "=> " : "   ")
+						  << "0x" << std::setfill('0') << std::setw(16) << std::hex << insn.address;
+				if (!name.empty()) std::cout << " <+" << std::dec << insn.address - begin << ">";
+				std::cout << ":  " << std::setfill(' ') << std::left << std::setw(24) << bytes.str()
+						  << std::right << formatInstruction(insn);
+
+				bool direct = insn.flow == FlowType::jump || insn.flow == FlowType::cond_jump
+						|| insn.flow == FlowType::call;
+				if (insn.valid && (direct || insn.rip_relative)) std::cout << describe(insn.target);
+				std::cout << std::endl;
 		}
 }
 
-void Debugger::readVariable(std::string name) {
+void Debugger::printVariable(const dwarf::die &die) {
 		using namespace dwarf;
-		
-		bool found_name = false;
-		auto func = getFunctionFromPC(getOffsetPC());
-		for (const auto &die : func) {
-				if (die.tag != DW_TAG::variable || at_name(die) != name) continue;
-
-				auto loc_val = die[DW_AT::location];
-				//TODO read loclists
-				if (loc_val.get_type() != value::type::exprloc) continue;
-
-				PtraceExprContext context {pid_};
-				auto result = loc_val.as_exprloc().evaluate(&context);
-				
-				found_name = true;
-				switch(result.location_type) {
-				case expr_result::type::address: {
-						auto value = readMemory(result.value);
-						std::cout << at_name(die) << " (0x" << std::hex << result.value
-										  << ") = " << value << std::endl;
-						break; 
-				}
-				case expr_result::type::reg: {
-						auto value = getRegisterValueFromDwarfRegister(pid_, result.value);
-						std::cout << at_name(die) << " (reg " << result.value << ") = "
-										  << value << std::endl;
-						break;
-				}
-				default:
-						throw std::runtime_error("Unhandled variable location");
+
+		auto loc_val = die[DW_AT::location];
+		//TODO read loclists
+		if (loc_val.get_type() != value::type::exprloc) return;
+
+		auto context = makeExprContext();
+		RegisterUseContext tracked {*context};
+		auto result = loc_val.as_exprloc().evaluate(&tracked);
+
+		switch(result.location_type) {
+		case expr_result::type::address: {
+				// globals & function-local statics are at link-time addresses
+				auto address = tracked.used_registers ? result.value : offsetDwarfAddress(result.value);
+				auto value = readMemory(address);
+				std::cout << dieName(die) << " (0x" << std::hex << address
+								  << ") = " << value << std::endl;
+				break;
+		}
+		case expr_result::type::reg: {
+				auto value = getDwarfRegister(result.value);
+				std::cout << dieName(die) << " (reg " << result.value << ") = "
+								  << value << std::endl;
+				break;
+		}
+		default:
+				throw std::runtime_error("Unhandled variable location");
+		}
+}
+
+void Debugger::readVariables() {
+		// innermost block outwards; a shadowed name is printed once
+		std::vector<std::string> seen;
+		for (auto scope = program_->scopes.innermost(getOffsetPC()); scope; scope = scope->parent) {
+				for (const auto &die : scope->variables) {
+						auto name = dieName(die);
+						if (std::find(seen.begin(), seen.end(), name) != seen.end()) continue;
+						seen.push_back(name);
+						if (die.has(dwarf::DW_AT::location)) printVariable(die);
 				}
 		}
+}
 
-		if (!found_name) std::cerr << "Couldn't find variable with the given name"
-														   << std::endl;
+void Debugger::readVariable(std::string name) {
+		ScopedTimer timer {stats().lookup("variable")};
+		auto scope = program_->scopes.innermost(getOffsetPC());
+		dwarf::die die;
+		if (!ScopeIndex::findLocal(scope, name, &die)
+				&& !program_->scopes.findGlobal(name, scope ? scope->cu : dwarf::die(), &die)) {
+				std::cerr << "Couldn't find variable with the given name" << std::endl;
+				return;
+		}
+		if (!die.has(dwarf::DW_AT::location)) {
+				std::cerr << name << " is a constant, see print" << std::endl;
+				return;
+		}
+		printVariable(die);
+}
+
+TraceAgent &Debugger::traceAgent() {
+		if (!trace_agent_) trace_agent_ = std::make_unique<TraceAgent>(*this);
+		return *trace_agent_;
+}
+
+void Debugger::setTracepointAtAddress(uint64_t addr) {
+		std::stringstream ss;
+		ss << "0x" << std::hex << addr;
+		traceAgent().addTracepoint(addr, ss.str());
+}
+
+// Unlike breakpoints, tracepoints go at the very entry of a function:
+// the prologue gets relocated into the trampoline
+void Debugger::setTracepointAtFunction(const std::string &f_name) {
+		for (auto &cu : program_->dwarf.compilation_units()) {
+				for (auto &die : cu.root()) {
+						if (!die.has(dwarf::DW_AT::name) || at_name(die) != f_name) continue;
+						traceAgent().addTracepoint(offsetDwarfAddress(at_low_pc(die)), f_name);
+						return;
+				}
+		}
+		std::cerr << "Couldn't find function with name "
+							<< f_name << std::endl;
 }
@@ -0,0 +1,66 @@
+#include <algorithm>
+
+#include "debugger.hh"
+#include "disassembler.hh"
+
+const std::vector<Instruction> &Disassembler::decodeRange(uint64_t begin, uint64_t end) {
+    static const std::vector<Instruction> none;
+
+    auto it = ranges_.find(begin);
+    if (it != ranges_.end() && it->second.end >= end) return it->second.insns;
+    if (end <= begin) return none;
+
+    // the last instruction may run past <end>; the bytes after a function
+    // can be unmapped though
+    std::vector<uint8_t> buf(end - begin + max_instruction_length - 1);
+    if (!dbg_.readMemoryBlock(begin, buf.data(), buf.size())) {
+        buf.resize(end - begin);
+        if (!dbg_.readMemoryBlock(begin, buf.data(), buf.size())) return none;
+    }
+    for (const auto &bp : dbg_.getBreakpoints()) {
+        uint64_t addr = bp.first;
+        if (bp.second.isEnabled() && addr >= begin && addr < begin + buf.size())
+            buf[addr - begin] = bp.second.getSavedData();
+    }
+
+    if (ranges_.size() >= max_cached_ranges) ranges_.clear();
+    auto &range = ranges_[begin];
+    range.end = end;
+    range.insns.clear();
+    for (uint64_t addr = begin; addr < end;) {
+        auto offset = addr - begin;
+        Instruction insn;
+        if (!decodeInstruction(buf.data() + offset, buf.size() - offset, addr, &insn)) {
+            insn = Instruction{};
+            insn.address = addr;
+            insn.length = 1;
+            insn.bytes[0] = buf[offset];
+        }
+        range.insns.push_back(insn);
+        addr += insn.length;
+    }
+    return range.insns;
+}
+
+const Instruction *Disassembler::instructionAt(uint64_t address) {
+    auto it = ranges_.upper_bound(address);
+    if (it != ranges_.begin()) {
+        auto &range = std::prev(it)->second;
+        auto insn = std::lower_bound(range.insns.begin(), range.insns.end(), address,
+                                     [](const Instruction &i, uint64_t a) {
+                                         return i.address < a;
+                                     });
+        if (insn != range.insns.end() && insn->address == address) return &*insn;
+    }
+
+    auto &insns = decodeRange(address, address + 1);
+    return insns.empty() ? nullptr : &insns.front();
+}
+
+void Disassembler::invalidate(uint64_t begin, uint64_t end) {
+    // a range's last instruction may extend up to 14 bytes past its end
+    for (auto it = ranges_.begin(); it != ranges_.end() && it->first < end;) {
+        if (it->second.end + max_instruction_length - 1 > begin) it = ranges_.erase(it);
+        else ++it;
+    }
+}
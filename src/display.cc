@@ -0,0 +1,102 @@
+#include <iostream>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "debugger.hh"
+#include "display.hh"
+
+void DisplayList::compile(Display &d, uint64_t pc) {
+    if (d.expr && d.expr->program() == dbg_.program() && d.expr->validAt(pc)) return;
+
+    d.expr.reset();
+    try {
+        d.expr = std::make_unique<Expression>(d.text, dbg_.program(), pc);
+    } catch (std::exception &) {
+        // a name not visible here; retried on the next stop
+    }
+}
+
+void DisplayList::add(const std::string &text) {
+    // compiled right away so that typos are reported now
+    auto expr = std::make_unique<Expression>(text, dbg_.program(), dbg_.getOffsetPC());
+    displays_.push_back(Display{next_id_++, text, std::move(expr)});
+    show(displays_.size() - 1, true);
+}
+
+bool DisplayList::remove(unsigned id) {
+    for (auto it = displays_.begin(); it != displays_.end(); ++it) {
+        if (it->id != id) continue;
+        displays_.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void DisplayList::show(size_t first, bool all) {
+    if (first >= displays_.size()) return;
+    auto pc = dbg_.getOffsetPC();
+
+    // evaluate everything first, collecting the memory to read
+    std::vector<Value> values(displays_.size());
+    std::vector<std::string> errors(displays_.size());
+    std::vector<iovec> local, remote;
+    std::vector<size_t> pending;
+    for (size_t i = first; i < displays_.size(); ++i) {
+        auto &d = displays_[i];
+        compile(d, pc);
+        if (!d.expr) continue;
+        try {
+            values[i] = d.expr->evaluate(dbg_);
+        } catch (std::exception &e) {
+            errors[i] = e.what();
+            continue;
+        }
+        if (values[i].loaded() || values[i].type->kind == Type::Kind::function) continue;
+        values[i].bytes.resize(printedSize(*values[i].type));
+        local.push_back({values[i].bytes.data(), values[i].bytes.size()});
+        remote.push_back({reinterpret_cast<void*>(values[i].address), values[i].bytes.size()});
+        pending.push_back(i);
+    }
+
+    if (!local.empty() && !dbg_.readMemoryBlocks(local, remote)) {
+        // some address is bad: find out which, one by one
+        for (auto i : pending) {
+            values[i].bytes.clear();
+            try {
+                loadValue(dbg_, values[i]);
+            } catch (std::exception &e) {
+                errors[i] = e.what();
+            }
+        }
+    }
+
+    bool color = isatty(STDOUT_FILENO);
+    for (size_t i = first; i < displays_.size(); ++i) {
+        auto &d = displays_[i];
+        if (!d.expr) {
+            d.printed = false; // shown again once back in scope
+            continue;
+        }
+
+        std::string text;
+        if (errors[i].empty()) {
+            try {
+                text = formatValue(dbg_, values[i]);
+            } catch (std::exception &e) {
+                errors[i] = e.what();
+            }
+        }
+        if (!errors[i].empty()) text = "<error: " + errors[i] + ">";
+
+        bool changed = d.printed && text != d.shown;
+        if (all || !d.printed || changed) {
+            std::cout << std::dec << d.id << ": " << d.text << " = ";
+            if (changed && color) std::cout << "\033[1;33m" << text << "\033[0m";
+            else std::cout << text;
+            std::cout << std::endl;
+        }
+        d.shown = text;
+        d.printed = true;
+    }
+}
@@ -0,0 +1,311 @@
+#include "dwarf-types.hh"
+
+namespace {
+
+using namespace dwarf;
+
+// Constant attribute <at> of <d>, <fallback> if missing or not a constant
+int64_t constantAttr(const die &d, DW_AT at, int64_t fallback = 0) {
+    if (!d.has(at)) return fallback;
+    auto v = d[at];
+    switch (v.get_type()) {
+    case value::type::constant:
+    case value::type::uconstant:
+        return v.as_uconstant();
+    case value::type::sconstant:
+        return v.as_sconstant();
+    default:
+        return fallback;
+    }
+}
+
+// Elements of the array dimension <subrange>. 0 for flexible arrays
+uint64_t subrangeCount(const die &subrange) {
+    if (subrange.has(DW_AT::count)) return constantAttr(subrange, DW_AT::count);
+    if (!subrange.has(DW_AT::upper_bound)) return 0;
+    auto upper = constantAttr(subrange, DW_AT::upper_bound, -1);
+    auto lower = constantAttr(subrange, DW_AT::lower_bound);
+    return upper < lower ? 0 : upper - lower + 1;
+}
+
+// Byte offset of the member DIE <m>: a constant, or (DWARF 2) an
+// expression applied to the address of the aggregate
+uint64_t memberOffset(const die &m) {
+    if (!m.has(DW_AT::data_member_location)) return 0; // union members
+    auto v = m[DW_AT::data_member_location];
+    if (v.get_type() == value::type::exprloc)
+        return v.as_exprloc().evaluate(&no_expr_context, 0).value;
+    return constantAttr(m, DW_AT::data_member_location);
+}
+
+} // namespace
+
+const Type::Member *findMember(const Type &type, const std::string &name,
+                               uint64_t *offset) {
+    for (const auto &m : type.members) {
+        if (m.name == name) {
+            *offset = m.offset;
+            return &m;
+        }
+        if ((m.name.empty() || m.base_class) && m.type->kind == Type::Kind::structure) {
+            uint64_t inner;
+            if (auto found = findMember(*m.type, name, &inner)) {
+                *offset = m.offset + inner;
+                return found;
+            }
+        }
+    }
+    return nullptr;
+}
+
+std::string typeName(const Type &type) {
+    switch (type.kind) {
+    case Type::Kind::pointer:
+    case Type::Kind::reference: {
+        auto sigil = type.kind == Type::Kind::pointer ? "*" : "&";
+        auto target = typeName(*type.target);
+        bool indirect = type.target->kind == Type::Kind::pointer
+                        || type.target->kind == Type::Kind::reference;
+        return target + (indirect ? "" : " ") + sigil;
+    }
+    case Type::Kind::array: {
+        auto dims = "[" + (type.count ? std::to_string(type.count) : "") + "]";
+        const Type *element = type.target;
+        while (element->kind == Type::Kind::array) {
+            dims += "[" + std::to_string(element->count) + "]";
+            element = element->target;
+        }
+        return typeName(*element) + " " + dims;
+    }
+    case Type::Kind::structure:
+        return type.name.empty() ? "struct {...}" : type.name;
+    case Type::Kind::enumeration:
+        return type.name.empty() ? "enum {...}" : type.name;
+    case Type::Kind::function:
+        return type.target ? typeName(*type.target) + " (...)" : "void (...)";
+    default:
+        return type.name;
+    }
+}
+
+const Type *TypeTable::fromDie(const dwarf::die &die) {
+    auto offset = die.get_section_offset();
+    auto cached = by_die_.find(offset);
+    if (cached != by_die_.end()) return cached->second;
+
+    switch (die.tag) {
+    case DW_TAG::typedef_:
+    case DW_TAG::const_type:
+    case DW_TAG::volatile_type: {
+        auto type = die.has(DW_AT::type) ? fromDie(at_type(die)) : voidType();
+        by_die_[offset] = type;
+        return type;
+    }
+    case DW_TAG::array_type: {
+        auto type = fromDie(at_type(die));
+        std::vector<uint64_t> dims;
+        for (const auto &child : die)
+            if (child.tag == DW_TAG::subrange_type) dims.push_back(subrangeCount(child));
+        if (dims.empty()) dims.push_back(0);
+        // int a[2][3] is an array of 2 arrays of 3
+        for (auto d = dims.rbegin(); d != dims.rend(); ++d) type = arrayOf(type, *d);
+        by_die_[offset] = type;
+        return type;
+    }
+    default: {
+        // registered before conversion: self-referencing structs end here
+        auto type = add();
+        by_die_[offset] = type;
+        convert(die, type);
+        return type;
+    }
+    }
+}
+
+void TypeTable::convert(const dwarf::die &die, Type *type) {
+    type->size = constantAttr(die, DW_AT::byte_size);
+
+    switch (die.tag) {
+    case DW_TAG::base_type:
+        type->name = at_name(die);
+        switch (DW_ATE(constantAttr(die, DW_AT::encoding))) {
+        case DW_ATE::boolean:
+            type->kind = Type::Kind::boolean;
+            break;
+        case DW_ATE::float_:
+            type->kind = Type::Kind::floating;
+            type->is_signed = true;
+            break;
+        case DW_ATE::signed_:
+            type->kind = Type::Kind::integer;
+            type->is_signed = true;
+            break;
+        case DW_ATE::signed_char:
+            type->kind = Type::Kind::integer;
+            type->is_signed = type->is_char = true;
+            break;
+        case DW_ATE::unsigned_char:
+            type->kind = Type::Kind::integer;
+            type->is_char = true;
+            break;
+        default:
+            type->kind = Type::Kind::integer;
+            break;
+        }
+        break;
+    case DW_TAG::pointer_type:
+    case DW_TAG::reference_type:
+    case DW_TAG::rvalue_reference_type:
+        type->kind = die.tag == DW_TAG::pointer_type ? Type::Kind::pointer
+                                                     : Type::Kind::reference;
+        if (!type->size) type->size = sizeof(uint64_t);
+        type->target = die.has(DW_AT::type) ? fromDie(at_type(die)) : voidType();
+        break;
+    case DW_TAG::structure_type:
+    case DW_TAG::class_type:
+    case DW_TAG::union_type: {
+        type->kind = Type::Kind::structure;
+        auto keyword = die.tag == DW_TAG::union_type ? "union "
+                     : die.tag == DW_TAG::class_type ? "class " : "struct ";
+        if (die.has(DW_AT::name)) type->name = keyword + at_name(die);
+
+        for (const auto &child : die) {
+            bool base = child.tag == DW_TAG::inheritance;
+            // static data members are declarations only
+            if ((child.tag != DW_TAG::member && !base) || child.has(DW_AT::declaration))
+                continue;
+
+            Type::Member m {};
+            m.type = fromDie(at_type(child));
+            m.name = base ? typeName(*m.type) : child.has(DW_AT::name) ? at_name(child) : "";
+            m.offset = memberOffset(child);
+            m.base_class = base;
+            if (child.has(DW_AT::bit_size)) {
+                m.bit_size = constantAttr(child, DW_AT::bit_size);
+                uint64_t bit;
+                if (child.has(DW_AT::data_bit_offset)) {
+                    bit = constantAttr(child, DW_AT::data_bit_offset);
+                } else {
+                    // DWARF 2/3: counted from the most significant bit of the
+                    // storage unit at data_member_location
+                    auto unit = constantAttr(child, DW_AT::byte_size, m.type->size);
+                    bit = m.offset * 8 + unit * 8
+                          - constantAttr(child, DW_AT::bit_offset) - m.bit_size;
+                    m.offset = 0;
+                }
+                m.offset += bit / 8;
+                m.bit_offset = bit % 8;
+            }
+            type->members.push_back(m);
+        }
+        break;
+    }
+    case DW_TAG::enumeration_type:
+        type->kind = Type::Kind::enumeration;
+        if (die.has(DW_AT::name)) type->name = "enum " + at_name(die);
+        type->is_signed = die.has(DW_AT::type) ? fromDie(at_type(die))->is_signed : true;
+        for (const auto &child : die)
+            if (child.tag == DW_TAG::enumerator)
+                type->enumerators.emplace_back(at_name(child),
+                                               constantAttr(child, DW_AT::const_value));
+        break;
+    case DW_TAG::subroutine_type:
+        type->kind = Type::Kind::function;
+        type->size = 1;
+        if (die.has(DW_AT::type)) type->target = fromDie(at_type(die));
+        break;
+    default:
+        type->kind = Type::Kind::void_;
+        type->name = die.has(DW_AT::name) ? at_name(die) : "void";
+        break;
+    }
+}
+
+const Type *TypeTable::findNamed(const dwarf::dwarf &dw, const std::string &name) {
+    if (!named_indexed_) {
+        // types declared at CU level or in namespaces
+        std::vector<die> pending;
+        for (const auto &cu : dw.compilation_units()) pending.push_back(cu.root());
+        while (!pending.empty()) {
+            auto scope = pending.back();
+            pending.pop_back();
+            for (const auto &d : scope) {
+                if (d.tag == DW_TAG::namespace_) {
+                    pending.push_back(d);
+                    continue;
+                }
+                if (!d.has(DW_AT::name) || d.has(DW_AT::declaration)) continue;
+
+                auto n = at_name(d);
+                switch (d.tag) {
+                case DW_TAG::structure_type:
+                    named_.emplace("struct " + n, d);
+                    named_.emplace(n, d);
+                    break;
+                case DW_TAG::class_type:
+                    named_.emplace("class " + n, d);
+                    named_.emplace(n, d);
+                    break;
+                case DW_TAG::union_type:
+                    named_.emplace("union " + n, d);
+                    named_.emplace(n, d);
+                    break;
+                case DW_TAG::enumeration_type:
+                    named_.emplace("enum " + n, d);
+                    named_.emplace(n, d);
+                    break;
+                case DW_TAG::typedef_:
+                case DW_TAG::base_type:
+                    named_.emplace(n, d);
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+        named_indexed_ = true;
+    }
+
+    auto found = named_.find(name);
+    return found == named_.end() ? nullptr : fromDie(found->second);
+}
+
+const Type *TypeTable::builtin(Type::Kind kind, uint64_t size, bool is_signed,
+                               const std::string &name) {
+    auto &type = builtins_[name];
+    if (!type) {
+        auto t = add();
+        t->kind = kind;
+        t->size = size;
+        t->is_signed = is_signed;
+        t->is_char = name.find("char") != std::string::npos;
+        t->name = name;
+        type = t;
+    }
+    return type;
+}
+
+const Type *TypeTable::pointerTo(const Type *target) {
+    auto &type = pointers_[target];
+    if (!type) {
+        auto t = add();
+        t->kind = Type::Kind::pointer;
+        t->size = sizeof(uint64_t);
+        t->target = target;
+        type = t;
+    }
+    return type;
+}
+
+const Type *TypeTable::arrayOf(const Type *element, uint64_t count) {
+    auto &type = arrays_[{element, count}];
+    if (!type) {
+        auto t = add();
+        t->kind = Type::Kind::array;
+        t->size = element->size * count;
+        t->target = element;
+        t->count = count;
+        type = t;
+    }
+    return type;
+}
@@ -0,0 +1,52 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "event-loop.hh"
+
+EventLoop::EventLoop() : epoll_fd_{epoll_create1(EPOLL_CLOEXEC)} {
+    if (epoll_fd_ < 0)
+        throw std::runtime_error(std::string{"epoll_create1: "} + strerror(errno));
+}
+
+EventLoop::~EventLoop() {
+    close(epoll_fd_);
+}
+
+bool EventLoop::addFd(int fd, uint32_t events, Callback cb) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) return false;
+    callbacks_[fd] = std::move(cb);
+    return true;
+}
+
+void EventLoop::removeFd(int fd) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    callbacks_.erase(fd);
+}
+
+void EventLoop::runUntil(const std::function<bool()> &done) {
+    while (!done()) runOnce(-1);
+}
+
+void EventLoop::runOnce(int timeout_ms) {
+    epoll_event events[16];
+    auto n = epoll_wait(epoll_fd_, events, 16, timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR) return;
+        throw std::runtime_error(std::string{"epoll_wait: "} + strerror(errno));
+    }
+
+    for (int i = 0; i < n; ++i) {
+        // a callback may have removed a later fd
+        auto it = callbacks_.find(events[i].data.fd);
+        if (it == callbacks_.end()) continue;
+        auto cb = it->second; // callbacks may remove themselves
+        cb(events[i].events);
+    }
+}
@@ -0,0 +1,1016 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include "debugger.hh"
+#include "expression.hh"
+#include "register-use-context.hh"
+#include "stats.hh"
+
+struct Expression::Node {
+    enum class Op {
+        constant, variable, function, member, deref, address_of, decay,
+        repeat, cast, unary, binary, logical_and, logical_or
+    };
+
+    Op op;
+    const Type *type;
+    std::vector<std::unique_ptr<Node>> operands;
+    Value constant;                     // constant
+    dwarf::die die;                     // variable
+    uint64_t address {0};               // function, as a DWARF address
+    const Type::Member *member {nullptr}; // member
+    uint64_t offset {0};                // member
+    std::string token;                  // unary & binary operator
+    const Type *operand_type {nullptr}; // binary: operands converted to it
+};
+
+namespace {
+
+using Node = Expression::Node;
+using NodePtr = std::unique_ptr<Node>;
+
+// ---- Tokens -------------------------------------------------------------
+
+struct Token {
+    enum class Kind { identifier, number, character, punct, end };
+    Kind kind;
+    std::string text;
+};
+
+const char *const puncts[] = {
+    "->", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||",
+    "+", "-", "*", "/", "%", "&", "|", "^", "!", "~", "<", ">",
+    "(", ")", "[", "]", ".", "@",
+};
+
+std::vector<Token> tokenize(const std::string &text) {
+    std::vector<Token> tokens;
+    size_t i = 0;
+    while (i < text.size()) {
+        auto c = text[i];
+        if (isspace(c)) {
+            ++i;
+        }
+        else if (isalpha(c) || c == '_') {
+            auto start = i;
+            while (i < text.size() && (isalnum(text[i]) || text[i] == '_'
+                   || (text.compare(i, 2, "::") == 0 && ++i))) ++i;
+            tokens.push_back({Token::Kind::identifier, text.substr(start, i - start)});
+        }
+        else if (isdigit(c) || (c == '.' && i + 1 < text.size() && isdigit(text[i + 1]))) {
+            auto start = i;
+            bool hex = text.compare(i, 2, "0x") == 0 || text.compare(i, 2, "0X") == 0;
+            while (i < text.size() && (isalnum(text[i]) || text[i] == '.'
+                   || (!hex && (text[i] == '+' || text[i] == '-')
+                       && (text[i - 1] == 'e' || text[i - 1] == 'E')))) ++i;
+            tokens.push_back({Token::Kind::number, text.substr(start, i - start)});
+        }
+        else if (c == '\'') {
+            auto end = text.find('\'', i + 2);
+            if (end == std::string::npos) throw ExpressionError("Unmatched single quote");
+            tokens.push_back({Token::Kind::character, text.substr(i + 1, end - i - 1)});
+            i = end + 1;
+        }
+        else {
+            auto p = std::find_if(std::begin(puncts), std::end(puncts),
+                                  [&](const char *s) { return text.compare(i, strlen(s), s) == 0; });
+            if (p == std::end(puncts))
+                throw ExpressionError(std::string("Invalid character '") + c + "' in expression");
+            tokens.push_back({Token::Kind::punct, *p});
+            i += strlen(*p);
+        }
+    }
+    tokens.push_back({Token::Kind::end, ""});
+    return tokens;
+}
+
+// Value of the character literal body <s> ("a", "\n", "\x41", "\0")
+int parseCharacter(const std::string &s) {
+    if (s.size() == 1) return s[0];
+    if (s.size() < 2 || s[0] != '\\') throw ExpressionError("Invalid character constant");
+    switch (s[1]) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case 'a': return '\a';
+    case 'b': return '\b';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    case 'e': return 27;
+    case 'x': return std::stoi(s.substr(2), nullptr, 16);
+    default:
+        if (isdigit(s[1])) return std::stoi(s.substr(1), nullptr, 8);
+        return s[1];
+    }
+}
+
+// ---- Scalars ------------------------------------------------------------
+
+bool isFloating(const Type *t) { return t->kind == Type::Kind::floating; }
+
+// Bits of the integer, enum or pointer <v>, sign-extended if signed
+uint64_t rawBits(const Value &v) {
+    uint64_t bits = 0;
+    auto size = std::min<size_t>(v.bytes.size(), sizeof(bits));
+    std::memcpy(&bits, v.bytes.data(), size);
+    if (v.type->is_signed && size && size < sizeof(bits) && (bits >> (size * 8 - 1)) & 1)
+        bits |= ~uint64_t{0} << (size * 8);
+    return bits;
+}
+
+long double toFloating(const Value &v) {
+    if (!isFloating(v.type)) {
+        return v.type->is_signed ? static_cast<long double>(int64_t(rawBits(v)))
+                                 : static_cast<long double>(rawBits(v));
+    }
+    if (v.bytes.size() == sizeof(float)) {
+        float f;
+        std::memcpy(&f, v.bytes.data(), sizeof(f));
+        return f;
+    }
+    if (v.bytes.size() == sizeof(double)) {
+        double d;
+        std::memcpy(&d, v.bytes.data(), sizeof(d));
+        return d;
+    }
+    long double ld = 0; // x87 extended, 10 bytes padded to 16
+    std::memcpy(&ld, v.bytes.data(), std::min(v.bytes.size(), sizeof(ld)));
+    return ld;
+}
+
+bool isTrue(const Value &v) {
+    return isFloating(v.type) ? toFloating(v) != 0 : rawBits(v) != 0;
+}
+
+Value makeInteger(const Type *type, uint64_t bits) {
+    Value v {type};
+    v.bytes.resize(type->size);
+    std::memcpy(v.bytes.data(), &bits, std::min<size_t>(type->size, sizeof(bits)));
+    return v;
+}
+
+Value makeFloating(const Type *type, long double x) {
+    Value v {type};
+    v.bytes.resize(type->size);
+    if (type->size == sizeof(float)) {
+        float f = x;
+        std::memcpy(v.bytes.data(), &f, sizeof(f));
+    } else if (type->size == sizeof(double)) {
+        double d = x;
+        std::memcpy(v.bytes.data(), &d, sizeof(d));
+    } else {
+        std::memcpy(v.bytes.data(), &x, std::min<size_t>(type->size, sizeof(x)));
+    }
+    return v;
+}
+
+Value convertScalar(const Value &v, const Type *to) {
+    if (isFloating(to)) return makeFloating(to, toFloating(v));
+    if (to->kind == Type::Kind::boolean) return makeInteger(to, isTrue(v));
+    if (isFloating(v.type)) {
+        auto x = toFloating(v);
+        return makeInteger(to, to->is_signed ? uint64_t(int64_t(x)) : uint64_t(x));
+    }
+    return makeInteger(to, rawBits(v));
+}
+
+// ---- Compiler -----------------------------------------------------------
+
+// Binary operators by precedence, lowest first (as in C, with gdb's @
+// between shifts and additions)
+const std::vector<std::vector<std::string>> binary_levels = {
+    {"||"}, {"&&"}, {"|"}, {"^"}, {"&"}, {"==", "!="}, {"<", ">", "<=", ">="},
+    {"<<", ">>"}, {"@"}, {"+", "-"}, {"*", "/", "%"},
+};
+
+// Recursive-descent parser building the typed plan directly
+class Compiler {
+public:
+    Compiler(std::vector<Token> tokens, ProgramIndex &program, const Scope *scope)
+        : tokens_{std::move(tokens)}, program_{program}, types_{program.types},
+          scope_{scope}, cu_{scope ? scope->cu : dwarf::die()} {}
+
+    NodePtr compile() {
+        auto node = binary(0);
+        if (peek().kind != Token::Kind::end)
+            throw ExpressionError("Unexpected '" + peek().text + "' in expression");
+        return node;
+    }
+
+private:
+    const Token &peek(size_t ahead = 0) const {
+        return tokens_[std::min(pos_ + ahead, tokens_.size() - 1)];
+    }
+
+    bool accept(const std::string &punct) {
+        if (peek().kind != Token::Kind::punct || peek().text != punct) return false;
+        ++pos_;
+        return true;
+    }
+
+    void expect(const std::string &punct) {
+        if (!accept(punct))
+            throw ExpressionError("Expected '" + punct + "' in expression");
+    }
+
+    const Type *intType() { return types_.builtin(Type::Kind::integer, 4, true, "int"); }
+    const Type *longType() { return types_.builtin(Type::Kind::integer, 8, true, "long"); }
+    const Type *ulongType() {
+        return types_.builtin(Type::Kind::integer, 8, false, "unsigned long");
+    }
+
+    NodePtr node(Node::Op op, const Type *type) {
+        auto n = std::make_unique<Node>();
+        n->op = op;
+        n->type = type;
+        return n;
+    }
+
+    NodePtr constant(Value v) {
+        auto n = node(Node::Op::constant, v.type);
+        n->constant = std::move(v);
+        return n;
+    }
+
+    // References are used as what they refer to
+    NodePtr unreference(NodePtr n) {
+        if (n->type->kind != Type::Kind::reference) return n;
+        auto deref = node(Node::Op::deref, n->type->target);
+        deref->operands.push_back(std::move(n));
+        return deref;
+    }
+
+    // Arrays & functions used as values become pointers
+    NodePtr decay(NodePtr n) {
+        if (n->type->kind != Type::Kind::array && n->type->kind != Type::Kind::function)
+            return n;
+        auto target = n->type->kind == Type::Kind::array ? n->type->target : n->type;
+        auto d = node(Node::Op::decay, types_.pointerTo(target));
+        d->operands.push_back(std::move(n));
+        return d;
+    }
+
+    NodePtr scalar(NodePtr n, const std::string &op) {
+        n = decay(std::move(n));
+        if (!n->type->isScalar())
+            throw ExpressionError("Operand of '" + op + "' has non-scalar type "
+                                  + typeName(*n->type));
+        return n;
+    }
+
+    // Type both operands of an arithmetic operator are converted to
+    const Type *arithmeticType(const Type *a, const Type *b) {
+        if (isFloating(a) || isFloating(b)) {
+            auto size = std::max(isFloating(a) ? a->size : 0, isFloating(b) ? b->size : 0);
+            if (size > sizeof(double))
+                return types_.builtin(Type::Kind::floating, size, true, "long double");
+            if (size == sizeof(float))
+                return types_.builtin(Type::Kind::floating, sizeof(float), true, "float");
+            return types_.builtin(Type::Kind::floating, sizeof(double), true, "double");
+        }
+        // integer promotion, then the larger type wins; unsigned on a tie
+        auto promote = [](const Type *t) { return t->size < 4 ? std::make_pair(4ul, true)
+                                                              : std::make_pair(t->size, t->is_signed); };
+        auto pa = promote(a), pb = promote(b);
+        auto size = std::max(pa.first, pb.first);
+        bool is_signed = pa.first == pb.first ? pa.second && pb.second
+                       : pa.first > pb.first ? pa.second : pb.second;
+        if (size > 4)
+            return is_signed ? longType() : ulongType();
+        return is_signed ? intType()
+                         : types_.builtin(Type::Kind::integer, 4, false, "unsigned int");
+    }
+
+    NodePtr binary(size_t level) {
+        if (level == binary_levels.size()) return unary();
+
+        auto lhs = binary(level + 1);
+        for (;;) {
+            const auto &ops = binary_levels[level];
+            if (peek().kind != Token::Kind::punct
+                    || std::find(ops.begin(), ops.end(), peek().text) == ops.end())
+                return lhs;
+            auto op = tokens_[pos_++].text;
+            lhs = makeBinary(op, std::move(lhs), binary(level + 1));
+        }
+    }
+
+    NodePtr makeBinary(const std::string &op, NodePtr lhs, NodePtr rhs) {
+        if (op == "@") {
+            rhs = scalar(std::move(rhs), op);
+            if (!rhs->type->isInteger()) throw ExpressionError("Count of '@' must be an integer");
+            auto n = node(Node::Op::repeat, types_.arrayOf(lhs->type, 0));
+            n->operands.push_back(std::move(lhs));
+            n->operands.push_back(std::move(rhs));
+            return n;
+        }
+
+        lhs = scalar(std::move(lhs), op);
+        rhs = scalar(std::move(rhs), op);
+        auto a = lhs->type, b = rhs->type;
+        bool a_ptr = a->kind == Type::Kind::pointer, b_ptr = b->kind == Type::Kind::pointer;
+
+        NodePtr n;
+        if (op == "&&" || op == "||") {
+            n = node(op == "&&" ? Node::Op::logical_and : Node::Op::logical_or, intType());
+        }
+        else if (op == "==" || op == "!=" || op == "<" || op == ">" || op == "<=" || op == ">=") {
+            n = node(Node::Op::binary, intType());
+            n->operand_type = a_ptr || b_ptr ? ulongType() : arithmeticType(a, b);
+        }
+        else if ((op == "+" || op == "-") && (a_ptr || b_ptr)) {
+            if (a_ptr && b_ptr) {
+                if (op == "+" || a->target->size != b->target->size)
+                    throw ExpressionError("Invalid pointer operands of '" + op + "'");
+                n = node(Node::Op::binary, longType());
+            }
+            else {
+                auto ptr = a_ptr ? a : b;
+                if (!(a_ptr ? b : a)->isInteger() || (op == "-" && b_ptr))
+                    throw ExpressionError("Invalid operands of '" + op + "'");
+                if (ptr->target->kind == Type::Kind::void_)
+                    throw ExpressionError("Arithmetic on a void pointer");
+                n = node(Node::Op::binary, ptr);
+            }
+            n->operand_type = ulongType();
+        }
+        else {
+            if (a_ptr || b_ptr) throw ExpressionError("Invalid pointer operand of '" + op + "'");
+            bool integral = op != "+" && op != "-" && op != "*" && op != "/";
+            if (integral && (!a->isInteger() || !b->isInteger()))
+                throw ExpressionError("Operands of '" + op + "' must be integers");
+            auto type = op == "<<" || op == ">>" ? arithmeticType(a, a) : arithmeticType(a, b);
+            n = node(Node::Op::binary, type);
+            n->operand_type = type;
+        }
+        n->token = op;
+        n->operands.push_back(std::move(lhs));
+        n->operands.push_back(std::move(rhs));
+        return n;
+    }
+
+    NodePtr unary() {
+        if (accept("-") || accept("+") || accept("!") || accept("~")) {
+            auto op = tokens_[pos_ - 1].text;
+            auto operand = scalar(unary(), op);
+            const Type *type;
+            if (op == "!") {
+                type = intType();
+            } else {
+                if (operand->type->kind == Type::Kind::pointer
+                        || (op == "~" && isFloating(operand->type)))
+                    throw ExpressionError("Invalid operand of '" + op + "'");
+                type = arithmeticType(operand->type, operand->type);
+            }
+            auto n = node(Node::Op::unary, type);
+            n->token = op;
+            n->operands.push_back(std::move(operand));
+            return n;
+        }
+        if (accept("*")) return dereference(unary());
+        if (accept("&")) {
+            auto operand = unary();
+            if (operand->op == Node::Op::member && operand->member->bit_size)
+                throw ExpressionError("Can't take the address of a bit-field");
+            auto n = node(Node::Op::address_of, types_.pointerTo(operand->type));
+            n->operands.push_back(std::move(operand));
+            return n;
+        }
+        if (peek().kind == Token::Kind::identifier && peek().text == "sizeof") {
+            ++pos_;
+            const Type *type = nullptr;
+            if (peek().text == "(") {
+                auto saved = pos_++;
+                type = parseTypeName();
+                if (type) expect(")");
+                else pos_ = saved;
+            }
+            if (!type) type = unary()->type;
+            return constant(makeInteger(ulongType(), type->size));
+        }
+        if (peek().text == "(" && peek().kind == Token::Kind::punct) {
+            auto saved = pos_++;
+            if (auto type = parseTypeName()) {
+                expect(")");
+                return cast(unary(), type);
+            }
+            pos_ = saved;
+        }
+        return postfix();
+    }
+
+    NodePtr dereference(NodePtr operand) {
+        operand = decay(std::move(operand));
+        if (operand->type->kind != Type::Kind::pointer)
+            throw ExpressionError("Attempt to take contents of a non-pointer value");
+        if (operand->type->target->kind == Type::Kind::void_)
+            throw ExpressionError("Attempt to take contents of a void pointer");
+        auto n = node(Node::Op::deref, operand->type->target);
+        n->operands.push_back(std::move(operand));
+        return n;
+    }
+
+    NodePtr cast(NodePtr operand, const Type *to) {
+        operand = decay(std::move(operand));
+        if (!to->isScalar() || !operand->type->isScalar())
+            throw ExpressionError("Invalid cast to " + ::typeName(*to));
+        if (to->kind == Type::Kind::pointer && isFloating(operand->type))
+            throw ExpressionError("Invalid cast of a floating-point value to a pointer");
+        auto n = node(Node::Op::cast, to);
+        n->operands.push_back(std::move(operand));
+        return n;
+    }
+
+    // Type name followed by '*'s, or nullptr (nothing consumed) if the
+    // tokens don't start one
+    const Type *parseTypeName() {
+        auto start = pos_;
+        bool is_unsigned = false, is_signed = false;
+        int longs = 0;
+        std::string base, keyword;
+        for (;;) {
+            if (peek().kind != Token::Kind::identifier) break;
+            const auto &word = peek().text;
+            if (word == "const" || word == "volatile") {}
+            else if (word == "unsigned") is_unsigned = true;
+            else if (word == "signed") is_signed = true;
+            else if (word == "long") ++longs;
+            else if (word == "short" || word == "char" || word == "int" || word == "float"
+                     || word == "double" || word == "bool" || word == "_Bool"
+                     || word == "void") {
+                if (!base.empty() && !(base == "short" && word == "int")) break;
+                if (base.empty()) base = word;
+            }
+            else if (word == "struct" || word == "union" || word == "enum" || word == "class") {
+                if (peek(1).kind != Token::Kind::identifier) break;
+                keyword = word + " " + peek(1).text;
+                ++pos_;
+            }
+            else if (base.empty() && keyword.empty() && !is_unsigned && !is_signed && !longs
+                     && !hasVariable(word) && types_.findNamed(program_.dwarf, word)) {
+                keyword = word; // typedef or C++ class name
+            }
+            else break;
+            ++pos_;
+        }
+        if (pos_ == start) return nullptr;
+
+        const Type *type;
+        if (!keyword.empty()) {
+            type = types_.findNamed(program_.dwarf, keyword);
+            if (!type) throw ExpressionError("No type named " + keyword);
+        }
+        else if (base == "void") type = types_.voidType();
+        else if (base == "bool" || base == "_Bool")
+            type = types_.builtin(Type::Kind::boolean, 1, false, "bool");
+        else if (base == "float") type = types_.builtin(Type::Kind::floating, 4, true, "float");
+        else if (base == "double")
+            type = longs ? types_.builtin(Type::Kind::floating, 16, true, "long double")
+                         : types_.builtin(Type::Kind::floating, 8, true, "double");
+        else if (base == "char")
+            type = is_unsigned ? types_.builtin(Type::Kind::integer, 1, false, "unsigned char")
+                 : is_signed ? types_.builtin(Type::Kind::integer, 1, true, "signed char")
+                 : types_.builtin(Type::Kind::integer, 1, true, "char");
+        else {
+            uint64_t size = base == "short" ? 2 : longs ? 8 : 4;
+            auto name = std::string(is_unsigned ? "unsigned " : "")
+                        + (size == 2 ? "short" : size == 8 ? "long" : "int");
+            type = types_.builtin(Type::Kind::integer, size, !is_unsigned, name);
+        }
+        while (accept("*")) type = types_.pointerTo(type);
+        return type;
+    }
+
+    NodePtr postfix() {
+        auto n = primary();
+        for (;;) {
+            if (accept("[")) {
+                auto index = binary(0);
+                expect("]");
+                n = dereference(makeBinary("+", std::move(n), std::move(index)));
+            }
+            else if (accept(".")) {
+                n = member(std::move(n));
+            }
+            else if (accept("->")) {
+                n = member(dereference(std::move(n)));
+            }
+            else {
+                return n;
+            }
+        }
+    }
+
+    NodePtr member(NodePtr base) {
+        if (peek().kind != Token::Kind::identifier) throw ExpressionError("Expected a member name");
+        auto name = tokens_[pos_++].text;
+        if (base->type->kind != Type::Kind::structure)
+            throw ExpressionError("Attempt to extract member " + name + " of a non-struct value");
+
+        uint64_t offset;
+        auto m = findMember(*base->type, name, &offset);
+        if (!m) throw ExpressionError("There is no member named " + name);
+        auto n = node(Node::Op::member, m->type);
+        n->member = m;
+        n->offset = offset;
+        n->operands.push_back(std::move(base));
+        return unreference(std::move(n));
+    }
+
+    NodePtr primary() {
+        const auto &t = tokens_[pos_];
+        switch (t.kind) {
+        case Token::Kind::number:
+            ++pos_;
+            return number(t.text);
+        case Token::Kind::character:
+            ++pos_;
+            return constant(makeInteger(types_.builtin(Type::Kind::integer, 1, true, "char"),
+                                        parseCharacter(t.text)));
+        case Token::Kind::identifier:
+            ++pos_;
+            return identifier(t.text);
+        default:
+            if (accept("(")) {
+                auto n = binary(0);
+                expect(")");
+                return n;
+            }
+            throw ExpressionError(t.kind == Token::Kind::end ? "Incomplete expression"
+                                  : "Unexpected '" + t.text + "' in expression");
+        }
+    }
+
+    NodePtr number(const std::string &text) {
+        size_t used = 0;
+        bool hex = text.size() > 1 && text[0] == '0' && tolower(text[1]) == 'x';
+        if (!hex && text.find_first_of(".eE") != std::string::npos) {
+            auto x = std::stold(text, &used);
+            bool is_float = used < text.size() && tolower(text[used]) == 'f';
+            auto type = is_float ? types_.builtin(Type::Kind::floating, 4, true, "float")
+                                 : types_.builtin(Type::Kind::floating, 8, true, "double");
+            if (used + is_float != text.size()) throw ExpressionError("Invalid number " + text);
+            return constant(makeFloating(type, x));
+        }
+
+        uint64_t x;
+        try {
+            x = std::stoull(text, &used, 0);
+        } catch (std::exception &) {
+            throw ExpressionError("Invalid number " + text);
+        }
+        auto suffix = text.substr(used);
+        std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
+        if (suffix.find_first_not_of("ul") != std::string::npos)
+            throw ExpressionError("Invalid number " + text);
+
+        bool is_unsigned = suffix.find('u') != std::string::npos;
+        bool is_long = suffix.find('l') != std::string::npos || x > 0x7fffffff;
+        auto type = is_long ? (is_unsigned || x > 0x7fffffffffffffff ? ulongType() : longType())
+                  : is_unsigned ? types_.builtin(Type::Kind::integer, 4, false, "unsigned int")
+                  : intType();
+        return constant(makeInteger(type, x));
+    }
+
+    bool findVariable(const std::string &name, dwarf::die *out) const {
+        return ScopeIndex::findLocal(scope_, name, out)
+               || program_.scopes.findGlobal(name, cu_, out);
+    }
+
+    bool hasVariable(const std::string &name) const {
+        dwarf::die d;
+        return findVariable(name, &d);
+    }
+
+    NodePtr identifier(const std::string &name) {
+        using namespace dwarf;
+
+        die found;
+        if (findVariable(name, &found)) return variable(found, name);
+        if (cu_.valid()) {
+            // enumerators of the compilation unit
+            for (const auto &d : cu_) {
+                if (d.tag != DW_TAG::enumeration_type) continue;
+                auto type = types_.fromDie(d);
+                for (const auto &e : type->enumerators)
+                    if (e.first == name) return constant(makeInteger(type, e.second));
+            }
+        }
+
+        for (const auto &cu : program_.dwarf.compilation_units()) {
+            for (const auto &d : cu.root()) {
+                if (d.tag != DW_TAG::subprogram || !d.has(DW_AT::low_pc) || dieName(d) != name)
+                    continue;
+                auto type = types_.builtin(Type::Kind::function, 1, false, name + "()");
+                auto n = node(Node::Op::function, type);
+                n->address = at_low_pc(d);
+                return n;
+            }
+        }
+        throw ExpressionError("No symbol \"" + name + "\" in current context");
+    }
+
+    NodePtr variable(const dwarf::die &d, const std::string &name) {
+        using namespace dwarf;
+        auto type = d.has(DW_AT::type) ? types_.fromDie(at_type(d)) : intType();
+
+        if (d.has(DW_AT::const_value)) {
+            auto v = d[DW_AT::const_value];
+            uint64_t bits = v.get_type() == value::type::sconstant ? v.as_sconstant()
+                          : v.get_type() == value::type::uconstant
+                            || v.get_type() == value::type::constant ? v.as_uconstant()
+                          : throw ExpressionError(name + " is a constant of unsupported form");
+            return constant(makeInteger(type, bits));
+        }
+        // libelfin can't walk .debug_loc/.debug_loclists entries
+        if (d[DW_AT::location].get_type() != value::type::exprloc)
+            throw ExpressionError(name + " has an unsupported location list");
+
+        auto n = node(Node::Op::variable, type);
+        n->die = d;
+        return unreference(std::move(n));
+    }
+
+    std::vector<Token> tokens_;
+    size_t pos_ {0};
+    ProgramIndex &program_;
+    TypeTable &types_;
+    const Scope *scope_;
+    dwarf::die cu_;
+};
+
+// ---- Evaluation ---------------------------------------------------------
+
+Value readVariable(Debugger &dbg, const Node &n) {
+    using namespace dwarf;
+
+    auto context = dbg.makeExprContext();
+    RegisterUseContext tracked {*context};
+    auto result = n.die[DW_AT::location].as_exprloc().evaluate(&tracked);
+
+    Value v {n.type};
+    switch (result.location_type) {
+    case expr_result::type::address:
+        v.lvalue = true;
+        v.address = tracked.used_registers ? result.value : dbg.offsetDwarfAddress(result.value);
+        return v;
+    case expr_result::type::reg:
+        return makeInteger(n.type, dbg.getDwarfRegister(result.value));
+    case expr_result::type::literal:
+        return makeInteger(n.type, result.value);
+    case expr_result::type::implicit:
+        v.bytes.assign(result.implicit, result.implicit + result.implicit_len);
+        v.bytes.resize(n.type->size);
+        return v;
+    default:
+        throw ExpressionError(dieName(n.die) + " is optimized out");
+    }
+}
+
+Value evaluateNode(Debugger &dbg, TypeTable &types, const Node &n);
+
+Value loaded(Debugger &dbg, TypeTable &types, const Node &n) {
+    auto v = evaluateNode(dbg, types, n);
+    loadValue(dbg, v);
+    return v;
+}
+
+Value evaluateBinary(const Node &n, const Value &a, const Value &b) {
+    const auto &op = n.token;
+    auto type = n.operand_type;
+
+    // pointer arithmetic, scaled by the pointee
+    if (n.type->kind == Type::Kind::pointer) {
+        bool a_ptr = a.type->kind == Type::Kind::pointer;
+        auto ptr = rawBits(a_ptr ? a : b), offset = rawBits(a_ptr ? b : a);
+        offset *= n.type->target->size;
+        return makeInteger(n.type, op == "+" ? ptr + offset : ptr - offset);
+    }
+    if (a.type->kind == Type::Kind::pointer && b.type->kind == Type::Kind::pointer && op == "-") {
+        auto size = std::max<uint64_t>(a.type->target->size, 1);
+        return makeInteger(n.type, (int64_t(rawBits(a)) - int64_t(rawBits(b))) / int64_t(size));
+    }
+
+    bool compare = op == "==" || op == "!=" || op == "<" || op == ">"
+                   || op == "<=" || op == ">=";
+    if (isFloating(type)) {
+        auto x = toFloating(a), y = toFloating(b);
+        if (op == "==") return makeInteger(n.type, x == y);
+        if (op == "!=") return makeInteger(n.type, x != y);
+        if (op == "<") return makeInteger(n.type, x < y);
+        if (op == ">") return makeInteger(n.type, x > y);
+        if (op == "<=") return makeInteger(n.type, x <= y);
+        if (op == ">=") return makeInteger(n.type, x >= y);
+        if (op == "+") return makeFloating(type, x + y);
+        if (op == "-") return makeFloating(type, x - y);
+        if (op == "*") return makeFloating(type, x * y);
+        return makeFloating(type, x / y);
+    }
+
+    // both converted to <type>, then computed on 64 bits
+    auto x = rawBits(convertScalar(a, type)), y = rawBits(convertScalar(b, type));
+    if (compare) {
+        bool less = type->is_signed ? int64_t(x) < int64_t(y) : x < y;
+        bool greater = type->is_signed ? int64_t(x) > int64_t(y) : x > y;
+        if (op == "==") return makeInteger(n.type, x == y);
+        if (op == "!=") return makeInteger(n.type, x != y);
+        if (op == "<") return makeInteger(n.type, less);
+        if (op == ">") return makeInteger(n.type, greater);
+        if (op == "<=") return makeInteger(n.type, !greater);
+        return makeInteger(n.type, !less);
+    }
+    if ((op == "/" || op == "%") && y == 0) throw ExpressionError("Division by zero");
+    // INT64_MIN / -1 traps: negating wraps the same way, the remainder is 0
+    bool minus_one = type->is_signed && int64_t(y) == -1;
+    uint64_t r;
+    if (op == "+") r = x + y;
+    else if (op == "-") r = x - y;
+    else if (op == "*") r = x * y;
+    else if (op == "/" && minus_one) r = 0 - x;
+    else if (op == "%" && minus_one) r = 0;
+    else if (op == "/") r = type->is_signed ? uint64_t(int64_t(x) / int64_t(y)) : x / y;
+    else if (op == "%") r = type->is_signed ? uint64_t(int64_t(x) % int64_t(y)) : x % y;
+    else if (op == "&") r = x & y;
+    else if (op == "|") r = x | y;
+    else if (op == "^") r = x ^ y;
+    else if (y >= 64) r = op == ">>" && type->is_signed && int64_t(x) < 0 ? ~uint64_t{0} : 0;
+    else if (op == "<<") r = x << y;
+    else r = type->is_signed ? uint64_t(int64_t(x) >> y) : x >> y;
+    return makeInteger(n.type, r);
+}
+
+Value evaluateNode(Debugger &dbg, TypeTable &types, const Node &n) {
+    switch (n.op) {
+    case Node::Op::constant:
+        return n.constant;
+    case Node::Op::variable:
+        return readVariable(dbg, n);
+    case Node::Op::function: {
+        Value v {n.type};
+        v.lvalue = true;
+        v.address = dbg.offsetDwarfAddress(n.address);
+        return v;
+    }
+    case Node::Op::member: {
+        auto base = evaluateNode(dbg, types, *n.operands[0]);
+        Value v {n.type};
+        if (base.lvalue) {
+            v.lvalue = true;
+            v.address = base.address + n.offset;
+        } else {
+            auto begin = base.bytes.begin() + std::min<size_t>(n.offset, base.bytes.size());
+            v.bytes.assign(begin, begin + std::min<size_t>(n.type->size, base.bytes.end() - begin));
+            v.bytes.resize(n.type->size);
+        }
+        if (!n.member->bit_size) return v;
+
+        // bit-field: read the bytes holding it, then shift & mask
+        uint64_t bits = 0;
+        auto len = std::min<size_t>((n.member->bit_offset + n.member->bit_size + 7) / 8, sizeof(bits));
+        if (v.lvalue) {
+            if (!dbg.readMemoryBlock(v.address, &bits, len))
+                throw ExpressionError("Cannot access memory of bit-field");
+        } else {
+            std::memcpy(&bits, v.bytes.data(), std::min(len, v.bytes.size()));
+        }
+        bits >>= n.member->bit_offset;
+        if (n.member->bit_size < 64) {
+            bits &= (uint64_t{1} << n.member->bit_size) - 1;
+            if (n.type->is_signed && (bits >> (n.member->bit_size - 1)) & 1)
+                bits |= ~uint64_t{0} << n.member->bit_size;
+        }
+        return makeInteger(n.type, bits);
+    }
+    case Node::Op::deref: {
+        auto ptr = loaded(dbg, types, *n.operands[0]);
+        Value v {n.type};
+        v.lvalue = true;
+        v.address = rawBits(ptr);
+        return v;
+    }
+    case Node::Op::address_of:
+    case Node::Op::decay: {
+        auto v = evaluateNode(dbg, types, *n.operands[0]);
+        if (!v.lvalue) throw ExpressionError("Can't take the address of a value in a register");
+        return makeInteger(n.type, v.address);
+    }
+    case Node::Op::repeat: {
+        auto first = evaluateNode(dbg, types, *n.operands[0]);
+        auto count = rawBits(loaded(dbg, types, *n.operands[1]));
+        if (!first.lvalue) throw ExpressionError("Only values in memory can be extended with '@'");
+        if (int64_t(count) <= 0) throw ExpressionError("Count of '@' must be positive");
+        if (first.type->size && count > UINT64_MAX / first.type->size)
+            throw ExpressionError("Count of '@' is too large");
+        // not interned in <types>: every count would stay there for good
+        auto array = std::make_shared<Type>();
+        array->kind = Type::Kind::array;
+        array->size = first.type->size * count;
+        array->target = first.type;
+        array->count = count;
+        Value v {array.get()};
+        v.temporary = std::move(array);
+        v.lvalue = true;
+        v.address = first.address;
+        return v;
+    }
+    case Node::Op::cast:
+        return convertScalar(loaded(dbg, types, *n.operands[0]), n.type);
+    case Node::Op::unary: {
+        auto v = loaded(dbg, types, *n.operands[0]);
+        if (n.token == "!") return makeInteger(n.type, !isTrue(v));
+        if (isFloating(n.type))
+            return makeFloating(n.type, n.token == "-" ? -toFloating(v) : toFloating(v));
+        auto bits = rawBits(convertScalar(v, n.type));
+        return makeInteger(n.type, n.token == "-" ? -bits : n.token == "~" ? ~bits : bits);
+    }
+    case Node::Op::binary:
+        return evaluateBinary(n, loaded(dbg, types, *n.operands[0]),
+                              loaded(dbg, types, *n.operands[1]));
+    case Node::Op::logical_and:
+    case Node::Op::logical_or: {
+        bool lhs = isTrue(loaded(dbg, types, *n.operands[0]));
+        if (lhs != (n.op == Node::Op::logical_and)) return makeInteger(n.type, lhs);
+        return makeInteger(n.type, isTrue(loaded(dbg, types, *n.operands[1])));
+    }
+    }
+    throw ExpressionError("Invalid expression");
+}
+
+// ---- Formatting ---------------------------------------------------------
+
+// Elements of an array printed at most
+constexpr uint64_t max_printed_elements = 200;
+
+std::string escapeChar(int c, char quote) {
+    switch (c) {
+    case '\n': return "\\n";
+    case '\t': return "\\t";
+    case '\r': return "\\r";
+    case '\\': return "\\\\";
+    default: break;
+    }
+    if (c == quote) return std::string("\\") + quote;
+    if (isprint(c)) return std::string(1, char(c));
+    char buf[8];
+    snprintf(buf, sizeof(buf), "\\%03o", c & 0xff);
+    return buf;
+}
+
+// "text" from <len> bytes at <data>, up to the first NUL
+std::string quoted(const uint8_t *data, size_t len) {
+    std::string s = "\"";
+    for (size_t i = 0; i < len && data[i]; ++i) s += escapeChar(data[i], '"');
+    return s + "\"";
+}
+
+// <bytes> holds printedSize(type) bytes
+void format(Debugger &dbg, const Type &type, const uint8_t *bytes, std::ostream &out) {
+    Value v {&type};
+    if (type.kind != Type::Kind::array) v.bytes.assign(bytes, bytes + type.size);
+
+    switch (type.kind) {
+    case Type::Kind::void_:
+        out << "void";
+        break;
+    case Type::Kind::boolean:
+        out << (isTrue(v) ? "true" : "false");
+        break;
+    case Type::Kind::integer: {
+        auto bits = rawBits(v);
+        if (type.is_signed) out << std::dec << int64_t(bits);
+        else out << std::dec << bits;
+        if (type.is_char && type.size == 1) out << " '" << escapeChar(bits & 0xff, '\'') << "'";
+        break;
+    }
+    case Type::Kind::floating: {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*Lg", type.size == sizeof(float) ? 9 : 17, toFloating(v));
+        out << buf;
+        break;
+    }
+    case Type::Kind::enumeration: {
+        auto bits = int64_t(rawBits(v));
+        auto e = std::find_if(type.enumerators.begin(), type.enumerators.end(),
+                              [bits](const std::pair<std::string, int64_t> &e) {
+                                  return e.second == bits;
+                              });
+        if (e != type.enumerators.end()) out << e->first;
+        else out << std::dec << bits;
+        break;
+    }
+    case Type::Kind::pointer:
+    case Type::Kind::reference: {
+        auto address = rawBits(v);
+        out << (type.kind == Type::Kind::reference ? "@0x" : "0x") << std::hex << address << std::dec;
+        if (type.target->is_char && type.target->size == 1 && address) {
+            uint8_t text[max_printed_elements];
+            auto n = dbg.readMemoryChunk(address, text, sizeof(text));
+            if (n) out << " " << quoted(text, n);
+        }
+        break;
+    }
+    case Type::Kind::array: {
+        auto element = type.target;
+        if (element->is_char && element->size == 1) {
+            auto len = std::min(type.size, max_printed_elements);
+            out << quoted(bytes, len);
+            if (len < type.size && std::find(bytes, bytes + len, 0) == bytes + len) out << "...";
+            break;
+        }
+        out << "{";
+        auto n = std::min(type.count, max_printed_elements);
+        for (uint64_t i = 0; i < n; ++i) {
+            if (i) out << ", ";
+            format(dbg, *element, bytes + i * element->size, out);
+        }
+        if (type.count > n) out << "...";
+        out << "}";
+        break;
+    }
+    case Type::Kind::structure: {
+        out << "{";
+        bool first = true;
+        for (const auto &m : type.members) {
+            if (!first) out << ", ";
+            first = false;
+            if (m.base_class) out << "<" << m.name << "> = ";
+            else if (!m.name.empty()) out << m.name << " = ";
+            if (m.bit_size && m.offset < type.size) {
+                uint64_t bits = 0;
+                auto len = std::min<size_t>({(m.bit_offset + m.bit_size + 7) / 8,
+                                             sizeof(bits), type.size - m.offset});
+                std::memcpy(&bits, bytes + m.offset, len);
+                bits >>= m.bit_offset;
+                if (m.bit_size < 64) bits &= (uint64_t{1} << m.bit_size) - 1;
+                if (m.type->is_signed && m.bit_size < 64 && (bits >> (m.bit_size - 1)) & 1)
+                    bits |= ~uint64_t{0} << m.bit_size;
+                auto field = makeInteger(m.type, bits);
+                format(dbg, *m.type, field.bytes.data(), out);
+            } else if (m.offset + m.type->size > type.size) {
+                out << "<invalid>";
+            } else {
+                format(dbg, *m.type, bytes + m.offset, out);
+            }
+        }
+        out << "}";
+        break;
+    }
+    case Type::Kind::function:
+        out << "{" << typeName(type) << "}";
+        break;
+    }
+}
+
+} // namespace
+
+Expression::Expression(const std::string &text, std::shared_ptr<ProgramIndex> program,
+                       uint64_t pc)
+    : text_{text}, program_{std::move(program)} {
+    ScopedTimer timer {stats().lookup("expression")};
+
+    scope_ = program_->scopes.innermost(pc);
+    root_ = Compiler{tokenize(text), *program_, scope_}.compile();
+}
+
+Expression::~Expression() = default;
+
+const Type *Expression::type() const {
+    return root_->type;
+}
+
+bool Expression::validAt(uint64_t pc) const {
+    return program_->scopes.innermost(pc) == scope_;
+}
+
+Value Expression::evaluate(Debugger &dbg) const {
+    return evaluateNode(dbg, program_->types, *root_);
+}
+
+uint64_t printedSize(const Type &type) {
+    if (type.kind != Type::Kind::array) return type.size;
+    return std::min(type.count, max_printed_elements) * type.target->size;
+}
+
+void loadValue(Debugger &dbg, Value &v) {
+    if (v.loaded()) return;
+    v.bytes.resize(printedSize(*v.type));
+    if (!dbg.readMemoryBlock(v.address, v.bytes.data(), v.bytes.size())) {
+        std::ostringstream msg;
+        msg << "Cannot access memory at address 0x" << std::hex << v.address;
+        throw ExpressionError(msg.str());
+    }
+}
+
+std::string formatValue(Debugger &dbg, Value v) {
+    std::ostringstream out;
+    if (v.type->kind == Type::Kind::function) {
+        out << "{" << typeName(*v.type) << "} 0x" << std::hex << v.address;
+        return out.str();
+    }
+    loadValue(dbg, v);
+    format(dbg, *v.type, v.bytes.data(), out);
+    return out.str();
+}
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include <elf.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+
+#include "fp-registers.hh"
+#include "stats.hh"
+
+namespace {
+
+std::vector<FpRegDescriptor> makeDescriptors() {
+    std::vector<FpRegDescriptor> out;
+    for (unsigned i = 0; i < 16; ++i)
+        out.push_back({FpReg::xmm, i, static_cast<int>(17 + i), "xmm" + std::to_string(i)});
+    for (unsigned i = 0; i < 16; ++i)
+        out.push_back({FpReg::ymm, i, -1, "ymm" + std::to_string(i)});
+    for (unsigned i = 0; i < 8; ++i)
+        out.push_back({FpReg::st, i, static_cast<int>(33 + i), "st" + std::to_string(i)});
+    out.push_back({FpReg::mxcsr, 0, 64, "mxcsr"});
+    out.push_back({FpReg::fcw, 0, 65, "fcw"});
+    out.push_back({FpReg::fsw, 0, 66, "fsw"});
+    out.push_back({FpReg::ftw, 0, -1, "ftw"});
+    return out;
+}
+
+// xmm<n> lives in fx.xmm_space, 4 words each
+const uint8_t *xmmBytes(const FpRegisters &regs, unsigned n) {
+    return reinterpret_cast<const uint8_t *>(regs.fx.xmm_space) + 16 * n;
+}
+
+// st<n> in fx.st_space, 16-byte slots holding 80-bit values
+const uint8_t *stBytes(const FpRegisters &regs, unsigned n) {
+    return reinterpret_cast<const uint8_t *>(regs.fx.st_space) + 16 * n;
+}
+
+template <typename T>
+void printLanes(std::ostream &os, const char *label, const uint8_t *bytes, std::size_t size) {
+    os << " {" << label << ":";
+    for (std::size_t i = 0; i < size; i += sizeof(T)) {
+        T lane;
+        std::memcpy(&lane, bytes + i, sizeof(T));
+        os << (i ? ", " : " ") << lane;
+    }
+    os << "}";
+}
+
+} // namespace
+
+const std::vector<FpRegDescriptor> &fpRegisterDescriptors() {
+    static const auto descriptors = makeDescriptors();
+    return descriptors;
+}
+
+const FpRegDescriptor *findFpRegister(const std::string &name) {
+    auto &descriptors = fpRegisterDescriptors();
+    auto it = std::find_if(descriptors.begin(), descriptors.end(),
+                           [&name](auto &&rd) { return rd.name == name; });
+    return it == descriptors.end() ? nullptr : &*it;
+}
+
+const FpRegDescriptor *findFpDwarfRegister(unsigned regnum) {
+    auto &descriptors = fpRegisterDescriptors();
+    auto it = std::find_if(descriptors.begin(), descriptors.end(),
+                           [regnum](auto &&rd) { return rd.dwarf_r == static_cast<int>(regnum); });
+    return it == descriptors.end() ? nullptr : &*it;
+}
+
+uint64_t getFpRegisterValue(const FpRegisters &regs, const FpRegDescriptor &rd) {
+    uint64_t value = 0;
+    switch (rd.kind) {
+        case FpReg::xmm:
+        case FpReg::ymm:   std::memcpy(&value, xmmBytes(regs, rd.index), 8); break;
+        case FpReg::st:    std::memcpy(&value, stBytes(regs, rd.index), 8); break;
+        case FpReg::mxcsr: value = regs.fx.mxcsr; break;
+        case FpReg::fcw:   value = regs.fx.cwd; break;
+        case FpReg::fsw:   value = regs.fx.swd; break;
+        case FpReg::ftw:   value = regs.fx.ftw; break;
+    }
+    return value;
+}
+
+std::string formatFpRegister(const FpRegisters &regs, const FpRegDescriptor &rd) {
+    std::ostringstream os;
+    switch (rd.kind) {
+        case FpReg::xmm:
+        case FpReg::ymm: {
+            uint8_t bytes[32] = {};
+            std::memcpy(bytes, xmmBytes(regs, rd.index), 16);
+            std::size_t size = 16;
+            if (rd.kind == FpReg::ymm) {
+                std::memcpy(bytes + 16, regs.ymm_hi[rd.index], 16);
+                size = 32;
+            }
+            os << "0x";
+            for (std::size_t i = size; i-- > 0;)
+                os << std::hex << std::setfill('0') << std::setw(2) << unsigned{bytes[i]};
+            os << std::dec << std::setfill(' ');
+            printLanes<float>(os, "f32", bytes, size);
+            printLanes<double>(os, "f64", bytes, size);
+            break;
+        }
+        case FpReg::st: {
+            long double value;
+            std::memcpy(&value, stBytes(regs, rd.index), 10);
+            os << value;
+            break;
+        }
+        default:
+            os << "0x" << std::hex << getFpRegisterValue(regs, rd);
+            break;
+    }
+    return os.str();
+}
+
+void fpRegistersFromXsave(const uint8_t *xsave, std::size_t size, FpRegisters *out) {
+    *out = FpRegisters{};
+    std::memcpy(&out->fx, xsave, std::min(size, sizeof(out->fx)));
+
+    // XSTATE_BV bit 2: AVX state saved; clear means the init state (zero)
+    uint64_t xstate_bv = 0;
+    if (size >= xsave_header_offset + 8)
+        std::memcpy(&xstate_bv, xsave + xsave_header_offset, 8);
+    if (size >= xsave_avx_offset + xsave_avx_size) {
+        out->has_avx = true;
+        if (xstate_bv & 4) std::memcpy(out->ymm_hi, xsave + xsave_avx_offset, xsave_avx_size);
+    }
+}
+
+bool readFpRegisters(pid_t pid, FpRegisters *out) {
+    // the kernel copies no more than asked for: the AVX-512/AMX
+    // components past ymm are never transferred
+    alignas(64) uint8_t xsave[xsave_avx_offset + xsave_avx_size];
+    iovec iov {xsave, sizeof(xsave)};
+    if (countedPtrace(PTRACE_GETREGSET, pid, NT_X86_XSTATE, &iov) == 0) {
+        fpRegistersFromXsave(xsave, iov.iov_len, out);
+        return true;
+    }
+
+    *out = FpRegisters{};
+    iov = {&out->fx, sizeof(out->fx)};
+    return countedPtrace(PTRACE_GETREGSET, pid, NT_PRFPREG, &iov) == 0;
+}
@@ -8,6 +8,7 @@
 #include <inttypes.h>
 
 #include "helper.hh"
+#include "stats.hh"
 
 std::vector<std::string> split(const std::string &s, char delimiter) {
     std::vector<std::string> out{};
@@ -79,8 +80,11 @@ Reg getRegisterFromName(const std::string &name) {
 
 uint64_t getRegisterValue(pid_t pid, Reg r) {
     user_regs_struct regs;
-    ptrace(PTRACE_GETREGS, pid, nullptr, &regs); // regs --- object that contains
+    countedPtrace(PTRACE_GETREGS, pid, nullptr, &regs); // regs --- object that contains
+    return getRegisterValue(regs, r);
+}
 
+uint64_t getRegisterValue(const user_regs_struct &regs, Reg r) {
     auto it = std::find_if(begin(g_register_descriptors), 
                            end(g_register_descriptors),
                            [r](auto &&rd) { return r == rd.r; });
@@ -89,12 +93,12 @@ uint64_t getRegisterValue(pid_t pid, Reg r) {
         throw std::out_of_range{"Unknown register"};
     }
 
-    return *(reinterpret_cast<uint64_t*>(&regs) + (it - begin(g_register_descriptors)));
+    return *(reinterpret_cast<const uint64_t*>(&regs) + (it - begin(g_register_descriptors)));
 }
 
 void setRegisterValue(pid_t pid, Reg r, uint64_t value) {
     user_regs_struct regs;
-    ptrace(PTRACE_GETREGS, pid, nullptr, &regs); // regs --- object that contains
+    countedPtrace(PTRACE_GETREGS, pid, nullptr, &regs); // regs --- object that contains
                                                  // general purpose registers (see user.h) 
     auto it = std::find_if(begin(g_register_descriptors), 
                            end(g_register_descriptors),
@@ -105,11 +109,10 @@ void setRegisterValue(pid_t pid, Reg r, uint64_t value) {
     }
 
     *(reinterpret_cast<uint64_t*>(&regs) + (it - begin(g_register_descriptors))) = value;
-    ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
+    countedPtrace(PTRACE_SETREGS, pid, nullptr, &regs);
 }
 
-// 
-uint64_t getRegisterValueFromDwarfRegister (pid_t pid, unsigned regnum) {
+Reg getRegisterFromDwarfRegister(unsigned regnum) {
     auto it = std::find_if(begin(g_register_descriptors), 
                            end(g_register_descriptors),
                            [regnum](auto &&rd) { return regnum == rd.dwarf_r; });
@@ -118,7 +121,11 @@ uint64_t getRegisterValueFromDwarfRegister (pid_t pid, unsigned regnum) {
         throw std::out_of_range{"Unknown dwarf register"};
     }
 
-    return getRegisterValue(pid, it->r);
+    return it->r;
+}
+
+uint64_t getRegisterValueFromDwarfRegister (pid_t pid, unsigned regnum) {
+    return getRegisterValue(pid, getRegisterFromDwarfRegister(regnum));
 }
 
 bool find_pc(const dwarf::die &d, dwarf::taddr pc, std::vector<dwarf::die> *stack) {
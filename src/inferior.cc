@@ -0,0 +1,84 @@
+#include <map>
+#include <stdexcept>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "debug-info.hh"
+#include "inferior.hh"
+#include "stats.hh"
+
+namespace {
+
+void loadSymbols(const elf::elf &f,
+                 std::unordered_map<std::string, std::vector<Symbol>> *symbols) {
+    auto isSymbolTable = [](const elf::section &sec) {
+        return sec.get_hdr().type == elf::sht::symtab ||
+               sec.get_hdr().type == elf::sht::dynsym;
+    };
+
+    for (auto &sec : f.sections()) {
+        if (!isSymbolTable(sec)) continue;
+
+        for (auto sym : sec.as_symtab()) {
+            auto &data = sym.get_data();
+            Symbol my_sym{toSymbolType(data.type()),
+                          sym.get_name(),
+                          data.value};
+            (*symbols)[sym.get_name()].push_back(my_sym);
+        }
+    }
+}
+
+// Names the on-disk cache of <f>'s decompressed sections: its build-id,
+// else the identity of the file at <path>
+std::string sectionCacheKey(const elf::elf &f, const std::string &path) {
+    auto id = buildId(f);
+    if (!id.empty()) return id;
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) return "";
+    return "file-" + std::to_string(st.st_dev) + "-" + std::to_string(st.st_ino) + "-"
+           + std::to_string(st.st_size) + "-" + std::to_string(st.st_mtim.tv_sec);
+}
+
+} // namespace
+
+ProgramIndex::ProgramIndex(const std::string &path) : path{path} {
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Can't open " + path);
+    elf = elf::elf(elf::create_mmap_loader(fd));
+
+    // stripped release builds keep their DWARF in a separate file
+    auto debug_elf = elf;
+    debug_path = findSeparateDebugFile(elf, path);
+    if (!debug_path.empty()) {
+        auto debug_fd = open(debug_path.c_str(), O_RDONLY);
+        if (debug_fd < 0) throw std::runtime_error("Can't open " + debug_path);
+        debug_elf = elf::elf(elf::create_mmap_loader(debug_fd));
+    }
+    auto key = sectionCacheKey(debug_elf, debug_path.empty() ? path : debug_path);
+    dwarf = dwarf::dwarf(std::make_shared<DebugSectionLoader>(debug_elf, key));
+
+    loadSymbols(elf, &symbols);
+    // full .symtab of a stripped executable
+    if (!debug_path.empty()) loadSymbols(debug_elf, &symbols);
+}
+
+std::shared_ptr<ProgramIndex> loadProgramIndex(const std::string &path) {
+    using FileKey = std::tuple<dev_t, ino_t, off_t, time_t, long>;
+    // weak: an index lives as long as some inferior uses it
+    static std::map<FileKey, std::weak_ptr<ProgramIndex>> cache;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) throw std::runtime_error("Can't stat " + path);
+    FileKey key {st.st_dev, st.st_ino, st.st_size,
+                 st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+
+    if (auto cached = cache[key].lock()) return cached;
+
+    ScopedTimer timer {stats().lookup("index")};
+    auto index = std::make_shared<ProgramIndex>(path);
+    cache[key] = index;
+    return index;
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <tuple>
+
+#include "cwalk.h"
+#include "line-index.hh"
+#include "stats.hh"
+
+namespace {
+
+std::string normalize(const std::string &path) {
+    std::string out(path.size() + 1, '\0');
+    auto n = cwk_path_normalize(path.c_str(), &out[0], out.size());
+    if (n >= out.size()) return path;
+    out.resize(n);
+    return out;
+}
+
+std::string basename(const std::string &path) {
+    auto slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+void LineIndex::build() {
+    built_ = true;
+    ScopedTimer timer {stats().lookup("line-index")};
+
+    // raw path as libelfin joins it -> id, to normalize each one once
+    std::unordered_map<std::string, uint32_t> raw_ids;
+    auto fileId = [&](const std::string &raw) {
+        auto it = raw_ids.find(raw);
+        if (it != raw_ids.end()) return it->second;
+        auto path = normalize(raw);
+        auto id = file_ids_.emplace(path, files_.size()).first->second;
+        if (id == files_.size()) {
+            files_.push_back(path);
+            by_basename_.emplace(basename(path), id);
+        }
+        raw_ids.emplace(raw, id);
+        return id;
+    };
+
+    for (const auto &cu : dw_.compilation_units()) {
+        if (!cu.root().has(dwarf::DW_AT::stmt_list)) continue;
+        // only where a run of the line's statements begins: the rows
+        // after it in the same sequence would stop again mid-line
+        const dwarf::line_table::file *prev_file = nullptr;
+        unsigned prev_line = 0;
+        for (const auto &entry : cu.get_line_table()) {
+            if (entry.end_sequence) {
+                prev_file = nullptr;
+                continue;
+            }
+            if (!entry.is_stmt || !entry.line) continue;
+            if (entry.file != prev_file || entry.line != prev_line)
+                rows_.push_back({fileId(entry.file->path), entry.line, entry.address});
+            prev_file = entry.file;
+            prev_line = entry.line;
+        }
+    }
+
+    std::sort(rows_.begin(), rows_.end(), [](const Row &a, const Row &b) {
+        return std::tie(a.file, a.line, a.address) < std::tie(b.file, b.line, b.address);
+    });
+    rows_.erase(std::unique(rows_.begin(), rows_.end(), [](const Row &a, const Row &b) {
+        return a.file == b.file && a.line == b.line && a.address == b.address;
+    }), rows_.end());
+}
+
+std::vector<std::string> LineIndex::matchFiles(const std::string &spec) {
+    if (!built_) build();
+
+    std::vector<std::string> matches;
+    auto range = by_basename_.equal_range(basename(spec));
+    for (auto it = range.first; it != range.second; ++it) {
+        const auto &path = files_[it->second];
+        if (path == spec || (path.size() > spec.size()
+                && path.compare(path.size() - spec.size(), spec.size(), spec) == 0
+                && path[path.size() - spec.size() - 1] == '/'))
+            matches.push_back(path);
+    }
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
+
+const std::vector<std::string> &LineIndex::files() {
+    if (!built_) build();
+    return files_;
+}
+
+std::vector<uint64_t> LineIndex::addresses(const std::string &path, unsigned line, unsigned *actual) {
+    if (!built_) build();
+
+    auto id = file_ids_.find(path);
+    if (id == file_ids_.end()) return {};
+    auto it = std::lower_bound(rows_.begin(), rows_.end(), Row{id->second, line, 0},
+                               [](const Row &a, const Row &b) {
+        return std::tie(a.file, a.line, a.address) < std::tie(b.file, b.line, b.address);
+    });
+    if (it == rows_.end() || it->file != id->second) return {};
+
+    *actual = it->line;
+    std::vector<uint64_t> result;
+    for (; it != rows_.end() && it->file == id->second && it->line == *actual; ++it)
+        result.push_back(it->address);
+    return result;
+}
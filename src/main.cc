@@ -1,27 +1,27 @@
+#include <cstdio>
 #include <iostream>
 #include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <sys/types.h>
 #include <sys/ptrace.h>
 #include <sys/personality.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <sys/user.h>
 
 #include <linenoise.h>
 
+#include "coverage.hh"
 #include "debugger.hh"
+#include "rsp-server.hh"
+#include "syscall-catch.hh"
 
-//TODO --- add floating point & vector registers in the future
-
-
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        std::cerr << "Program name not specified\n";
-        return -1;
-    }
-    //TODO handle program errors, if it doesn't exist
-    auto prog = argv[1];
-
+// Fork & exec <prog> stopped under ptrace, with the seccomp <filter> of
+// the syscall catchpoints if any. Return its pid in the parent
+static pid_t startDebuggee(const char *prog, const std::vector<sock_filter> &filter = {}) {
     auto pid = fork();
     if (pid < 0) {
         std::cerr << "Forking failed!" << std::endl;
@@ -34,12 +34,117 @@ int main(int argc, char **argv) {
         ptrace(PTRACE_TRACEME, 0, nullptr, nullptr); // I allow
                                                      // parent process
                                                      // to trace me 
+        if (!filter.empty() && !installSyscallFilter(filter)) {
+            perror("Installing the syscall filter failed");
+            _exit(1);
+        }
         execl(prog, prog, nullptr); // execute prog
     }
-    else if (pid >= 1) {
-        // parent process --> debugger
+    return pid;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Program name not specified\n";
+        return -1;
+    }
+    //TODO handle program errors, if it doesn't exist
+    auto prog = argv[1];
+
+    // mdb <prog> --core <core file>: post-mortem, nothing is run
+    if (argc >= 4 && std::string{argv[2]} == "--core") {
+        std::unique_ptr<CoreFile> core;
+        try {
+            core = std::make_unique<CoreFile>(argv[3]);
+        } catch (std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+        Debugger dbg{prog, std::move(core)};
+        dbg.run();
+        return 0;
+    }
+
+    // mdb <prog> --coverage <lcov file> [<CU name part>]...: run <prog>
+    // to the end, recording which lines of the (matching) CUs executed
+    if (argc >= 4 && std::string{argv[2]} == "--coverage") {
+        auto pid = startDebuggee(prog);
+        Debugger dbg{prog, pid};
+        dbg.startInferior();
+        CoverageRun coverage{dbg};
+        auto sites = coverage.plant({argv + 4, argv + argc});
+        std::cout << "Covering " << sites << " addresses of process " << pid << std::endl;
+        auto code = coverage.run();
+        auto counts = coverage.lineCounts();
+        if (!coverage.writeLcov(argv[3])) {
+            std::cerr << "Can't write " << argv[3] << std::endl;
+            return -1;
+        }
+        std::cout << "Executed " << counts.second << " of " << counts.first
+                  << " lines, written to " << argv[3] << std::endl;
+        return code;
+    }
+
+    // mdb <prog> --server <[host:]port|->: run <prog> for a client
+    // speaking GDB's remote protocol, over TCP or stdin & stdout
+    if (argc >= 4 && std::string{argv[2]} == "--server") {
+        int in_fd, out_fd;
+        try {
+            rspListen(argv[3], &in_fd, &out_fd);
+        } catch (std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+        RspConnection conn{in_fd, out_fd};
+        auto pid = startDebuggee(prog);
         std::cout << "Started debugging process " << pid << std::endl;
         Debugger dbg{prog, pid};
+        dbg.startInferior();
+        RspServer{dbg, conn}.serve();
+        return 0;
+    }
+
+    // mdb <prog> --remote <host:port|"|command">: debug <prog> running
+    // under `mdb --server` elsewhere, with the local copy's debug info
+    if (argc >= 4 && std::string{argv[2]} == "--remote") {
+        std::unique_ptr<RemoteTarget> remote;
+        try {
+            remote = std::make_unique<RemoteTarget>(rspConnect(argv[3]));
+        } catch (std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+        Debugger dbg{prog, std::move(remote)};
         dbg.run();
+        return 0;
     }
+
+    // mdb <prog> [--catch-syscall "<name|nr> [if argN==X]"]...: the
+    // filter goes in before exec, so even the startup code is caught
+    std::vector<SyscallCatchpoint> catchpoints;
+    for (int i = 2; i < argc; i += 2) {
+        SyscallCatchpoint cp;
+        cp.id = catchpoints.size() + 1;
+        if (std::string{argv[i]} != "--catch-syscall" || i + 1 == argc
+                || !parseSyscallCatchpoint(split(argv[i + 1], ' '), &cp)) {
+            std::cerr << "Usage: mdb <prog> [--catch-syscall \"<name|nr> [if argN==X]\"]..."
+                      << std::endl;
+            return -1;
+        }
+        // it would stop before ptrace options are set, failing with ENOSYS
+        if (cp.nr == SYS_execve || cp.nr == SYS_execveat) {
+            std::cerr << "exec calls can be caught with `catch syscall` once started"
+                      << std::endl;
+            return -1;
+        }
+        catchpoints.push_back(cp);
+    }
+
+    auto pid = startDebuggee(prog, catchpoints.empty() ? std::vector<sock_filter>{}
+                                                       : buildSyscallFilter(catchpoints));
+    // parent process --> debugger
+    std::cout << "Started debugging process " << pid << std::endl;
+    Debugger dbg{prog, pid};
+    dbg.addSyscallCatchpoints(catchpoints);
+    dbg.run();
 }
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "memory-scan.hh"
+
+std::vector<MemoryRegion> readProcMaps(pid_t pid) {
+    std::vector<MemoryRegion> regions;
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+
+    // start-end perms offset dev inode [path]
+    std::string line;
+    while (std::getline(maps, line)) {
+        std::istringstream ss{line};
+        std::string range, perms, offset, dev, inode, path;
+        ss >> range >> perms >> offset >> dev >> inode;
+        std::getline(ss >> std::ws, path);
+
+        auto dash = range.find('-');
+        if (dash == std::string::npos) continue;
+        MemoryRegion region;
+        region.start = std::stoull(range.substr(0, dash), nullptr, 16);
+        region.end = std::stoull(range.substr(dash + 1), nullptr, 16);
+        // [vvar] faults on access by another process
+        region.readable = !perms.empty() && perms[0] == 'r' && path != "[vvar]";
+        region.path = path;
+        regions.push_back(region);
+    }
+    return regions;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> readableRanges(
+        const std::vector<MemoryRegion> &regions, uint64_t start, uint64_t end) {
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (const auto &r : regions) {
+        if (!r.readable) continue;
+        auto begin = std::max(r.start, start), finish = std::min(r.end, end);
+        if (begin >= finish) continue;
+        if (!ranges.empty() && ranges.back().second == begin) ranges.back().second = finish;
+        else ranges.emplace_back(begin, finish);
+    }
+    return ranges;
+}
+
+std::vector<LoadedLibrary> mappedLibraries(const std::vector<MemoryRegion> &regions) {
+    std::vector<LoadedLibrary> libraries;
+    for (const auto &r : regions) {
+        if (r.path.empty() || r.path[0] != '/') continue;
+        auto known = std::find_if(libraries.begin(), libraries.end(),
+                                  [&r](const LoadedLibrary &l) { return l.path == r.path; });
+        if (known == libraries.end()) libraries.push_back({r.path, r.start});
+        else known->base = std::min(known->base, r.start);
+    }
+    return libraries;
+}
+
+bool parsePattern(const std::string &text, std::vector<uint8_t> *out) {
+    out->clear();
+    if (text.size() >= 2 && (text.front() == '"' || text.front() == '\'')
+            && text.back() == text.front()) {
+        out->assign(text.begin() + 1, text.end() - 1);
+        return !out->empty();
+    }
+
+    auto hexBytes = [out](const std::string &digits) {
+        if (digits.empty() || digits.size() % 2) return false;
+        for (std::size_t i = 0; i < digits.size(); i += 2) {
+            if (!isxdigit(digits[i]) || !isxdigit(digits[i + 1])) return false;
+            out->push_back(std::stoul(digits.substr(i, 2), nullptr, 16));
+        }
+        return true;
+    };
+    if (text.compare(0, 4, "hex:") == 0) return hexBytes(text.substr(4));
+
+    if (text.size() > 2 && text.compare(0, 2, "0x") == 0 && text.size() <= 18) {
+        auto digits = text.substr(2);
+        if (!std::all_of(digits.begin(), digits.end(), ::isxdigit)) return false;
+        std::size_t width = 1;
+        while (width * 2 < digits.size()) width *= 2;
+        auto value = std::stoull(digits, nullptr, 16);
+        for (std::size_t i = 0; i < width; ++i) out->push_back(value >> (8 * i));
+        return true;
+    }
+    return false;
+}
+
+// memchr (vectorized in glibc) skips to candidates for the first byte,
+// memcmp checks the rest
+bool scanBuffer(const uint8_t *data, std::size_t size, const std::vector<uint8_t> &pattern,
+                const std::function<bool(std::size_t)> &found) {
+    if (pattern.empty() || size < pattern.size()) return true;
+    auto last = data + size - pattern.size();
+    for (auto p = data; p <= last; ++p) {
+        p = static_cast<const uint8_t *>(std::memchr(p, pattern[0], last - p + 1));
+        if (!p) break;
+        if (std::memcmp(p + 1, pattern.data() + 1, pattern.size() - 1) == 0
+                && !found(p - data)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,174 @@
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf-counters.hh"
+
+namespace {
+
+struct PerfEvent {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+const PerfEvent perf_events[] = {
+    {"cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {"cache-misses",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branches",         PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {"branch-misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"task-clock",       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"page-faults",      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"cpu-migrations",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+};
+
+const PerfEvent *findEvent(const std::string &name) {
+    for (const auto &e : perf_events)
+        if (name == e.name) return &e;
+    return nullptr;
+}
+
+std::vector<pid_t> threadsOf(pid_t pid) {
+    std::vector<pid_t> threads;
+    auto dir = opendir(("/proc/" + std::to_string(pid) + "/task").c_str());
+    if (!dir) return {pid};
+    while (auto entry = readdir(dir))
+        if (entry->d_name[0] != '.') threads.push_back(std::stoi(entry->d_name));
+    closedir(dir);
+    return threads;
+}
+
+// Value of counter <fd>, scaled up if it was multiplexed with others
+uint64_t readScaled(int fd) {
+    uint64_t data[3];   // value, time enabled, time running
+    if (read(fd, data, sizeof(data)) != sizeof(data) || !data[2]) return 0;
+    if (data[2] == data[1]) return data[0];
+    return static_cast<uint64_t>(static_cast<long double>(data[0]) * data[1] / data[2]);
+}
+
+} // namespace
+
+PerfCounters::PerfCounters(pid_t pid, const std::vector<std::string> &events) : pid_{pid} {
+    auto threads = threadsOf(pid);
+    bool hardware_missing = false;
+    for (const auto &name : events) {
+        auto event = findEvent(name);
+        if (!event) {
+            std::cerr << "Unknown event " << name << " (" << perfEventNames() << ")" << std::endl;
+            continue;
+        }
+        if (addCounter(name, threads)) continue;
+        std::cerr << "Can't count " << name << ": " << strerror(errno) << std::endl;
+        hardware_missing |= event->type == PERF_TYPE_HARDWARE;
+    }
+
+    // no PMU (most VMs): software events still tell time & memory cost
+    if (hardware_missing) {
+        for (auto name : {"task-clock", "page-faults"}) {
+            bool counted = false;
+            for (const auto &c : counters_) counted |= c.name == name;
+            if (!counted && addCounter(name, threads))
+                std::cerr << "Counting " << name << " instead" << std::endl;
+        }
+    }
+    if (counters_.empty()) throw std::runtime_error("No event can be counted");
+    sample();
+    for (auto &c : counters_) c.interval = c.total = 0;
+    ran_ = false;
+}
+
+PerfCounters::~PerfCounters() {
+    for (const auto &c : counters_)
+        for (auto fd : c.fds) close(fd);
+}
+
+bool PerfCounters::addCounter(const std::string &name, const std::vector<pid_t> &threads) {
+    auto event = findEvent(name);
+    perf_event_attr attr {};
+    attr.size = sizeof(attr);
+    attr.type = event->type;
+    attr.config = event->config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1;           // summed in when a new thread or child exits
+    attr.exclude_kernel = 1;    // also what perf_event_paranoid allows
+    attr.exclude_hv = 1;
+
+    Counter counter {name, event->config == PERF_COUNT_SW_TASK_CLOCK
+                           && event->type == PERF_TYPE_SOFTWARE};
+    for (auto tid : threads) {
+        int fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) {
+            auto saved = errno;
+            for (auto f : counter.fds) close(f);
+            errno = saved;
+            return false;
+        }
+        counter.fds.push_back(fd);
+    }
+    counters_.push_back(std::move(counter));
+    return true;
+}
+
+std::vector<std::string> PerfCounters::events() const {
+    std::vector<std::string> names;
+    for (const auto &c : counters_) names.push_back(c.name);
+    return names;
+}
+
+void PerfCounters::sample() {
+    for (auto &c : counters_) {
+        uint64_t value = 0;
+        for (auto fd : c.fds) value += readScaled(fd);
+        if (value < c.last) value = c.last;     // a scaled estimate went back
+        c.interval += value - c.last;
+        c.total += value - c.last;
+        ran_ |= value != c.last;
+        c.last = value;
+    }
+}
+
+void PerfCounters::reportInterval(std::ostream &os) {
+    if (!ran_) return;
+    print(os, true);
+    for (auto &c : counters_) c.interval = 0;
+    ran_ = false;
+}
+
+void PerfCounters::reportTotals(std::ostream &os) const {
+    print(os, false);
+}
+
+void PerfCounters::print(std::ostream &os, bool interval) const {
+    uint64_t cycles = 0, instructions = 0;
+    auto precision = os.precision();
+    os << (interval ? "[perf]" : "[perf total]");
+    for (const auto &c : counters_) {
+        auto value = interval ? c.interval : c.total;
+        if (c.name == "cycles") cycles = value;
+        if (c.name == "instructions") instructions = value;
+        if (c.nanoseconds)
+            os << " " << c.name << " " << std::fixed << std::setprecision(3) << value / 1e6 << " ms";
+        else
+            os << " " << c.name << " " << std::dec << value;
+    }
+    if (cycles && instructions)
+        os << " IPC " << std::fixed << std::setprecision(2)
+           << static_cast<double>(instructions) / cycles;
+    os << std::defaultfloat << std::setprecision(precision) << std::endl;
+}
+
+std::string perfEventNames() {
+    std::string names;
+    for (const auto &e : perf_events) names += (names.empty() ? "" : ",") + std::string{e.name};
+    return names;
+}
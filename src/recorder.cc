@@ -0,0 +1,785 @@
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <sys/time.h>
+#include <sys/times.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+#include "debugger.hh"
+#include "recorder.hh"
+#include "stats.hh"
+
+namespace {
+
+// record types of the log
+constexpr uint8_t syscall_entry = 0;
+constexpr uint8_t signal_entry = 1;
+
+// instructions traced at most by one reverse-step
+constexpr std::size_t max_reverse_steps = 1 << 22;
+
+// size of the kernel's struct termios (TCGETS), smaller than glibc's
+constexpr std::size_t kernel_termios_size = 36;
+
+// size of struct statx
+constexpr std::size_t statx_size = 256;
+
+template <typename T>
+void append(std::vector<uint8_t> *log, T value) {
+    uint8_t b[sizeof(T)];
+    std::memcpy(b, &value, sizeof(T));
+    log->insert(log->end(), b, b + sizeof(T));
+}
+
+template <typename T>
+T extract(const std::vector<uint8_t> &log, std::size_t *offset) {
+    T value;
+    std::memcpy(&value, log.data() + *offset, sizeof(T));
+    *offset += sizeof(T);
+    return value;
+}
+
+// -ERESTARTSYS ... -ERESTART_RESTARTBLOCK: the syscall starts over once
+// the signal is handled, only the restarted one is logged
+bool isRestart(int64_t result) { return result <= -512 && result >= -516; }
+
+// Syscalls replay runs for real: they only change the replayed process
+// itself, or later syscalls that run for real depend on them
+bool isReexecuted(const user_regs_struct &regs) {
+    uint64_t flags;
+    switch (regs.orig_rax) {
+        case SYS_brk: case SYS_mmap: case SYS_munmap: case SYS_mprotect:
+        case SYS_mremap: case SYS_madvise: case SYS_arch_prctl:
+        case SYS_set_tid_address: case SYS_set_robust_list:
+        case SYS_rt_sigaction: case SYS_rt_sigprocmask: case SYS_rt_sigreturn:
+        case SYS_sigaltstack: case SYS_close: case SYS_exit: case SYS_exit_group:
+#ifdef SYS_rseq
+        case SYS_rseq:
+#endif
+            return true;
+        case SYS_open:
+            flags = regs.rsi;
+            break;
+        case SYS_openat:
+            flags = regs.rdx;
+            break;
+        default:
+            return false;
+    }
+    // read-only opens, so that the files can be mmapped
+    return (flags & O_ACCMODE) == O_RDONLY && !(flags & (O_CREAT | O_TRUNC));
+}
+
+bool samePosition(const user_regs_struct &a, const user_regs_struct &b) {
+    return a.rip == b.rip && a.rsp == b.rsp && a.rbp == b.rbp
+        && a.rax == b.rax && a.rbx == b.rbx && a.rcx == b.rcx
+        && a.rdx == b.rdx && a.rsi == b.rsi && a.rdi == b.rdi
+        && a.r8 == b.r8 && a.r9 == b.r9 && a.r10 == b.r10
+        && a.r11 == b.r11 && a.r12 == b.r12 && a.r13 == b.r13
+        && a.r14 == b.r14 && a.r15 == b.r15;
+}
+
+// Memory a successful syscall wrote to: address & length
+std::vector<std::pair<uint64_t, std::size_t>>
+syscallOutputs(Debugger &dbg, const user_regs_struct &entry, int64_t result) {
+    std::vector<std::pair<uint64_t, std::size_t>> out;
+    if (result < 0) return out;
+
+    auto add = [&out](uint64_t address, std::size_t len) {
+        if (address && len) out.emplace_back(address, len);
+    };
+    auto a0 = entry.rdi, a1 = entry.rsi, a2 = entry.rdx;
+    auto a3 = entry.r10, a4 = entry.r8, a5 = entry.r9;
+
+    switch (entry.orig_rax) {
+        case SYS_read: case SYS_pread64: case SYS_getdents64:
+        case SYS_readlink:
+            add(a1, result);
+            break;
+        case SYS_readlinkat:
+            add(a2, result);
+            break;
+        case SYS_getrandom: case SYS_getcwd:
+            add(a0, result);
+            break;
+        case SYS_recvfrom: {
+            add(a1, result);
+            uint32_t addrlen = 0;
+            if (a4 && a5 && dbg.readMemoryBlock(a5, &addrlen, sizeof(addrlen))) {
+                add(a5, sizeof(addrlen));
+                add(a4, addrlen);
+            }
+            break;
+        }
+        case SYS_readv: case SYS_preadv: {
+            // scattered over the iovecs, in order
+            std::size_t left = result;
+            for (uint64_t i = 0; i < a2 && left; ++i) {
+                iovec iov;
+                if (!dbg.readMemoryBlock(a1 + i * sizeof(iov), &iov, sizeof(iov))) break;
+                auto n = std::min(left, iov.iov_len);
+                add(reinterpret_cast<uint64_t>(iov.iov_base), n);
+                left -= n;
+            }
+            break;
+        }
+        case SYS_clock_gettime: case SYS_clock_getres:
+            add(a1, sizeof(timespec));
+            break;
+        case SYS_gettimeofday:
+            add(a0, sizeof(timeval));
+            add(a1, sizeof(struct timezone));
+            break;
+        case SYS_time:
+            add(a0, sizeof(time_t));
+            break;
+        case SYS_times:
+            add(a0, sizeof(struct tms));
+            break;
+        case SYS_getrusage:
+            add(a1, sizeof(rusage));
+            break;
+        case SYS_fstat: case SYS_stat: case SYS_lstat:
+            add(a1, sizeof(struct stat));
+            break;
+        case SYS_newfstatat:
+            add(a2, sizeof(struct stat));
+            break;
+        case SYS_statx:
+            add(a4, statx_size);
+            break;
+        case SYS_uname:
+            add(a0, sizeof(utsname));
+            break;
+        case SYS_sysinfo:
+            add(a0, sizeof(struct sysinfo));
+            break;
+        case SYS_pipe: case SYS_pipe2:
+            add(a0, 2 * sizeof(int));
+            break;
+        case SYS_poll:
+            add(a0, a1 * sizeof(pollfd));
+            break;
+        case SYS_epoll_wait:
+            add(a1, result * sizeof(epoll_event));
+            break;
+        case SYS_wait4:
+            add(a1, sizeof(int));
+            add(a3, sizeof(rusage));
+            break;
+        case SYS_ioctl:
+            if (a1 == TCGETS) add(a2, kernel_termios_size);
+            else if (a1 == TIOCGWINSZ) add(a2, sizeof(winsize));
+            break;
+    }
+    return out;
+}
+
+} // namespace
+
+Recorder::Recorder(Debugger &dbg) : dbg_{dbg}, pid_{dbg.getPid()} {
+    last_snapshot_cpu_ = traceeCpuTime();
+    takeSnapshot();
+}
+
+Recorder::~Recorder() {
+    for (const auto &snapshot : snapshots_) {
+        kill(snapshot.second.pid, SIGKILL);
+        countedWaitpid(snapshot.second.pid, nullptr, __WALL);
+    }
+}
+
+bool Recorder::isCurrent() const {
+    return dbg_.getPid() == pid_ && !dbg_.hasExited();
+}
+
+__ptrace_request Recorder::mapResume(__ptrace_request request) const {
+    if (!isCurrent() || (full_ && !replaying_)) return request;
+    if (in_syscall_ || request == PTRACE_CONT) return PTRACE_SYSCALL;
+
+    // a step over a syscall instruction has to stop at its exit too
+    if (request == PTRACE_SINGLESTEP
+            && (dbg_.readMemory(dbg_.get_pc()) & 0xffff) == 0x050f)
+        return PTRACE_SYSCALL;
+    return request;
+}
+
+bool Recorder::handleSyscallStop() {
+    auto start = std::chrono::steady_clock::now();
+    ++syscall_stops_;
+
+    bool step_done = false;
+    if (!in_syscall_) {
+        onSyscallEntry();
+    } else {
+        onSyscallExit();
+        step_done = dbg_.lastResume() == PTRACE_SINGLESTEP;
+    }
+    overhead_ += std::chrono::steady_clock::now() - start;
+
+    // stopped for good: the prompt takes the live process back
+    if (diverged_) return false;
+
+    // the exit of a stepped syscall instruction is the end of the step
+    if (step_done) return false;
+    countedPtrace(mapResume(dbg_.lastResume()), pid_, nullptr, nullptr);
+    return true;
+}
+
+void Recorder::onSyscallEntry() {
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &entry_regs_);
+    in_syscall_ = true;
+    emulated_ = false;
+    if (!replaying_) return;
+
+    if (event_ == index_.size()) {
+        // Past the last logged syscall: the copy has the live process'
+        // memory & shares its open files, it can carry on in its place
+        kill(live_.pid, SIGKILL);
+        countedWaitpid(live_.pid, nullptr, __WALL);
+        // signals the live process got from here on aren't the copy's
+        if (next_signal_ < signal_index_.size()) signal_index_.resize(next_signal_);
+        replaying_ = false;
+        std::cout << "[End of the recording, process " << std::dec << pid_
+                  << " is live now]" << std::endl;
+        return;
+    }
+
+    auto record = syscallRecord(event_);
+    if (record.nr != entry_regs_.orig_rax) {
+        // the log doesn't describe this process anymore: it runs for real
+        std::cerr << "Replay diverged at syscall #" << std::dec << event_
+                  << ": " << entry_regs_.orig_rax << " instead of "
+                  << record.nr << std::endl;
+        diverged_ = true;
+        return;
+    }
+    if (isReexecuted(entry_regs_)) return;
+
+    // skip it, its result is written at the exit stop
+    auto regs = entry_regs_;
+    regs.orig_rax = -1;
+    countedPtrace(PTRACE_SETREGS, pid_, nullptr, &regs);
+    emulated_ = true;
+}
+
+void Recorder::onSyscallExit() {
+    in_syscall_ = false;
+    if (diverged_) return;
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+    auto result = static_cast<int64_t>(regs.rax);
+
+    if (!replaying_) {
+        if (full_ || isRestart(result)) return;
+        logSyscall(regs);
+        ++event_;
+
+        auto cpu = traceeCpuTime();
+        if (cpu - last_snapshot_cpu_ >= snapshot_interval_) {
+            takeSnapshot();
+            last_snapshot_cpu_ = cpu;
+        }
+        return;
+    }
+
+    if (emulated_) {
+        // interrupted by a signal while recorded: the handler runs first,
+        // then the syscall starts over & gets its logged result
+        SignalRecord signal;
+        if (nextSignal(&signal) && isRestart(signal.regs.rax) && signal.regs.rip == regs.rip) {
+            regs.rax = signal.regs.rax;
+            regs.orig_rax = signal.regs.orig_rax;
+            countedPtrace(PTRACE_SETREGS, pid_, nullptr, &regs);
+            // reported as it returns, where signalToDeliver() matches it
+            syscall(SYS_tgkill, pid_, pid_, signal.signo);
+            return;
+        }
+    }
+
+    if (!emulated_ && isRestart(result)) return;
+    auto record = syscallRecord(event_++);
+    if (emulated_) {
+        regs.rax = record.result;
+        countedPtrace(PTRACE_SETREGS, pid_, nullptr, &regs);
+        for (const auto &write : record.writes) {
+            dbg_.writeMemoryBlock(write.first, log_.data() + write.second.first,
+                                  write.second.second);
+        }
+    }
+    else if (result != record.result && entry_regs_.orig_rax == SYS_set_tid_address) {
+        // returns the thread id, which the copy doesn't share
+        regs.rax = record.result;
+        countedPtrace(PTRACE_SETREGS, pid_, nullptr, &regs);
+    }
+    else if (result != record.result) {
+        bool is_open = entry_regs_.orig_rax == SYS_open
+                    || entry_regs_.orig_rax == SYS_openat;
+        if (is_open && result >= 0 && record.result >= 0) {
+            // skipped opens leave holes in the descriptor numbers
+            dbg_.injectSyscallInto(pid_, SYS_dup2, result, record.result);
+            dbg_.injectSyscallInto(pid_, SYS_close, result);
+            regs.rax = record.result;
+            countedPtrace(PTRACE_SETREGS, pid_, nullptr, &regs);
+        } else {
+            std::cerr << "Replay diverged at syscall #" << std::dec << event_ - 1
+                      << ": returned " << result << " instead of "
+                      << record.result << std::endl;
+            diverged_ = true;
+        }
+    }
+}
+
+// syscall record: type, nr, result, number of writes,
+// then address, length & bytes of each write
+void Recorder::logSyscall(const user_regs_struct &regs) {
+    auto result = static_cast<int64_t>(regs.rax);
+    auto writes = syscallOutputs(dbg_, entry_regs_, result);
+
+    index_.push_back(log_.size());
+    append<uint8_t>(&log_, syscall_entry);
+    append<uint16_t>(&log_, entry_regs_.orig_rax);
+    append<int64_t>(&log_, result);
+    append<uint16_t>(&log_, writes.size());
+    for (const auto &write : writes) {
+        append<uint64_t>(&log_, write.first);
+        append<uint32_t>(&log_, write.second);
+        auto offset = log_.size();
+        log_.resize(offset + write.second);
+        dbg_.readMemoryBlock(write.first, log_.data() + offset, write.second);
+    }
+
+    if (log_.size() > max_record_log_size) {
+        full_ = true;
+        std::cerr << "Recording log is full, recording stopped at syscall #"
+                  << std::dec << index_.size() << std::endl;
+    }
+}
+
+Recorder::SyscallRecord Recorder::syscallRecord(std::size_t event) const {
+    SyscallRecord record;
+    auto offset = index_[event] + 1; // skip type
+    record.nr = extract<uint16_t>(log_, &offset);
+    record.result = extract<int64_t>(log_, &offset);
+    auto n_writes = extract<uint16_t>(log_, &offset);
+    for (unsigned i = 0; i < n_writes; ++i) {
+        auto address = extract<uint64_t>(log_, &offset);
+        auto len = extract<uint32_t>(log_, &offset);
+        record.writes.push_back({address, {offset, len}});
+        offset += len;
+    }
+    return record;
+}
+
+// signal record: type, signal, event, registers & siginfo it was
+// delivered with. Replay delivers it at the same point, and no others
+void Recorder::logSignal(int signo) {
+    if (!isCurrent() || replaying_ || full_) return;
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+    // the stop's own siginfo, unless the signal was held past its stop
+    siginfo_t info {};
+    if (countedPtrace(PTRACE_GETSIGINFO, pid_, nullptr, &info) != 0 || info.si_signo != signo)
+        info = siginfo_t{};
+
+    signal_index_.push_back(log_.size());
+    append<uint8_t>(&log_, signal_entry);
+    append<uint8_t>(&log_, signo);
+    append<uint64_t>(&log_, event_);
+    append<user_regs_struct>(&log_, regs);
+    append<siginfo_t>(&log_, info);
+}
+
+Recorder::SignalRecord Recorder::signalRecord(std::size_t i) const {
+    SignalRecord record;
+    auto offset = signal_index_[i] + 1; // skip type
+    record.signo = extract<uint8_t>(log_, &offset);
+    record.event = extract<uint64_t>(log_, &offset);
+    record.regs = extract<user_regs_struct>(log_, &offset);
+    record.info = extract<siginfo_t>(log_, &offset);
+    return record;
+}
+
+bool Recorder::nextSignal(SignalRecord *record) {
+    for (; next_signal_ < signal_index_.size(); ++next_signal_) {
+        *record = signalRecord(next_signal_);
+        if (record->event >= event_) return record->event == event_;
+    }
+    return false;
+}
+
+int Recorder::signalToDeliver() {
+    SignalRecord record;
+    if (!replaying_ || !isCurrent() || !nextSignal(&record)) return 0;
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+    if (!samePosition(regs, record.regs)) return 0;
+
+    ++next_signal_;
+    // the kernel keeps a siginfo of the same signal instead of making one up
+    if (record.info.si_signo == record.signo)
+        countedPtrace(PTRACE_SETSIGINFO, pid_, nullptr, &record.info);
+    return record.signo;
+}
+
+void Recorder::armSignalBreakpoint(Breakpoint *bp) {
+    SignalRecord record;
+    bool due = nextSignal(&record);
+    auto address = static_cast<intptr_t>(record.regs.rip);
+    if (bp->isEnabled() && (!due || bp->getAddress() != address)) bp->disable();
+    // another int3 there stops the process already
+    if (!due || bp->isEnabled() || (dbg_.readMemory(address) & 0xff) == 0xcc) return;
+    *bp = Breakpoint{pid_, address};
+    bp->enable();
+}
+
+void Recorder::takeSnapshot() {
+    auto pid = dbg_.forkStopped(pid_);
+    if (pid < 0) return;
+
+    auto state = dbg_.currentProcessState();
+    state.pid = pid;
+    snapshots_.emplace_back(event_, std::move(state));
+    if (snapshots_.size() <= max_record_snapshots) return;
+
+    // Halve the density, keeping the first: history still reaches back
+    // to where recording started, just with longer replays
+    std::vector<std::pair<std::size_t, Checkpoint>> kept;
+    for (std::size_t i = 0; i < snapshots_.size(); ++i) {
+        if (i % 2 == 0) {
+            kept.push_back(std::move(snapshots_[i]));
+        } else {
+            kill(snapshots_[i].second.pid, SIGKILL);
+            countedWaitpid(snapshots_[i].second.pid, nullptr, __WALL);
+        }
+    }
+    snapshots_ = std::move(kept);
+    snapshot_interval_ *= 2;
+}
+
+std::chrono::nanoseconds Recorder::traceeCpuTime() const {
+    clockid_t clock;
+    timespec ts;
+    if (clock_getcpuclockid(pid_, &clock) != 0 || clock_gettime(clock, &ts) != 0)
+        return std::chrono::nanoseconds{0};
+    return std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec};
+}
+
+bool Recorder::startReplay(std::size_t event) {
+    auto snapshot = std::find_if(snapshots_.rbegin(), snapshots_.rend(),
+                                 [event](auto &&s) { return s.first <= event; });
+    if (snapshot == snapshots_.rend()) return false;
+
+    auto pid = dbg_.forkStopped(snapshot->second.pid);
+    if (pid < 0) return false;
+
+    // the live process is parked, an earlier copy thrown away
+    if (!replaying_) live_ = dbg_.currentProcessState();
+    dbg_.adoptProcess(pid, snapshot->second, replaying_);
+    replaying_ = true;
+    pid_ = pid;
+    event_ = snapshot->first;
+    in_syscall_ = false;
+    diverged_ = false;
+    next_signal_ = 0; // nextSignal() skips those before the snapshot
+    return true;
+}
+
+bool Recorder::stepInstruction() {
+    dbg_.invalidateRegisterCache();
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+
+    auto &breakpoints = dbg_.getBreakpoints();
+    auto bp = breakpoints.find(regs.rip);
+    bool on_breakpoint = bp != breakpoints.end() && bp->second.isEnabled();
+    if (on_breakpoint) bp->second.disable();
+
+    long deliver = signalToDeliver();
+    bool ok = true;
+    int status;
+    if ((dbg_.readMemory(regs.rip) & 0xffff) == 0x050f) {
+        // through the syscall stops, so that the log is fed in
+        int stops = 0;
+        while (ok && stops < 2) {
+            countedPtrace(PTRACE_SYSCALL, pid_, nullptr, deliver);
+            countedWaitpid(pid_, &status, __WALL);
+            deliver = 0;
+            if (!WIFSTOPPED(status)) ok = false;
+            else if (WSTOPSIG(status) != (SIGTRAP | 0x80)) deliver = signalToDeliver();
+            else if (in_syscall_) onSyscallExit(), ++stops;
+            else if (event_ >= index_.size()) ok = false;
+            else onSyscallEntry(), ++stops;
+            if (diverged_) ok = false;
+        }
+    } else {
+        countedPtrace(PTRACE_SINGLESTEP, pid_, nullptr, deliver);
+        countedWaitpid(pid_, &status, __WALL);
+        ok = WIFSTOPPED(status);
+    }
+
+    if (on_breakpoint && ok) bp->second.enable();
+    return ok;
+}
+
+bool Recorder::replayForward(std::size_t event, const user_regs_struct *target,
+                             std::vector<ReplayPosition> *hits) {
+    dbg_.invalidateRegisterCache();
+    auto atTarget = [&](const user_regs_struct &regs) {
+        return target && event_ == event && samePosition(regs, *target);
+    };
+
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+    if (!target && event_ == event) return true;
+    if (atTarget(regs)) return true;
+
+    auto &breakpoints = dbg_.getBreakpoints();
+    auto isUserBreakpoint = [&breakpoints](uint64_t address) {
+        auto bp = breakpoints.find(address);
+        return bp != breakpoints.end() && bp->second.isEnabled();
+    };
+
+    Breakpoint temp;
+    bool has_temp = target && !isUserBreakpoint(target->rip);
+    if (has_temp) {
+        temp = Breakpoint{pid_, static_cast<intptr_t>(target->rip)};
+        temp.enable();
+    }
+
+    Breakpoint signal_bp {pid_, 0};
+    bool reached = false;
+    long deliver = 0;
+    while (true) {
+        armSignalBreakpoint(&signal_bp);
+        int status;
+        countedPtrace(PTRACE_SYSCALL, pid_, nullptr, deliver);
+        countedWaitpid(pid_, &status, __WALL);
+        deliver = 0;
+        if (!WIFSTOPPED(status)) break;
+
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            if (!in_syscall_) {
+                if (event_ >= index_.size()) break;
+                onSyscallEntry();
+                if (diverged_) break;
+                continue;
+            }
+            onSyscallExit();
+            if (diverged_) break;
+            if (!target && event_ == event) { reached = true; break; }
+            if (event_ > event) break; // went past without meeting <target>
+            continue;
+        }
+        // other signals are delivered only where the recording did
+        if (WSTOPSIG(status) != SIGTRAP) {
+            deliver = signalToDeliver();
+            continue;
+        }
+
+        countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+        auto pc = regs.rip - 1;
+        bool is_temp = has_temp && pc == target->rip;
+        bool is_user = isUserBreakpoint(pc);
+        bool is_signal = signal_bp.isEnabled() && pc == static_cast<uint64_t>(signal_bp.getAddress());
+        if (!is_temp && !is_user && !is_signal) continue; // the program's own SIGTRAP
+
+        regs.rip = pc;
+        countedPtrace(PTRACE_SETREGS, pid_, nullptr, &regs);
+        // the signal came before the instruction ran, and before its breakpoint
+        deliver = signalToDeliver();
+        if (deliver) continue;
+        if (atTarget(regs)) { reached = true; break; }
+        if (is_user && hits) hits->push_back({event_, regs});
+
+        if (is_signal) signal_bp.disable();
+        if (is_temp) temp.disable();
+        bool stepped = stepInstruction();
+        if (is_temp && stepped) temp.enable();
+        if (!stepped) break;
+        if (!target && event_ == event) { reached = true; break; }
+    }
+
+    if (has_temp && reached) temp.disable();
+    if (signal_bp.isEnabled()) signal_bp.disable();
+    return reached;
+}
+
+bool Recorder::replayTo(const ReplayPosition &pos) {
+    return startReplay(pos.event) && replayForward(pos.event, &pos.regs, nullptr);
+}
+
+ReplayPosition Recorder::currentPosition() const {
+    ReplayPosition pos;
+    pos.event = event_;
+    countedPtrace(PTRACE_GETREGS, pid_, nullptr, &pos.regs);
+    return pos;
+}
+
+void Recorder::reverseStep() {
+    if (!isCurrent()) {
+        std::cerr << "The current process is not being recorded" << std::endl;
+        return;
+    }
+    auto now = currentPosition();
+
+    // file & line of an instruction, {nullptr, 0} without line info.
+    // Loops run the same instructions over & over: looked up once
+    using LineKey = std::pair<const void *, unsigned>;
+    std::unordered_map<uint64_t, LineKey> lines;
+    auto lineOf = [this, &lines](uint64_t pc) -> LineKey {
+        auto it = lines.find(pc);
+        if (it != lines.end()) return it->second;
+        LineKey key {nullptr, 0};
+        try {
+            auto entry = dbg_.getLineEntryFromPC(dbg_.offsetLoadAddress(pc));
+            key = {entry->file, entry->line};
+        } catch (std::out_of_range &) {
+        }
+        return lines[pc] = key;
+    };
+
+    // Trace the instructions from the nearest snapshot up to now, once,
+    // keeping where each run of a line begins. An earlier snapshot is
+    // only needed when the previous line began before this one
+    for (auto s = snapshots_.size(); s-- > 0; ) {
+        if (snapshots_[s].first > now.event) continue;
+        if (!startReplay(snapshots_[s].first)) break;
+
+        std::vector<std::pair<ReplayPosition, LineKey>> runs;
+        user_regs_struct regs;
+        countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+        runs.push_back({{event_, regs}, lineOf(regs.rip)});
+        bool ok = true;
+        for (std::size_t steps = 0; !(event_ == now.event && samePosition(regs, now.regs)); ++steps) {
+            if (steps == max_reverse_steps) {
+                std::cerr << "More than " << std::dec << max_reverse_steps
+                          << " instructions since the last snapshot, not stepping back"
+                          << std::endl;
+                if (!replayTo(now)) break;
+                dbg_.printCurrentLocation();
+                return;
+            }
+            if (!stepInstruction()) {
+                ok = false;
+                break;
+            }
+            countedPtrace(PTRACE_GETREGS, pid_, nullptr, &regs);
+            auto line = lineOf(regs.rip);
+            if (line != runs.back().second) runs.push_back({{event_, regs}, line});
+        }
+        if (!ok) break;
+
+        // skip the current line, then the previous line goes back to its
+        // first instruction; calls without line info (libc) are part of it
+        auto current = runs.back().second;
+        long i = runs.size() - 1;
+        while (i >= 0 && (!runs[i].second.first || runs[i].second == current)) --i;
+
+        bool at_beginning = s == 0;
+        if (i < 0) {
+            if (!at_beginning) continue;
+            std::cout << "No more reverse-execution history." << std::endl;
+            dbg_.printCurrentLocation();
+            return;
+        }
+
+        auto previous = runs[i].second;
+        long begin = i, k = i - 1;
+        for (; k >= 0; --k) {
+            if (!runs[k].second.first) continue;
+            if (runs[k].second != previous) break;
+            begin = k;
+        }
+        if (k < 0 && !at_beginning) continue;
+
+        if (!replayTo(runs[begin].first)) break;
+        dbg_.printCurrentLocation();
+        return;
+    }
+
+    std::cerr << "Couldn't replay the recording, back to the live process"
+              << std::endl;
+    returnToLive();
+}
+
+void Recorder::reverseContinue() {
+    if (!isCurrent()) {
+        std::cerr << "The current process is not being recorded" << std::endl;
+        return;
+    }
+    auto now = currentPosition();
+
+    // from the latest snapshot backwards, until a stretch has a hit
+    for (auto s = snapshots_.size(); s-- > 0; ) {
+        if (snapshots_[s].first > now.event) continue;
+
+        std::vector<ReplayPosition> hits;
+        if (!startReplay(snapshots_[s].first)
+                || !replayForward(now.event, &now.regs, &hits)) {
+            std::cerr << "Couldn't replay the recording, back to the live process"
+                      << std::endl;
+            returnToLive();
+            return;
+        }
+        if (hits.empty()) continue;
+
+        if (!replayTo(hits.back())) {
+            std::cerr << "Couldn't replay the recording, back to the live process"
+                      << std::endl;
+            returnToLive();
+            return;
+        }
+        std::cout << "Hit breakpoint at address 0x" << std::hex
+                  << hits.back().regs.rip << std::endl;
+        dbg_.printCurrentLocation();
+        return;
+    }
+
+    startReplay(snapshots_.front().first);
+    std::cout << "No more reverse-execution history." << std::endl;
+    dbg_.printCurrentLocation();
+}
+
+void Recorder::returnToLive() {
+    if (!replaying_) return;
+    dbg_.adoptProcess(live_.pid, live_, true); // the copy is thrown away
+    pid_ = live_.pid;
+    event_ = index_.size();
+    in_syscall_ = false;
+    diverged_ = false;
+    replaying_ = false;
+}
+
+void Recorder::printStatus() const {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    std::cout << std::dec << (replaying_ ? "Replaying" : full_ ? "Stopped (log full)" : "Recording")
+              << " process " << pid_ << ", at syscall #" << event_ << std::endl
+              << "  log: " << index_.size() << " syscalls, " << signal_index_.size()
+              << " signals, " << log_.size() << " bytes" << std::endl
+              << "  snapshots: " << snapshots_.size() << ", every "
+              << duration_cast<microseconds>(snapshot_interval_).count() / 1000
+              << " ms of CPU time" << std::endl
+              << "  overhead: " << syscall_stops_ << " syscall stops, "
+              << duration_cast<microseconds>(overhead_).count() << " us in mdb";
+    if (syscall_stops_)
+        std::cout << " (" << duration_cast<microseconds>(overhead_).count() / syscall_stops_
+                  << " us per stop)";
+    std::cout << std::endl;
+}
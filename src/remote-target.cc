@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "remote-target.hh"
+
+namespace {
+
+std::string hexNumber(uint64_t value) {
+    std::ostringstream ss;
+    ss << std::hex << value;
+    return ss.str();
+}
+
+bool startsWith(const std::string &s, const std::string &prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Value of the first <key>="..." at or after <from> in <xml>
+std::string xmlAttribute(const std::string &xml, size_t from, const std::string &key) {
+    auto start = xml.find(key + "=\"", from);
+    if (start == std::string::npos) return "";
+    start += key.size() + 2;
+    auto value = xml.substr(start, xml.find('"', start) - start);
+
+    static const std::pair<std::string, char> entities[] = {
+        {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}, {"&amp;", '&'},
+    };
+    for (const auto &e : entities) {
+        for (auto pos = value.find(e.first); pos != std::string::npos; pos = value.find(e.first, pos + 1))
+            value.replace(pos, e.first.size(), 1, e.second);
+    }
+    return value;
+}
+
+// Requests written back to back: bounded so that neither side blocks on
+// a full socket buffer while the other is still writing
+constexpr size_t max_pipelined = 64;
+
+} // namespace
+
+RemoteTarget::RemoteTarget(int fd) : conn_{fd, fd} {
+    // ^C while the debuggee runs goes to the server
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    interrupt_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    for (const auto &feature : split(request("qSupported:vContSupported+"), ';')) {
+        if (startsWith(feature, "PacketSize=")) {
+            size_t pos = 11;
+            uint64_t size;
+            // a hex or binary reply takes up to two characters per byte
+            if (parseHex(feature, &pos, &size))
+                max_read_ = std::max(page_size, (size - 16) / 2 / page_size * page_size);
+        }
+        else if (feature == "binary-upload+") {
+            binary_upload_ = true;
+        }
+        else if (feature == "QStartNoAckMode+" && request("QStartNoAckMode") == "OK") {
+            conn_.setNoAck(true);
+        }
+    }
+    for (const auto &action : split(request("vCont?"), ';'))
+        if (action == "r") range_stepping_ = true;
+
+    auto thread = request("qC");
+    if (startsWith(thread, "QC")) {
+        size_t pos = 2;
+        uint64_t pid;
+        if (parseHex(thread, &pos, &pid)) pid_ = pid;
+    }
+    parseStop(request("?"));
+}
+
+RemoteTarget::~RemoteTarget() {
+    if (interrupt_fd_ >= 0) close(interrupt_fd_);
+}
+
+std::string RemoteTarget::request(const std::string &packet) {
+    conn_.send(packet);
+    return conn_.receive();
+}
+
+void RemoteTarget::invalidate() {
+    regs_valid_ = false;
+    expedited_.clear();
+    pages_.clear();
+}
+
+void RemoteTarget::waitForStop(const std::string &packet) {
+    invalidate();
+    conn_.send(packet);
+    while (!conn_.hasPacket()) {
+        pollfd fds[2] = {{conn_.inFd(), POLLIN, 0}, {interrupt_fd_, POLLIN, 0}};
+        if (::poll(fds, interrupt_fd_ >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string{"poll: "} + strerror(errno));
+        }
+        if (fds[1].revents & POLLIN) {
+            signalfd_siginfo info;
+            while (::read(interrupt_fd_, &info, sizeof(info)) == sizeof(info)) {}
+            conn_.sendInterrupt();
+        }
+        if (fds[0].revents && !conn_.poll())
+            throw std::runtime_error("Remote connection closed");
+    }
+    parseStop(conn_.receive());
+}
+
+void RemoteTarget::parseStop(const std::string &reply) {
+    stop_ = RemoteStop{};
+    expedited_.clear();
+
+    std::vector<uint8_t> number;
+    if (reply.size() < 3 || !fromHex(reply.substr(1, 2), &number))
+        throw std::runtime_error("Bad stop reply: " + reply);
+    switch (reply[0]) {
+        case 'W':
+            stop_.exited = true;
+            stop_.code = number[0];
+            return;
+        case 'X':
+            stop_.exited = true;
+            stop_.signal = linuxSignalFromRsp(number[0]);
+            return;
+        case 'S':
+        case 'T':
+            stop_.signal = linuxSignalFromRsp(number[0]);
+            break;
+        default:
+            throw std::runtime_error("Bad stop reply: " + reply);
+    }
+
+    // T<sig>n:value;...: registers sent along, besides thread:, core:...
+    for (const auto &field : split(reply.substr(3), ';')) {
+        size_t pos = 0;
+        uint64_t regno;
+        std::vector<uint8_t> bytes;
+        if (!parseHex(field, &pos, &regno) || pos >= field.size() || field[pos] != ':') continue;
+        if (!fromHex(field.substr(pos + 1), &bytes) || bytes.size() > 8
+                || bytes.size() != rspRegisterSize(regno))
+            continue;
+        uint64_t value = 0;
+        std::memcpy(&value, bytes.data(), bytes.size());
+        expedited_[regno] = value;
+    }
+}
+
+void RemoteTarget::fetchRegisters() {
+    if (regs_valid_) return;
+    auto reply = request("g");
+    std::vector<uint8_t> data;
+    if (!fromHex(reply, &data) || data.size() < rsp_registers_size)
+        throw std::runtime_error("Can't read registers: " + reply);
+
+    size_t offset = 0;
+    for (unsigned regno = 0; regno < rsp_register_count; ++regno) {
+        rspUnpackRegister(&regs_, &fp_regs_.fx, regno, data.data() + offset);
+        offset += rspRegisterSize(regno);
+    }
+    fp_regs_.has_avx = false;
+    regs_valid_ = true;
+}
+
+uint64_t RemoteTarget::getRegister(Reg r) {
+    auto regno = rspRegisterNumber(r);
+    if (!regs_valid_ && regno >= 0) {
+        auto it = expedited_.find(regno);
+        if (it != expedited_.end()) return it->second;
+    }
+    fetchRegisters();
+    return getRegisterValue(regs_, r);
+}
+
+void RemoteTarget::setRegister(Reg r, uint64_t value) {
+    auto regno = rspRegisterNumber(r);
+    if (regno < 0)
+        throw std::runtime_error("Register " + getRegisterName(r) + " isn't available remotely");
+
+    uint8_t bytes[8];
+    std::memcpy(bytes, &value, sizeof(bytes));
+    auto reply = request("P" + hexNumber(regno) + "=" + toHex(bytes, rspRegisterSize(regno)));
+    if (reply != "OK")
+        throw std::runtime_error("Can't write " + getRegisterName(r) + ": " + reply);
+    regs_valid_ = false;
+    expedited_.erase(regno);
+}
+
+const FpRegisters &RemoteTarget::fpRegisters() {
+    fetchRegisters();
+    return fp_regs_;
+}
+
+void RemoteTarget::prefetch(const std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+    std::set<uint64_t> missing;
+    for (const auto &r : ranges) {
+        for (auto page = r.first & ~uint64_t{page_size - 1}; page < r.second; page += page_size)
+            if (!pages_.count(page)) missing.insert(page);
+    }
+
+    // (start, length): adjacent pages in one request, up to max_read_
+    std::vector<std::pair<uint64_t, uint64_t>> runs;
+    for (auto page : missing) {
+        if (!runs.empty() && runs.back().first + runs.back().second == page
+                && runs.back().second + page_size <= max_read_)
+            runs.back().second += page_size;
+        else
+            runs.emplace_back(page, page_size);
+    }
+
+    for (size_t first = 0; first < runs.size(); first += max_pipelined) {
+        auto last = std::min(runs.size(), first + max_pipelined);
+        std::vector<std::string> packets;
+        for (auto i = first; i < last; ++i)
+            packets.push_back((binary_upload_ ? "x" : "m") + hexNumber(runs[i].first) + ","
+                              + hexNumber(runs[i].second));
+        auto replies = conn_.exchange(packets);
+
+        for (auto i = first; i < last; ++i) {
+            const auto &reply = replies[i - first];
+            std::vector<uint8_t> data;
+            // errors are E<nn>; short data ends at an unreadable page
+            if (binary_upload_ && startsWith(reply, "b")) data = unescapeBinary(reply, 1);
+            else if (!binary_upload_ && reply.size() % 2 == 0) fromHex(reply, &data);
+
+            for (uint64_t offset = 0; offset < runs[i].second; offset += page_size) {
+                auto &page = pages_[runs[i].first + offset];
+                if (offset + page_size <= data.size())
+                    page.assign(data.begin() + offset, data.begin() + offset + page_size);
+                else
+                    page.clear();
+            }
+        }
+    }
+}
+
+size_t RemoteTarget::readPartial(uint64_t address, void *buf, size_t len) {
+    if (!len) return 0;
+    prefetch({{address, address + len}});
+
+    auto out = static_cast<uint8_t*>(buf);
+    size_t done = 0;
+    while (done < len) {
+        auto addr = address + done;
+        auto page_addr = addr & ~uint64_t{page_size - 1};
+        const auto &page = pages_[page_addr];
+        if (page.empty()) break;
+        auto n = std::min<size_t>(page_size - (addr - page_addr), len - done);
+        std::memcpy(out + done, page.data() + (addr - page_addr), n);
+        done += n;
+    }
+    return done;
+}
+
+bool RemoteTarget::read(uint64_t address, void *buf, size_t len) {
+    return readPartial(address, buf, len) == len;
+}
+
+bool RemoteTarget::write(uint64_t address, const void *buf, size_t len) {
+    auto in = static_cast<const uint8_t*>(buf);
+    for (size_t done = 0; done < len;) {
+        auto n = std::min(len - done, max_read_);
+        auto where = hexNumber(address + done) + "," + hexNumber(n) + ":";
+        auto reply = request("X" + where + escapeBinary(in + done, n));
+        if (reply.empty()) reply = request("M" + where + toHex(in + done, n));
+        if (reply != "OK") return false;
+        done += n;
+    }
+
+    for (auto page = address & ~uint64_t{page_size - 1}; page < address + len; page += page_size)
+        pages_.erase(page);
+    return true;
+}
+
+bool RemoteTarget::insertBreakpoint(uint64_t address) {
+    return request("Z0," + hexNumber(address) + ",1") == "OK";
+}
+
+bool RemoteTarget::removeBreakpoint(uint64_t address) {
+    return request("z0," + hexNumber(address) + ",1") == "OK";
+}
+
+void RemoteTarget::resume() {
+    waitForStop("vCont;c");
+}
+
+void RemoteTarget::step() {
+    waitForStop("vCont;s");
+}
+
+void RemoteTarget::rangeStep(uint64_t start, uint64_t end) {
+    if (range_stepping_) {
+        waitForStop("vCont;r" + hexNumber(start) + "," + hexNumber(end));
+        return;
+    }
+    // a round trip per instruction
+    do {
+        step();
+    } while (!stop_.exited && stop_.signal == SIGTRAP
+             && getRegister(Reg::rip) >= start && getRegister(Reg::rip) < end);
+}
+
+std::string RemoteTarget::transfer(const std::string &object) {
+    std::string data;
+    for (;;) {
+        auto reply = request("qXfer:" + object + ":read::" + hexNumber(data.size()) + ","
+                             + hexNumber(max_read_));
+        if (reply.empty() || (reply[0] != 'm' && reply[0] != 'l')) return data;
+        auto chunk = unescapeBinary(reply, 1);
+        data.append(chunk.begin(), chunk.end());
+        if (reply[0] == 'l' || chunk.empty()) return data;
+    }
+}
+
+std::vector<LoadedLibrary> RemoteTarget::libraries() {
+    auto xml = transfer("libraries");
+    std::vector<LoadedLibrary> libraries;
+    for (auto pos = xml.find("<library "); pos != std::string::npos; pos = xml.find("<library ", pos + 1)) {
+        auto address = xmlAttribute(xml, pos, "address");
+        if (address.empty()) continue;
+        libraries.push_back({xmlAttribute(xml, pos, "name"), std::stoull(address, nullptr, 0)});
+    }
+    return libraries;
+}
+
+uint64_t RemoteTarget::auxv(uint64_t type) {
+    if (auxv_.empty()) {
+        auto data = transfer("auxv");
+        auxv_.assign(data.begin(), data.end());
+    }
+    // (type, value) pairs ending with AT_NULL
+    for (size_t offset = 0; offset + 16 <= auxv_.size(); offset += 16) {
+        uint64_t entry[2];
+        std::memcpy(entry, auxv_.data() + offset, sizeof(entry));
+        if (entry[0] == type) return entry[1];
+    }
+    return 0;
+}
+
+void RemoteTarget::kill() {
+    // no reply to 'k'
+    conn_.send("k");
+    invalidate();
+    stop_ = RemoteStop{};
+    stop_.exited = true;
+    stop_.signal = SIGKILL;
+}
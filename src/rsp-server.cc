@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#include "debugger.hh"
+#include "rsp-server.hh"
+#include "stats.hh"
+
+namespace {
+
+std::string hexNumber(uint64_t value) {
+    std::ostringstream ss;
+    ss << std::hex << value;
+    return ss.str();
+}
+
+std::string hexByte(unsigned value) {
+    uint8_t byte = value;
+    return toHex(&byte, 1);
+}
+
+bool startsWith(const std::string &s, const std::string &prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+// <addr>,<length> at <*pos>, which is left after them
+bool parseAddressLength(const std::string &args, size_t *pos, uint64_t *addr, uint64_t *len) {
+    if (!parseHex(args, pos, addr) || *pos >= args.size() || args[*pos] != ',') return false;
+    ++*pos;
+    return parseHex(args, pos, len);
+}
+
+std::string escapeXml(const std::string &text) {
+    std::string out;
+    for (auto c : text) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default:  out += c;
+        }
+    }
+    return out;
+}
+
+// Data bytes a reply can carry, escaped or hex
+constexpr size_t max_transfer = (rsp_packet_size - 16) / 2;
+
+} // namespace
+
+void RspServer::serve() {
+    conn_.setCompress(true);
+    while (!done_) {
+        std::string packet;
+        try {
+            packet = conn_.receive();
+        } catch (std::exception &) {
+            hung_up_ = true;
+        }
+        if (hung_up_) {
+            std::cerr << "Client hung up, killing debuggee" << std::endl;
+            if (!dbg_.hasExited()) kill(dbg_.getPid(), SIGKILL);
+            return;
+        }
+
+        std::string reply;
+        try {
+            reply = handle(packet);
+        } catch (std::exception &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            reply = "E01";
+        }
+        if (packet == "k") break; // no reply expected
+        conn_.send(reply);
+        if (packet == "QStartNoAckMode") conn_.setNoAck(true);
+    }
+}
+
+std::string RspServer::handle(const std::string &packet) {
+    if (packet.empty()) return "";
+
+    size_t pos = 1;
+    uint64_t regno;
+    switch (packet[0]) {
+        case '?':
+            return stopReply();
+        case 'g':
+            return readRegisters();
+        case 'G':
+            return writeRegisters(packet.substr(1));
+        case 'p':
+            if (!parseHex(packet, &pos, &regno)) return "E01";
+            return readRegister(regno);
+        case 'P':
+            if (!parseHex(packet, &pos, &regno) || pos >= packet.size() || packet[pos] != '=')
+                return "E01";
+            return writeRegister(regno, packet.substr(pos + 1));
+        case 'm':
+        case 'x':
+            return readMemory(packet.substr(1), packet[0] == 'x');
+        case 'M':
+        case 'X':
+            return writeMemory(packet.substr(1), packet[0] == 'X');
+        case 'Z':
+        case 'z':
+            return breakpoint(packet.substr(1), packet[0] == 'Z');
+        // C<sig> & S<sig> resume like c & s: the stop signal is discarded
+        case 'c':
+        case 'C':
+            return resume("c");
+        case 's':
+        case 'S':
+            return resume("s");
+        case 'H':
+        case 'T':
+            return "OK";
+        case 'k':
+            if (!dbg_.hasExited()) kill(dbg_.getPid(), SIGKILL);
+            done_ = true;
+            return "";
+        case 'D':
+            detach();
+            done_ = true;
+            return "OK";
+        case 'q':
+            return query(packet);
+        case 'Q':
+            return packet == "QStartNoAckMode" ? "OK" : "";
+        case 'v':
+            if (packet == "vCont?") return "vCont;c;C;s;S;r";
+            if (startsWith(packet, "vCont;")) {
+                // one thread: the first action applies, whatever its thread
+                auto action = split(packet.substr(6), ';').front();
+                action = action.substr(0, action.find(':'));
+                if (action.empty()) return "E01";
+                if (action[0] == 'c' || action[0] == 'C') return resume("c");
+                if (action[0] == 's' || action[0] == 'S') return resume("s");
+                if (action[0] == 'r') return resume(action);
+                return "E01";
+            }
+            return "";
+    }
+    return "";
+}
+
+std::string RspServer::stopReply() {
+    auto status = dbg_.waitStatus();
+    if (dbg_.hasExited()) {
+        if (WIFEXITED(status)) return "W" + hexByte(WEXITSTATUS(status));
+        return "X" + hexByte(rspSignalFromLinux(WTERMSIG(status)));
+    }
+
+    // syscall stops (SIGTRAP | 0x80) are traps too
+    int sig = WIFSTOPPED(status) ? WSTOPSIG(status) & 0x7f : SIGTRAP;
+    auto reply = "T" + hexByte(rspSignalFromLinux(sig));
+
+    // the registers every stop needs: rbp, rsp & rip
+    user_regs_struct regs;
+    user_fpregs_struct fp {};
+    countedPtrace(PTRACE_GETREGS, dbg_.getPid(), nullptr, &regs);
+    for (unsigned regno : {6u, 7u, 16u}) {
+        uint8_t bytes[8];
+        rspPackRegister(regs, fp, regno, bytes);
+        reply += hexByte(regno) + ":" + toHex(bytes, sizeof(bytes)) + ";";
+    }
+    return reply + "thread:" + hexNumber(dbg_.getPid()) + ";";
+}
+
+std::string RspServer::readRegisters() {
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, dbg_.getPid(), nullptr, &regs);
+    const auto &fp = dbg_.getFpRegisters().fx;
+
+    uint8_t bytes[rsp_registers_size];
+    size_t offset = 0;
+    for (unsigned regno = 0; regno < rsp_register_count; ++regno) {
+        rspPackRegister(regs, fp, regno, bytes + offset);
+        offset += rspRegisterSize(regno);
+    }
+    return toHex(bytes, offset);
+}
+
+std::string RspServer::writeRegisters(const std::string &hex) {
+    std::vector<uint8_t> data;
+    if (!fromHex(hex, &data) || data.size() < rsp_registers_size) return "E01";
+
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, dbg_.getPid(), nullptr, &regs);
+    auto fp = dbg_.getFpRegisters().fx;
+    size_t offset = 0;
+    for (unsigned regno = 0; regno < rsp_register_count; ++regno) {
+        rspUnpackRegister(&regs, &fp, regno, data.data() + offset);
+        offset += rspRegisterSize(regno);
+    }
+    countedPtrace(PTRACE_SETREGS, dbg_.getPid(), nullptr, &regs);
+    countedPtrace(PTRACE_SETFPREGS, dbg_.getPid(), nullptr, &fp);
+    dbg_.invalidateRegisterCache();
+    return "OK";
+}
+
+std::string RspServer::readRegister(unsigned regno) {
+    auto size = rspRegisterSize(regno);
+    if (!size) return "E01";
+
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, dbg_.getPid(), nullptr, &regs);
+    uint8_t bytes[16];
+    rspPackRegister(regs, dbg_.getFpRegisters().fx, regno, bytes);
+    return toHex(bytes, size);
+}
+
+std::string RspServer::writeRegister(unsigned regno, const std::string &hex) {
+    std::vector<uint8_t> data;
+    if (!rspRegisterSize(regno) || !fromHex(hex, &data) || data.size() < rspRegisterSize(regno))
+        return "E01";
+
+    user_regs_struct regs;
+    countedPtrace(PTRACE_GETREGS, dbg_.getPid(), nullptr, &regs);
+    auto fp = dbg_.getFpRegisters().fx;
+    rspUnpackRegister(&regs, &fp, regno, data.data());
+    if (regno < 24) countedPtrace(PTRACE_SETREGS, dbg_.getPid(), nullptr, &regs);
+    else countedPtrace(PTRACE_SETFPREGS, dbg_.getPid(), nullptr, &fp);
+    dbg_.invalidateRegisterCache();
+    return "OK";
+}
+
+std::string RspServer::readMemory(const std::string &args, bool binary) {
+    size_t pos = 0;
+    uint64_t addr, len;
+    if (!parseAddressLength(args, &pos, &addr, &len)) return "E01";
+
+    std::vector<uint8_t> buf(std::min<uint64_t>(len, max_transfer));
+    auto n = buf.empty() ? 0 : dbg_.readMemoryChunk(addr, buf.data(), buf.size());
+    if (!buf.empty() && !n) return "E14"; // EFAULT
+
+    // the int3s are ours: the client sees the original code
+    for (const auto &bp : dbg_.getBreakpoints()) {
+        uint64_t at = bp.first;
+        if (bp.second.isEnabled() && at >= addr && at < addr + n)
+            buf[at - addr] = bp.second.getSavedData();
+    }
+    return binary ? "b" + escapeBinary(buf.data(), n) : toHex(buf.data(), n);
+}
+
+std::string RspServer::writeMemory(const std::string &args, bool binary) {
+    size_t pos = 0;
+    uint64_t addr, len;
+    if (!parseAddressLength(args, &pos, &addr, &len) || pos >= args.size() || args[pos] != ':')
+        return "E01";
+
+    std::vector<uint8_t> data;
+    if (binary) data = unescapeBinary(args, pos + 1);
+    else if (!fromHex(args.substr(pos + 1), &data)) return "E01";
+    if (data.size() != len) return "E01";
+    if (!len) return "OK";
+
+    // lift the breakpoints in the way so that they save the new bytes
+    std::vector<Breakpoint*> lifted;
+    for (auto &bp : dbg_.getBreakpoints()) {
+        uint64_t at = bp.first;
+        if (bp.second.isEnabled() && at >= addr && at < addr + len) {
+            bp.second.disable();
+            lifted.push_back(&bp.second);
+        }
+    }
+    dbg_.writeMemoryBlock(addr, data.data(), len);
+    for (auto bp : lifted) bp->enable();
+    return "OK";
+}
+
+std::string RspServer::breakpoint(const std::string &args, bool insert) {
+    if (args.size() < 2 || args[0] != '0' || args[1] != ',') return "";
+    size_t pos = 2;
+    uint64_t addr;
+    if (!parseHex(args, &pos, &addr)) return "E01";
+
+    auto &breakpoints = dbg_.getBreakpoints();
+    if (insert && !breakpoints.count(addr)) dbg_.setBreakpointAtAddress(addr);
+    if (!insert && breakpoints.count(addr)) dbg_.removeBreakpoint(addr);
+    return breakpoints.count(addr) == insert ? "OK" : "E01";
+}
+
+std::string RspServer::resume(const std::string &action) {
+    if (dbg_.hasExited()) return "E01";
+
+    if (action == "c") {
+        runInterruptible([this] { dbg_.continueExecution(); });
+        return stopReply();
+    }
+    if (action == "s") {
+        runInterruptible([this] { dbg_.singleStepWithBreakpointCheck(); });
+        return stopReply();
+    }
+
+    // r<start>,<end>: keep stepping while the PC stays in [start, end),
+    // one reply for the whole range
+    size_t pos = 1;
+    uint64_t start, end;
+    if (!parseAddressLength(action, &pos, &start, &end)) return "E01";
+    for (;;) {
+        dbg_.singleStepWithBreakpointCheck();
+        if (dbg_.hasExited() || !WIFSTOPPED(dbg_.waitStatus())
+                || (WSTOPSIG(dbg_.waitStatus()) & 0x7f) != SIGTRAP)
+            break;
+        auto pc = dbg_.get_pc();
+        if (pc < start || pc >= end || dbg_.getBreakpoints().count(pc)) break;
+        // a ^C between two steps
+        if (!conn_.poll() || conn_.takeInterrupt()) break;
+    }
+    return stopReply();
+}
+
+void RspServer::runInterruptible(const std::function<void()> &step) {
+    auto &loop = dbg_.eventLoop();
+    bool watched = loop.addFd(conn_.inFd(), EPOLLIN, [this](uint32_t) {
+        if (hung_up_) return;
+        // a hangup interrupts too; serve() notices it next
+        if (!conn_.poll()) hung_up_ = true;
+        if (hung_up_ || conn_.takeInterrupt()) kill(dbg_.getPid(), SIGINT);
+    });
+    try {
+        step();
+    } catch (...) {
+        if (watched) loop.removeFd(conn_.inFd());
+        throw;
+    }
+    if (watched) loop.removeFd(conn_.inFd());
+}
+
+std::string RspServer::query(const std::string &packet) {
+    auto pid = dbg_.getPid();
+    if (startsWith(packet, "qSupported"))
+        return "PacketSize=" + hexNumber(rsp_packet_size) + ";QStartNoAckMode+;"
+               "qXfer:libraries:read+;qXfer:auxv:read+;vContSupported+;binary-upload+";
+    if (packet == "qC") return "QC" + hexNumber(pid);
+    if (packet == "qfThreadInfo") return "m" + hexNumber(pid);
+    if (packet == "qsThreadInfo") return "l";
+    if (packet == "qAttached") return "0"; // we started it
+    if (startsWith(packet, "qXfer:")) return transfer(packet.substr(6));
+    return "";
+}
+
+std::string RspServer::transfer(const std::string &args) {
+    auto fields = split(args, ':');
+    if (fields.size() != 4 || fields[1] != "read") return "";
+
+    size_t pos = 0;
+    uint64_t offset, length;
+    if (!parseAddressLength(fields[3], &pos, &offset, &length)) return "E01";
+
+    std::string data;
+    if (fields[0] == "libraries") {
+        data = libraryList();
+    }
+    else if (fields[0] == "auxv") {
+        std::ifstream auxv {"/proc/" + std::to_string(dbg_.getPid()) + "/auxv", std::ios::binary};
+        data.assign(std::istreambuf_iterator<char>{auxv}, std::istreambuf_iterator<char>{});
+    }
+    else {
+        return "";
+    }
+
+    if (offset >= data.size()) return "l";
+    auto n = std::min<uint64_t>({length, data.size() - offset, max_transfer});
+    return (offset + n < data.size() ? "m" : "l") + escapeBinary(data.data() + offset, n);
+}
+
+std::string RspServer::libraryList() {
+    std::string xml = "<library-list>";
+    for (const auto &lib : mappedLibraries(dbg_.memoryRegions()))
+        xml += "<library name=\"" + escapeXml(lib.path) + "\"><segment address=\"0x"
+               + hexNumber(lib.base) + "\"/></library>";
+    return xml + "</library-list>";
+}
+
+void RspServer::detach() {
+    if (dbg_.hasExited()) return;
+    std::vector<intptr_t> addresses;
+    for (const auto &bp : dbg_.getBreakpoints()) addresses.push_back(bp.first);
+    for (auto addr : addresses) dbg_.removeBreakpoint(addr);
+    countedPtrace(PTRACE_DETACH, dbg_.getPid(), nullptr, nullptr);
+}
@@ -0,0 +1,173 @@
+#include <algorithm>
+
+#include "scope-index.hh"
+#include "stats.hh"
+
+namespace {
+
+using namespace dwarf;
+
+// PC ranges of <d>, empty if it has none
+std::vector<std::pair<uint64_t, uint64_t>> rangesOf(const die &d) {
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    if (!d.has(DW_AT::low_pc) && !d.has(DW_AT::ranges)) return ranges;
+    try {
+        for (const auto &r : die_pc_range(d)) ranges.push_back(r);
+    } catch (std::out_of_range &) {
+    } catch (value_type_mismatch &) {}
+    return ranges;
+}
+
+bool isDefinedVariable(const die &d) {
+    return (d.tag == DW_TAG::variable || d.tag == DW_TAG::formal_parameter)
+           && (d.has(DW_AT::location) || d.has(DW_AT::const_value));
+}
+
+void addScopeChildren(Scope *scope, const die &d);
+
+std::unique_ptr<Scope> buildScope(const die &d, const die &cu, const Scope *parent) {
+    auto scope = std::make_unique<Scope>();
+    scope->die = d;
+    scope->cu = cu;
+    scope->parent = parent;
+    scope->ranges = rangesOf(d);
+    addScopeChildren(scope.get(), d);
+    return scope;
+}
+
+void addScopeChildren(Scope *scope, const die &d) {
+    for (const auto &child : d) {
+        if (isDefinedVariable(child)) {
+            scope->variables.push_back(child);
+        }
+        else if (child.tag == DW_TAG::lexical_block) {
+            if (child.has(DW_AT::low_pc) || child.has(DW_AT::ranges))
+                scope->blocks.push_back(buildScope(child, scope->cu, scope));
+            else
+                addScopeChildren(scope, child);
+        }
+    }
+}
+
+} // namespace
+
+std::string dieName(const dwarf::die &d) {
+    using namespace dwarf;
+    if (d.has(DW_AT::name)) return at_name(d);
+    if (d.has(DW_AT::specification)) return dieName(d[DW_AT::specification].as_reference());
+    return "";
+}
+
+bool Scope::contains(uint64_t pc) const {
+    return std::any_of(ranges.begin(), ranges.end(), [pc](const std::pair<uint64_t, uint64_t> &r) {
+        return r.first <= pc && pc < r.second;
+    });
+}
+
+void ScopeIndex::indexFunctions() {
+    ScopedTimer timer {stats().lookup("scope-index")};
+
+    // functions at CU level or in namespaces
+    for (const auto &cu : dw_.compilation_units()) {
+        std::vector<die> pending {cu.root()};
+        while (!pending.empty()) {
+            auto parent = pending.back();
+            pending.pop_back();
+            for (const auto &d : parent) {
+                if (d.tag == DW_TAG::namespace_) {
+                    pending.push_back(d);
+                    continue;
+                }
+                if (d.tag != DW_TAG::subprogram) continue;
+                auto ranges = rangesOf(d);
+                if (ranges.empty()) continue; // declaration or inlined only
+                for (const auto &r : ranges)
+                    ranges_.push_back({r.first, r.second, functions_.size()});
+                functions_.push_back({d, cu.root(), nullptr});
+            }
+        }
+    }
+    std::sort(ranges_.begin(), ranges_.end(),
+              [](const FunctionRange &a, const FunctionRange &b) { return a.low < b.low; });
+    functions_indexed_ = true;
+}
+
+const Scope *ScopeIndex::function(uint64_t pc) {
+    if (!functions_indexed_) indexFunctions();
+
+    auto it = std::upper_bound(ranges_.begin(), ranges_.end(), pc,
+                               [](uint64_t pc, const FunctionRange &r) { return pc < r.low; });
+    if (it == ranges_.begin() || pc >= std::prev(it)->high) return nullptr;
+
+    auto &f = functions_[std::prev(it)->function];
+    if (!f.tree) f.tree = buildScope(f.die, f.cu, nullptr);
+    return f.tree.get();
+}
+
+const Scope *ScopeIndex::innermost(uint64_t pc) {
+    auto scope = function(pc);
+    if (!scope) return nullptr;
+    for (;;) {
+        auto inner = std::find_if(scope->blocks.begin(), scope->blocks.end(),
+                                  [pc](const std::unique_ptr<Scope> &b) { return b->contains(pc); });
+        if (inner == scope->blocks.end()) return scope;
+        scope = inner->get();
+    }
+}
+
+bool ScopeIndex::findLocal(const Scope *scope, const std::string &name, dwarf::die *out) {
+    for (; scope; scope = scope->parent) {
+        for (const auto &v : scope->variables) {
+            if (dieName(v) != name) continue;
+            *out = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ScopeIndex::indexGlobals() {
+    ScopedTimer timer {stats().lookup("scope-index")};
+
+    for (const auto &cu : dw_.compilation_units()) {
+        auto cu_offset = cu.root().get_section_offset();
+        // (scope DIE, qualifying prefix)
+        std::vector<std::pair<die, std::string>> pending {{cu.root(), ""}};
+        while (!pending.empty()) {
+            auto parent = pending.back();
+            pending.pop_back();
+            for (const auto &d : parent.first) {
+                if (d.tag == DW_TAG::namespace_) {
+                    auto ns = d.has(DW_AT::name) ? at_name(d) + "::" : "";
+                    pending.emplace_back(d, parent.second + ns);
+                    continue;
+                }
+                if (d.tag != DW_TAG::variable || !isDefinedVariable(d)) continue;
+                auto name = dieName(d);
+                if (name.empty()) continue;
+                globals_.emplace(parent.second + name, std::make_pair(d, cu_offset));
+                if (!parent.second.empty()) globals_.emplace(name, std::make_pair(d, cu_offset));
+            }
+        }
+    }
+    globals_indexed_ = true;
+}
+
+bool ScopeIndex::findGlobal(const std::string &name, const dwarf::die &cu, dwarf::die *out) {
+    if (!globals_indexed_) indexGlobals();
+
+    auto matches = globals_.equal_range(name);
+    if (matches.first == matches.second) return false;
+
+    // a static of the current file wins over other files' globals
+    *out = matches.first->second.first;
+    if (!cu.valid()) return true;
+    auto cu_offset = cu.get_section_offset();
+    for (auto it = matches.first; it != matches.second; ++it) {
+        if (it->second.second == cu_offset) {
+            *out = it->second.first;
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+
+#include "signal-table.hh"
+
+namespace {
+
+const char *const signal_names[] = {
+    nullptr, "SIGHUP", "SIGINT", "SIGQUIT", "SIGILL", "SIGTRAP", "SIGABRT",
+    "SIGBUS", "SIGFPE", "SIGKILL", "SIGUSR1", "SIGSEGV", "SIGUSR2", "SIGPIPE",
+    "SIGALRM", "SIGTERM", "SIGSTKFLT", "SIGCHLD", "SIGCONT", "SIGSTOP",
+    "SIGTSTP", "SIGTTIN", "SIGTTOU", "SIGURG", "SIGXCPU", "SIGXFSZ",
+    "SIGVTALRM", "SIGPROF", "SIGWINCH", "SIGIO", "SIGPWR", "SIGSYS",
+};
+
+constexpr int named_signals = sizeof(signal_names) / sizeof(signal_names[0]);
+
+} // namespace
+
+SignalTable::SignalTable() {
+    for (auto sig : {SIGALRM, SIGURG, SIGCHLD, SIGWINCH, SIGPROF, SIGVTALRM, SIGIO, SIGPWR})
+        table_[sig] = {false, false, true};
+    table_[SIGINT].pass = false;
+}
+
+bool SignalTable::set(int sig, const std::vector<std::string> &keywords) {
+    auto d = table_.at(sig);
+    for (const auto &k : keywords) {
+        // stopping means printing, not printing means not stopping
+        if (k == "stop")         d.stop = d.print = true;
+        else if (k == "nostop")  d.stop = false;
+        else if (k == "print")   d.print = true;
+        else if (k == "noprint") d.print = d.stop = false;
+        else if (k == "pass")    d.pass = true;
+        else if (k == "nopass")  d.pass = false;
+        else return false;
+    }
+    table_[sig] = d;
+    return true;
+}
+
+void SignalTable::print(std::ostream &os, int sig) const {
+    os << std::left << std::setw(12) << "Signal" << "Stop  Print  Pass" << std::endl;
+    for (int s = sig ? sig : 1; s < (sig ? sig + 1 : NSIG); ++s) {
+        const auto &d = table_[s];
+        os << std::setw(12) << signalName(s) << std::setw(6) << (d.stop ? "Yes" : "No")
+           << std::setw(7) << (d.print ? "Yes" : "No") << (d.pass ? "Yes" : "No") << std::endl;
+    }
+    os << std::right;
+}
+
+int signalNumber(const std::string &name) {
+    if (!name.empty() && name.find_first_not_of("0123456789") == std::string::npos) {
+        auto sig = std::atoi(name.c_str());
+        return sig > 0 && sig < NSIG ? sig : 0;
+    }
+    std::string upper;
+    for (auto c : name) upper += std::toupper(static_cast<unsigned char>(c));
+    auto full = upper.compare(0, 3, "SIG") == 0 ? upper : "SIG" + upper;
+    for (int sig = 1; sig < named_signals; ++sig)
+        if (full == signal_names[sig]) return sig;
+    // SIG34 ... SIG64
+    if (full.size() > 3 && full.find_first_not_of("0123456789", 3) == std::string::npos)
+        return signalNumber(full.substr(3));
+    return 0;
+}
+
+std::string signalName(int sig) {
+    if (sig > 0 && sig < named_signals) return signal_names[sig];
+    return "SIG" + std::to_string(sig);
+}
@@ -0,0 +1,146 @@
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sys/wait.h>
+
+#include "stats.hh"
+
+namespace {
+
+const char *ptraceRequestName(int request) {
+    switch (request) {
+        case PTRACE_PEEKDATA:   return "PEEKDATA";
+        case PTRACE_POKEDATA:   return "POKEDATA";
+        case PTRACE_GETREGS:    return "GETREGS";
+        case PTRACE_SETREGS:    return "SETREGS";
+        case PTRACE_GETSIGINFO: return "GETSIGINFO";
+        case PTRACE_CONT:       return "CONT";
+        case PTRACE_SINGLESTEP: return "SINGLESTEP";
+        case PTRACE_SYSCALL:    return "SYSCALL";
+        case PTRACE_SETOPTIONS: return "SETOPTIONS";
+        case PTRACE_GETEVENTMSG: return "GETEVENTMSG";
+        case PTRACE_GETREGSET:  return "GETREGSET";
+        default:                return nullptr;
+    }
+}
+
+// nanoseconds, in the most readable unit
+std::string formatNs(uint64_t ns) {
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(1);
+    if (ns < 1000) os << ns << "ns";
+    else if (ns < 1000000) os << ns / 1e3 << "us";
+    else if (ns < 1000000000) os << ns / 1e6 << "ms";
+    else os << ns / 1e9 << "s";
+    return os.str();
+}
+
+void printHistogram(std::ostream &os, const std::string &name, const Histogram &h) {
+    if (!h.count()) return;
+    os << "  " << std::left << std::setw(20) << name << std::right
+       << std::setw(9) << h.count()
+       << "  total " << std::setw(8) << formatNs(h.totalNs())
+       << "  avg " << std::setw(8) << formatNs(h.totalNs() / h.count())
+       << "  p50 <" << std::setw(8) << formatNs(h.percentileNs(0.5))
+       << "  p99 <" << std::setw(8) << formatNs(h.percentileNs(0.99))
+       << "  max " << formatNs(h.maxNs()) << std::endl;
+}
+
+} // namespace
+
+void Histogram::add(std::chrono::nanoseconds d) {
+    uint64_t ns = d.count() > 0 ? d.count() : 0;
+    ++count_;
+    total_ns_ += ns;
+    if (ns > max_ns_) max_ns_ = ns;
+
+    // bucket i: [2^i, 2^(i+1)) ns
+    std::size_t bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= buckets_.size()) bucket = buckets_.size() - 1;
+    ++buckets_[bucket];
+}
+
+uint64_t Histogram::percentileNs(double p) const {
+    uint64_t rank = p * count_;
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets_.size(); ++i) {
+        seen += buckets_[i];
+        if (seen > rank || seen == count_) return uint64_t{2} << i;
+    }
+    return max_ns_;
+}
+
+Stats::Totals Stats::totals() const {
+    Totals t{};
+    for (const auto &h : ptrace_) {
+        t.ptrace_calls += h.second.count();
+        t.ptrace_ns += h.second.totalNs();
+    }
+    t.waits = waitpid_.count() + stop_wait_.count();
+    t.wait_ns = stop_wait_.totalNs() + waitpid_.totalNs();
+    for (const auto &h : lookups_) {
+        t.lookups += h.second.count();
+        t.lookup_ns += h.second.totalNs();
+    }
+    return t;
+}
+
+void Stats::print(std::ostream &os) const {
+    os << "Commands:" << std::endl;
+    for (const auto &h : commands_) printHistogram(os, h.first, h.second);
+
+    os << "ptrace:" << std::endl;
+    for (const auto &h : ptrace_) {
+        auto name = ptraceRequestName(h.first);
+        printHistogram(os, name ? name : "request " + std::to_string(h.first), h.second);
+    }
+
+    os << "Waits:" << std::endl;
+    printHistogram(os, "other waitpid", waitpid_);
+    printHistogram(os, "until stopped", stop_wait_);
+
+    os << "Lookups:" << std::endl;
+    for (const auto &h : lookups_) printHistogram(os, h.first, h.second);
+}
+
+void Stats::reset() {
+    ptrace_.clear();
+    waitpid_ = Histogram{};
+    stop_wait_ = Histogram{};
+    lookups_.clear();
+    commands_.clear();
+}
+
+Stats &stats() {
+    static Stats instance;
+    return instance;
+}
+
+CommandScope::CommandScope()
+    : before_{stats().totals()},
+      start_{std::chrono::steady_clock::now()} {}
+
+CommandScope::~CommandScope() {
+    if (name_.empty()) return;
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    stats().command(name_).add(elapsed);
+    if (!stats().trace) return;
+
+    auto after = stats().totals();
+    std::cerr << "[stats] " << name_ << ": "
+              << formatNs(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+              << ", " << after.ptrace_calls - before_.ptrace_calls << " ptrace ("
+              << formatNs(after.ptrace_ns - before_.ptrace_ns) << "), "
+              << after.waits - before_.waits << " waits ("
+              << formatNs(after.wait_ns - before_.wait_ns) << "), "
+              << after.lookups - before_.lookups << " lookups ("
+              << formatNs(after.lookup_ns - before_.lookup_ns) << ")" << std::endl;
+}
+
+pid_t countedWaitpid(pid_t pid, int *status, int options) {
+    // already part of the enclosing stop wait
+    if (stats().inStopWait()) return waitpid(pid, status, options);
+    ScopedTimer timer {stats().waitpidCalls()};
+    return waitpid(pid, status, options);
+}
@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#include "debugger.hh"
+#include "tracepoint.hh"
+
+namespace {
+
+// size of the code region holding the trampolines
+constexpr std::size_t trampoline_area_size = 1 << 16;
+
+// length of jmp rel32
+constexpr std::size_t jump_length = 5;
+
+static_assert(sizeof(TraceEvent) == 16, "trampolines index the ring with shl 4");
+static_assert(sizeof(TraceBufferHeader) <= trace_events_offset,
+              "ring overlaps header");
+
+void emit(std::vector<uint8_t> *code, std::initializer_list<uint8_t> bytes) {
+    code->insert(code->end(), bytes);
+}
+
+template <typename T>
+void emitValue(std::vector<uint8_t> *code, T value) {
+    uint8_t b[sizeof(T)];
+    std::memcpy(b, &value, sizeof(T));
+    code->insert(code->end(), b, b + sizeof(T));
+}
+
+} // namespace
+
+TraceAgent::~TraceAgent() {
+    if (header_) munmap(header_, data_size_);
+}
+
+bool TraceAgent::install(uint64_t anchor) {
+    // Trampolines have to be reachable with a rel32 jump
+    code_base_ = dbg_.allocateInferiorMemoryNear(anchor, trampoline_area_size,
+                                                 PROT_READ | PROT_EXEC);
+    if (!code_base_) {
+        std::cerr << "Couldn't map trampolines near 0x" << std::hex << anchor
+                  << std::endl;
+        return false;
+    }
+
+    // Shared buffer: a memfd created by the debuggee, which mdb maps
+    // through /proc/<pid>/fd. Its name is staged in the (still unused)
+    // trampoline area
+    const char name[] = "mdb-trace";
+    dbg_.writeMemoryBlock(code_base_, name, sizeof(name));
+    auto fd = dbg_.injectSyscall(SYS_memfd_create, code_base_, 0);
+    if (fd < 0) {
+        std::cerr << "memfd_create failed in debuggee: " << strerror(-fd)
+                  << std::endl;
+        return false;
+    }
+
+    data_size_ = trace_events_offset + trace_ring_capacity * sizeof(TraceEvent);
+    auto remote = dbg_.injectSyscall(SYS_ftruncate, fd, data_size_);
+    if (remote == 0) {
+        remote = dbg_.injectSyscall(SYS_mmap, 0, data_size_,
+                                    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    auto path = "/proc/" + std::to_string(dbg_.getPid()) + "/fd/" + std::to_string(fd);
+    auto local_fd = open(path.c_str(), O_RDWR);
+    dbg_.injectSyscall(SYS_close, fd);
+
+    if (remote < 0 || local_fd < 0) {
+        std::cerr << "Couldn't share trace buffer with debuggee" << std::endl;
+        if (local_fd >= 0) close(local_fd);
+        return false;
+    }
+
+    auto local = mmap(nullptr, data_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      local_fd, 0);
+    close(local_fd);
+    if (local == MAP_FAILED) {
+        std::cerr << "Couldn't map trace buffer" << std::endl;
+        return false;
+    }
+
+    data_remote_ = remote;
+    header_ = static_cast<TraceBufferHeader *>(local);
+    header_->capacity = trace_ring_capacity;
+    code_used_ = 16; // keep the staged name out of the way
+    return true;
+}
+
+const TraceEvent *TraceAgent::events() const {
+    return reinterpret_cast<const TraceEvent *>(
+            reinterpret_cast<const char *>(header_) + trace_events_offset);
+}
+
+bool TraceAgent::buildTrampoline(const Tracepoint &tp,
+                                 const std::vector<Instruction> &insns,
+                                 std::vector<uint8_t> *code) const {
+    auto hits = data_remote_ + offsetof(TraceBufferHeader, hits) + tp.id * sizeof(uint64_t);
+    auto head = data_remote_ + offsetof(TraceBufferHeader, head);
+    auto ring = data_remote_ + trace_events_offset;
+
+    code->clear();
+    emit(code, {0x48, 0x8d, 0x64, 0x24, 0x80});     // lea rsp, [rsp-128] (red zone)
+    emit(code, {0x9c, 0x50, 0x51, 0x52});           // pushfq; push rax; push rcx; push rdx
+
+    emit(code, {0x48, 0xb8}); emitValue(code, hits); // movabs rax, &hits[id]
+    emit(code, {0xf0, 0x48, 0xff, 0x00});           // lock inc qword [rax]
+
+    emit(code, {0x48, 0xb9}); emitValue(code, head); // movabs rcx, &head
+    emit(code, {0xb8, 0x01, 0x00, 0x00, 0x00});     // mov eax, 1
+    emit(code, {0xf0, 0x48, 0x0f, 0xc1, 0x01});     // lock xadd [rcx], rax
+    emit(code, {0x48, 0x25});                       // and rax, capacity - 1
+    emitValue(code, static_cast<uint32_t>(trace_ring_capacity - 1));
+    emit(code, {0x48, 0xc1, 0xe0, 0x04});           // shl rax, 4
+    emit(code, {0x48, 0xb9}); emitValue(code, ring); // movabs rcx, ring
+    emit(code, {0x48, 0x01, 0xc1});                 // add rcx, rax
+
+    emit(code, {0x0f, 0x31});                       // rdtsc
+    emit(code, {0x48, 0xc1, 0xe2, 0x20});           // shl rdx, 32
+    emit(code, {0x48, 0x09, 0xd0});                 // or rax, rdx
+    emit(code, {0x48, 0x89, 0x01});                 // mov [rcx], rax
+    emit(code, {0xc7, 0x41, 0x08});                 // mov dword [rcx+8], id
+    emitValue(code, static_cast<uint32_t>(tp.id));
+
+    emit(code, {0x5a, 0x59, 0x58, 0x9d});           // pop rdx; pop rcx; pop rax; popfq
+    emit(code, {0x48, 0x8d, 0xa4, 0x24, 0x80, 0x00, 0x00, 0x00}); // lea rsp, [rsp+128]
+
+    // displaced copy of the original instructions
+    std::vector<uint8_t> relocated;
+    for (const auto &insn : insns) {
+        if (!relocateInstruction(insn, tp.trampoline + code->size(), &relocated)) {
+            std::cerr << "Can't relocate instruction at 0x" << std::hex
+                      << insn.address << std::endl;
+            return false;
+        }
+        code->insert(code->end(), relocated.begin(), relocated.end());
+    }
+
+    // jump back right after the patched bytes
+    auto resume = tp.address + tp.saved.size();
+    auto jump_end = tp.trampoline + code->size() + jump_length;
+    if (!fitsRel32(jump_end, resume)) return false;
+    emit(code, {0xe9});
+    emitValue(code, static_cast<int32_t>(resume - jump_end));
+    return true;
+}
+
+bool TraceAgent::addTracepoint(uint64_t address, const std::string &description) {
+    if (!isInstalled() && !install(address)) return false;
+
+    if (next_id_ >= max_tracepoints) {
+        std::cerr << "Too many tracepoints" << std::endl;
+        return false;
+    }
+
+    // Decode enough whole instructions to fit a jmp rel32
+    uint8_t buf[jump_length + max_instruction_length];
+    if (!dbg_.readMemoryBlock(address, buf, sizeof(buf))) {
+        std::cerr << "Can't read memory at 0x" << std::hex << address << std::endl;
+        return false;
+    }
+
+    std::vector<Instruction> insns;
+    std::size_t covered = 0;
+    while (covered < jump_length) {
+        Instruction insn;
+        if (!decodeInstruction(buf + covered, sizeof(buf) - covered,
+                               address + covered, &insn)) {
+            std::cerr << "Can't decode instruction at 0x" << std::hex
+                      << address + covered << std::endl;
+            return false;
+        }
+        covered += insn.length;
+        insns.push_back(insn);
+
+        bool ends_block = insn.flow == FlowType::jump
+                       || insn.flow == FlowType::ret
+                       || insn.flow == FlowType::indirect_jump
+                       || insn.flow == FlowType::interrupt;
+        if (ends_block && covered < jump_length) {
+            std::cerr << "Not enough room for a jump at 0x" << std::hex
+                      << address << std::endl;
+            return false;
+        }
+    }
+
+    // the bytes after the jump trap: code branching there can't run
+    if (isBranchedInto(address, covered)) {
+        std::cerr << "A branch lands inside the jump at 0x" << std::hex << address
+                  << ", using a trap" << std::endl;
+        return addTrapTracepoint(address, description);
+    }
+
+    if (dbg_.hasBreakpointInRange(address, address + covered)) {
+        std::cerr << "Remove breakpoints near 0x" << std::hex << address
+                  << " first" << std::endl;
+        return false;
+    }
+    for (uint64_t a = address; a < address + covered; ++a) {
+        if (isPatched(a)) {
+            std::cerr << "Overlaps an existing tracepoint" << std::endl;
+            return false;
+        }
+    }
+    auto pc = dbg_.get_pc();
+    if (pc > address && pc < address + covered) {
+        std::cerr << "The debuggee is stopped inside the patched range" << std::endl;
+        return false;
+    }
+
+    Tracepoint tp;
+    tp.id = next_id_;
+    tp.address = address;
+    tp.trampoline = code_base_ + ((code_used_ + 15) & ~uint64_t{15});
+    tp.saved.assign(buf, buf + covered);
+    tp.description = description;
+
+    std::vector<uint8_t> code;
+    if (!buildTrampoline(tp, insns, &code)) return false;
+    if (tp.trampoline + code.size() > code_base_ + trampoline_area_size) {
+        std::cerr << "Out of trampoline space" << std::endl;
+        return false;
+    }
+    if (!fitsRel32(address + jump_length, tp.trampoline)) {
+        std::cerr << "Trampoline out of jump range" << std::endl;
+        return false;
+    }
+    tp.trampoline_end = tp.trampoline + code.size();
+    dbg_.writeMemoryBlock(tp.trampoline, code.data(), code.size());
+
+    // jmp trampoline, left-over bytes trap if anything jumps into them
+    std::vector<uint8_t> patch{0xe9};
+    emitValue(&patch, static_cast<int32_t>(tp.trampoline - (address + jump_length)));
+    patch.resize(covered, 0xcc);
+    dbg_.writeMemoryBlock(address, patch.data(), patch.size());
+
+    code_used_ = tp.trampoline_end - code_base_;
+    ++next_id_;
+    tracepoints_.push_back(tp);
+
+    std::cout << "Tracepoint " << std::dec << tp.id << " at address 0x"
+              << std::hex << address << std::endl;
+    return true;
+}
+
+bool TraceAgent::addTrapTracepoint(uint64_t address, const std::string &description) {
+    auto &breakpoints = dbg_.getBreakpoints();
+    if (breakpoints.count(address)) {
+        std::cerr << "Remove the breakpoint at 0x" << std::hex << address
+                  << " first" << std::endl;
+        return false;
+    }
+    if (isPatched(address)) {
+        std::cerr << "Overlaps an existing tracepoint" << std::endl;
+        return false;
+    }
+
+    // a breakpoint of the debugger's, so stepping past it works as usual
+    Breakpoint bp {dbg_.getPid(), static_cast<intptr_t>(address)};
+    bp.enable();
+    breakpoints[address] = bp;
+
+    Tracepoint tp;
+    tp.id = next_id_++;
+    tp.address = address;
+    tp.trampoline = tp.trampoline_end = 0;
+    tp.description = description;
+    tp.trap = true;
+    tracepoints_.push_back(tp);
+
+    std::cout << "Tracepoint " << std::dec << tp.id << " at address 0x"
+              << std::hex << address << " (trap)" << std::endl;
+    return true;
+}
+
+bool TraceAgent::isBranchedInto(uint64_t address, std::size_t length) {
+    uint64_t begin, end;
+    try {
+        auto func = dbg_.getFunctionFromPC(dbg_.offsetLoadAddress(address));
+        begin = dbg_.offsetDwarfAddress(at_low_pc(func));
+        end = dbg_.offsetDwarfAddress(at_high_pc(func));
+    } catch (std::out_of_range &) {
+        return true;
+    }
+
+    auto &insns = dbg_.disassembler().decodeRange(begin, end);
+    if (insns.empty()) return true;
+    for (const auto &insn : insns) {
+        bool direct = insn.flow == FlowType::jump || insn.flow == FlowType::cond_jump
+                   || insn.flow == FlowType::call;
+        if (insn.valid && direct && insn.target > address && insn.target < address + length)
+            return true;
+    }
+    return false;
+}
+
+bool TraceAgent::logTrapHit(uint64_t address) {
+    auto tp = std::find_if(tracepoints_.begin(), tracepoints_.end(),
+                           [address](auto &&tp) { return tp.trap && tp.address == address; });
+    if (tp == tracepoints_.end()) return false;
+    logEvent(tp->id);
+    return true;
+}
+
+// What a trampoline does, from mdb: the buffer is shared with it
+void TraceAgent::logEvent(unsigned id) {
+    __atomic_fetch_add(&header_->hits[id], 1, __ATOMIC_SEQ_CST);
+    auto slot = __atomic_fetch_add(&header_->head, 1, __ATOMIC_SEQ_CST) & (header_->capacity - 1);
+    auto ring = reinterpret_cast<TraceEvent *>(
+            reinterpret_cast<char *>(header_) + trace_events_offset);
+    ring[slot].tsc = __rdtsc();
+    ring[slot].id = id;
+}
+
+bool TraceAgent::removeTracepoint(unsigned id) {
+    auto it = std::find_if(tracepoints_.begin(), tracepoints_.end(),
+                           [id](auto &&tp) { return tp.id == id; });
+    if (it == tracepoints_.end()) {
+        std::cerr << "No tracepoint " << std::dec << id << std::endl;
+        return false;
+    }
+
+    auto pc = dbg_.get_pc();
+    if (pc >= it->trampoline && pc < it->trampoline_end) {
+        std::cerr << "The debuggee is stopped inside the trampoline" << std::endl;
+        return false;
+    }
+
+    if (it->trap) {
+        auto &breakpoints = dbg_.getBreakpoints();
+        auto bp = breakpoints.find(it->address);
+        if (bp != breakpoints.end()) {
+            if (bp->second.isEnabled()) bp->second.disable();
+            breakpoints.erase(bp);
+        }
+        tracepoints_.erase(it);
+        return true;
+    }
+
+    // the trampoline itself stays mapped; nothing jumps to it anymore
+    dbg_.writeMemoryBlock(it->address, it->saved.data(), it->saved.size());
+    tracepoints_.erase(it);
+    return true;
+}
+
+bool TraceAgent::isPatched(uint64_t address) const {
+    for (const auto &tp : tracepoints_)
+        if (address == tp.address
+                || (address > tp.address && address < tp.address + tp.saved.size()))
+            return true;
+    return false;
+}
+
+bool TraceAgent::isTrampoline(uint64_t address) const {
+    return code_base_ && address >= code_base_
+        && address < code_base_ + trampoline_area_size;
+}
+
+void TraceAgent::printStatus() const {
+    if (tracepoints_.empty()) {
+        std::cout << "No tracepoints" << std::endl;
+        return;
+    }
+    for (const auto &tp : tracepoints_) {
+        std::cout << std::dec << tp.id << ": 0x" << std::hex << tp.address
+                  << ' ' << tp.description << (tp.trap ? " (trap)" : "") << " hits "
+                  << std::dec << header_->hits[tp.id] << std::endl;
+    }
+
+    auto head = header_->head;
+    std::cout << std::dec << head << " events recorded";
+    if (head > header_->capacity)
+        std::cout << ", " << head - header_->capacity << " overwritten";
+    std::cout << std::endl;
+}
+
+void TraceAgent::printEvents(std::size_t n) const {
+    if (!isInstalled()) {
+        std::cout << "No events" << std::endl;
+        return;
+    }
+
+    auto head = header_->head;
+    auto first = head - std::min<uint64_t>({head, n, header_->capacity});
+    auto ring = events();
+    uint64_t start_tsc = 0;
+
+    for (auto i = first; i < head; ++i) {
+        const auto &ev = ring[i & (header_->capacity - 1)];
+        if (i == first) start_tsc = ev.tsc;
+
+        auto tp = std::find_if(tracepoints_.begin(), tracepoints_.end(),
+                               [&ev](auto &&tp) { return tp.id == ev.id; });
+        std::cout << "#" << std::dec << i << " +" << ev.tsc - start_tsc
+                  << " cycles tracepoint " << ev.id;
+        if (tp != tracepoints_.end()) std::cout << ' ' << tp->description;
+        std::cout << std::endl;
+    }
+}
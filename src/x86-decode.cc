@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "x86-decode.hh"
+
+namespace {
+
+// Operand layout of an opcode
+enum : unsigned {
+    kModrm   = 1 << 0,
+    kImm8    = 1 << 1,
+    kImm16   = 1 << 2,
+    kImmZ    = 1 << 3, // 16/32 bits depending on operand size
+    kImmV    = 1 << 4, // 16/32/64 bits (mov r, imm)
+    kMoffs   = 1 << 5, // 32/64 bits depending on address size
+    kRel8    = 1 << 6,
+    kRel32   = 1 << 7,
+    kInvalid = 1 << 8,
+};
+
+unsigned oneByteInfo(uint8_t op) {
+    if (op < 0x40) {
+        switch (op & 7) {
+            case 0: case 1: case 2: case 3: return kModrm;
+            case 4: return kImm8;
+            case 5: return kImmZ;
+            default: return kInvalid; // push/pop seg, daa, das, aaa, aas
+        }
+    }
+    if (op >= 0x50 && op <= 0x5f) return 0;
+    if (op >= 0x70 && op <= 0x7f) return kRel8;
+    if (op >= 0x84 && op <= 0x8f) return kModrm;
+    if (op >= 0x90 && op <= 0x9f) return op == 0x9a ? kInvalid : 0;
+    if (op >= 0xb0 && op <= 0xb7) return kImm8;
+    if (op >= 0xb8 && op <= 0xbf) return kImmV;
+    if (op >= 0xd8 && op <= 0xdf) return kModrm; // x87
+
+    switch (op) {
+        case 0x63: return kModrm;
+        case 0x68: return kImmZ;
+        case 0x69: return kModrm | kImmZ;
+        case 0x6a: return kImm8;
+        case 0x6b: return kModrm | kImm8;
+        case 0x6c: case 0x6d: case 0x6e: case 0x6f: return 0;
+        case 0x80: case 0x83: return kModrm | kImm8;
+        case 0x81: return kModrm | kImmZ;
+        case 0xa0: case 0xa1: case 0xa2: case 0xa3: return kMoffs;
+        case 0xa4: case 0xa5: case 0xa6: case 0xa7: return 0;
+        case 0xa8: return kImm8;
+        case 0xa9: return kImmZ;
+        case 0xaa: case 0xab: case 0xac:
+        case 0xad: case 0xae: case 0xaf: return 0;
+        case 0xc0: case 0xc1: return kModrm | kImm8;
+        case 0xc2: return kImm16;
+        case 0xc3: return 0;
+        case 0xc6: return kModrm | kImm8;
+        case 0xc7: return kModrm | kImmZ;
+        case 0xc8: return kImm16 | kImm8; // enter
+        case 0xc9: return 0;
+        case 0xca: return kImm16;
+        case 0xcb: case 0xcc: return 0;
+        case 0xcd: return kImm8;
+        case 0xcf: return 0;
+        case 0xd0: case 0xd1: case 0xd2: case 0xd3: return kModrm;
+        case 0xd7: return 0;
+        case 0xe0: case 0xe1: case 0xe2: case 0xe3: return kRel8;
+        case 0xe4: case 0xe5: case 0xe6: case 0xe7: return kImm8;
+        case 0xe8: case 0xe9: return kRel32;
+        case 0xeb: return kRel8;
+        case 0xec: case 0xed: case 0xee: case 0xef: return 0;
+        case 0xf1: case 0xf4: case 0xf5: return 0;
+        case 0xf6: case 0xf7: return kModrm; // test takes an immediate, see below
+        case 0xf8: case 0xf9: case 0xfa:
+        case 0xfb: case 0xfc: case 0xfd: return 0;
+        case 0xfe: case 0xff: return kModrm;
+    }
+    return kInvalid;
+}
+
+unsigned twoByteInfo(uint8_t op) {
+    if (op >= 0x80 && op <= 0x8f) return kRel32;  // jcc
+    if (op >= 0xc8 && op <= 0xcf) return 0;       // bswap
+    if (op >= 0x70 && op <= 0x73) return kModrm | kImm8;
+
+    switch (op) {
+        case 0x04: case 0x0a: case 0x0c:
+        case 0x24: case 0x25: case 0x26: case 0x27:
+        case 0x36: case 0x39: case 0x3b: case 0x3c:
+        case 0x3d: case 0x3e: case 0x3f:
+            return kInvalid;
+        case 0x05: case 0x06: case 0x07: case 0x08:
+        case 0x09: case 0x0b: case 0x0e:
+        case 0x30: case 0x31: case 0x32: case 0x33:
+        case 0x34: case 0x35: case 0x37: case 0x77:
+        case 0xa0: case 0xa1: case 0xa2:
+        case 0xa8: case 0xa9: case 0xaa:
+            return 0;
+        case 0x0f: // 3DNow!
+        case 0xa4: case 0xac: case 0xba:
+        case 0xc2: case 0xc4: case 0xc5: case 0xc6:
+            return kModrm | kImm8;
+    }
+    return kModrm;
+}
+
+// Does a VEX/EVEX opcode in map 0F carry an imm8?
+bool vexHasImm8(uint8_t map, uint8_t op) {
+    if (map == 3) return true;
+    if (map != 1) return false;
+    return (op >= 0x70 && op <= 0x73) || op == 0xc2
+        || op == 0xc4 || op == 0xc5 || op == 0xc6;
+}
+
+bool isLegacyPrefix(uint8_t b) {
+    switch (b) {
+        case 0xf0: case 0xf2: case 0xf3:
+        case 0x2e: case 0x36: case 0x3e: case 0x26:
+        case 0x64: case 0x65: case 0x66: case 0x67:
+            return true;
+    }
+    return false;
+}
+
+int64_t readSigned(const uint8_t *p, std::size_t size) {
+    switch (size) {
+        case 1: return static_cast<int8_t>(p[0]);
+        case 2: { int16_t v; std::memcpy(&v, p, 2); return v; }
+        case 4: { int32_t v; std::memcpy(&v, p, 4); return v; }
+        default: { int64_t v; std::memcpy(&v, p, 8); return v; }
+    }
+}
+
+FlowType classify(const Instruction &insn) {
+    auto op = insn.opcode;
+    if (insn.vex) return FlowType::none;
+
+    if (insn.map == 0) {
+        if ((op >= 0x70 && op <= 0x7f) || (op >= 0xe0 && op <= 0xe3))
+            return FlowType::cond_jump;
+        switch (op) {
+            case 0xe9: case 0xeb: return FlowType::jump;
+            case 0xe8: return FlowType::call;
+            case 0xc2: case 0xc3: case 0xca: case 0xcb: case 0xcf:
+                return FlowType::ret;
+            case 0xcc: case 0xcd: case 0xf1: case 0xf4:
+                return FlowType::interrupt;
+            case 0xff: {
+                auto reg = (insn.modrm >> 3) & 7;
+                if (reg == 2 || reg == 3) return FlowType::indirect_call;
+                if (reg == 4 || reg == 5) return FlowType::indirect_jump;
+                return FlowType::none;
+            }
+        }
+    }
+    else if (insn.map == 1) {
+        if (op >= 0x80 && op <= 0x8f) return FlowType::cond_jump;
+        if (op == 0x05 || op == 0x34) return FlowType::syscall;
+        if (op == 0x0b) return FlowType::interrupt; // ud2
+    }
+    return FlowType::none;
+}
+
+void appendLE32(std::vector<uint8_t> *out, int32_t v) {
+    uint8_t b[4];
+    std::memcpy(b, &v, 4);
+    out->insert(out->end(), b, b + 4);
+}
+
+} // namespace
+
+bool fitsRel32(uint64_t from, uint64_t to) {
+    auto delta = static_cast<int64_t>(to - from);
+    return delta >= std::numeric_limits<int32_t>::min()
+        && delta <= std::numeric_limits<int32_t>::max();
+}
+
+bool decodeInstruction(const uint8_t *bytes, std::size_t len,
+                       uint64_t address, Instruction *out) {
+    Instruction insn{};
+    insn.address = address;
+    insn.valid = true;
+    len = std::min(len, max_instruction_length);
+
+    std::size_t i = 0;
+    bool addr32 = false;
+
+    // legacy prefixes, then an optional REX right before the opcode
+    for (; i < len && isLegacyPrefix(bytes[i]); ++i) {
+        if (bytes[i] == 0x66) insn.operand16 = true;
+        if (bytes[i] == 0x67) addr32 = true;
+    }
+    if (i < len && (bytes[i] & 0xf0) == 0x40) insn.rex = bytes[i++];
+    if (i >= len) return false;
+
+    unsigned info;
+    auto lead = bytes[i];
+    if (lead == 0xc4 || lead == 0xc5 || lead == 0x62) {
+        // VEX (2/3 byte) and EVEX: payload, opcode, ModRM
+        std::size_t payload = lead == 0xc5 ? 1 : (lead == 0xc4 ? 2 : 3);
+        if (i + payload + 1 >= len) return false;
+        uint8_t map = lead == 0xc5
+                    ? 1 : bytes[i + 1] & (lead == 0xc4 ? 0x1f : 0x03);
+        if (map < 1 || map > 3) return false;
+        i += payload + 1;
+
+        insn.vex = true;
+        insn.map = map;
+        insn.opcode_offset = i;
+        insn.opcode = bytes[i++];
+        if (map == 1 && insn.opcode == 0x77) info = 0; // vzeroupper/vzeroall
+        else info = kModrm | (vexHasImm8(map, insn.opcode) ? kImm8 : 0);
+    }
+    else if (lead == 0x0f) {
+        if (i + 1 >= len) return false;
+        ++i;
+        if (bytes[i] == 0x38 || bytes[i] == 0x3a) {
+            insn.map = bytes[i] == 0x38 ? 2 : 3;
+            if (++i >= len) return false;
+            info = insn.map == 3 ? kModrm | kImm8 : kModrm;
+        } else {
+            insn.map = 1;
+            info = twoByteInfo(bytes[i]);
+        }
+        insn.opcode_offset = i;
+        insn.opcode = bytes[i++];
+    }
+    else {
+        insn.map = 0;
+        insn.opcode_offset = i;
+        insn.opcode = bytes[i++];
+        info = oneByteInfo(insn.opcode);
+    }
+    if (info & kInvalid) return false;
+
+    if (info & kModrm) {
+        if (i >= len) return false;
+        insn.has_modrm = true;
+        insn.modrm = bytes[i++];
+
+        auto mod = insn.modrm >> 6;
+        auto rm = insn.modrm & 7;
+        std::size_t disp = 0;
+        if (mod != 3) {
+            if (rm == 4) {
+                if (i >= len) return false;
+                insn.has_sib = true;
+                insn.sib = bytes[i++];
+                if (mod == 0 && (insn.sib & 7) == 5) disp = 4;
+            }
+            if (mod == 0 && rm == 5) {
+                insn.rip_relative = true;
+                disp = 4;
+            }
+            if (mod == 1) disp = 1;
+            if (mod == 2) disp = 4;
+        }
+        if (disp) {
+            insn.disp_offset = i;
+            insn.disp_size = disp;
+            i += disp;
+        }
+    }
+
+    std::size_t imm = 0;
+    if (info & kImm8)  imm += 1;
+    if (info & kImm16) imm += 2;
+    if (info & kImmZ)  imm += insn.operand16 ? 2 : 4;
+    if (info & kImmV)  imm += (insn.rex & 0x08) ? 8 : (insn.operand16 ? 2 : 4);
+    if (info & kMoffs) imm += addr32 ? 4 : 8;
+    if (info & kRel8)  imm += 1;
+    if (info & kRel32) imm += 4;
+    if (insn.map == 0 && (insn.opcode == 0xf6 || insn.opcode == 0xf7)
+            && ((insn.modrm >> 3) & 7) < 2) {
+        // test r/m, imm
+        imm += insn.opcode == 0xf6 ? 1 : (insn.operand16 ? 2 : 4);
+    }
+    if (imm) {
+        insn.imm_offset = i;
+        insn.imm_size = imm;
+        i += imm;
+    }
+
+    if (i > len) return false;
+    insn.length = i;
+    std::memcpy(insn.bytes, bytes, i);
+
+    insn.flow = classify(insn);
+    auto next = address + insn.length;
+    if (info & (kRel8 | kRel32)) {
+        insn.target = next + readSigned(bytes + insn.imm_offset, insn.imm_size);
+    }
+    else if (insn.rip_relative) {
+        insn.target = next + readSigned(bytes + insn.disp_offset, 4);
+    }
+
+    *out = insn;
+    return true;
+}
+
+bool relocateInstruction(const Instruction &insn, uint64_t new_address,
+                         std::vector<uint8_t> *out) {
+    out->clear();
+
+    bool direct_branch = insn.flow == FlowType::jump
+                      || insn.flow == FlowType::cond_jump
+                      || insn.flow == FlowType::call;
+    if (direct_branch) {
+        // loop/jrcxz only exist with a rel8 operand
+        if (insn.map == 0 && insn.opcode >= 0xe0 && insn.opcode <= 0xe3)
+            return false;
+
+        // re-encode as rel32, dropping branch hint prefixes
+        if (insn.map == 0 && (insn.opcode == 0xe9 || insn.opcode == 0xeb))
+            out->push_back(0xe9);
+        else if (insn.map == 0 && insn.opcode == 0xe8)
+            out->push_back(0xe8);
+        else if (insn.map == 0)
+            out->insert(out->end(), {0x0f, static_cast<uint8_t>(0x80 | (insn.opcode & 0x0f))});
+        else
+            out->insert(out->end(), {0x0f, insn.opcode});
+
+        auto end = new_address + out->size() + 4;
+        if (!fitsRel32(end, insn.target)) return false;
+        appendLE32(out, static_cast<int32_t>(insn.target - end));
+        return true;
+    }
+
+    out->assign(insn.bytes, insn.bytes + insn.length);
+    if (insn.rip_relative) {
+        auto end = new_address + insn.length;
+        if (!fitsRel32(end, insn.target)) return false;
+        auto disp = static_cast<int32_t>(insn.target - end);
+        std::memcpy(out->data() + insn.disp_offset, &disp, 4);
+    }
+    return true;
+}
@@ -0,0 +1,470 @@
+#include <cstring>
+#include <sstream>
+
+#include "x86-format.hh"
+
+namespace {
+
+const char *const gpr64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                             "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+const char *const gpr32[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                             "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+const char *const gpr16[] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+                             "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"};
+const char *const gpr8[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+                            "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+const char *const gpr8_legacy[] = {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"};
+
+const char *const conditions[] = {"o", "no", "b", "ae", "e", "ne", "be", "a",
+                                  "s", "ns", "p", "np", "l", "ge", "le", "g"};
+
+const char *const alu[] = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp"};
+const char *const shifts[] = {"rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar"};
+const char *const group3[] = {"test", "test", "not", "neg", "mul", "imul", "div", "idiv"};
+
+// Operand sizes, in bits. xmm: 128, none: no "PTR" annotation (lea)
+enum : unsigned { kNone = 0, kXmm = 128 };
+
+// Decoding state the mnemonic tables need
+struct Context {
+    const Instruction &insn;
+    bool rep;      // F3
+    bool repne;    // F2
+    bool opsize;   // 66
+    unsigned size; // GPR operand size: 16/32/64
+
+    unsigned rexW() const { return insn.rex & 0x08; }
+    unsigned reg() const { return ((insn.modrm >> 3) & 7) | ((insn.rex & 0x04) << 1); }
+    unsigned rm() const { return (insn.modrm & 7) | ((insn.rex & 0x01) << 3); }
+    unsigned ext() const { return (insn.modrm >> 3) & 7; }
+    bool memory() const { return insn.has_modrm && (insn.modrm >> 6) != 3; }
+};
+
+int64_t readSigned(const uint8_t *p, std::size_t size) {
+    switch (size) {
+        case 1: return static_cast<int8_t>(p[0]);
+        case 2: { int16_t v; std::memcpy(&v, p, 2); return v; }
+        case 4: { int32_t v; std::memcpy(&v, p, 4); return v; }
+        default: { int64_t v; std::memcpy(&v, p, 8); return v; }
+    }
+}
+
+std::string hex(uint64_t v) {
+    std::ostringstream os;
+    os << "0x" << std::hex << v;
+    return os.str();
+}
+
+std::string signedHex(int64_t v) {
+    return v < 0 ? "-" + hex(-static_cast<uint64_t>(v)) : hex(v);
+}
+
+std::string gpr(unsigned n, unsigned size, bool rex) {
+    switch (size) {
+        case 8: return rex ? gpr8[n] : (n < 8 ? gpr8_legacy[n] : gpr8[n]);
+        case 16: return gpr16[n];
+        case 32: return gpr32[n];
+        default: return gpr64[n];
+    }
+}
+
+std::string xmm(unsigned n) {
+    return "xmm" + std::to_string(n);
+}
+
+std::string sizePtr(unsigned size) {
+    switch (size) {
+        case 8: return "BYTE PTR ";
+        case 16: return "WORD PTR ";
+        case 32: return "DWORD PTR ";
+        case 64: return "QWORD PTR ";
+        case kXmm: return "XMMWORD PTR ";
+        default: return "";
+    }
+}
+
+std::string memoryOperand(const Context &c, unsigned size) {
+    const auto &insn = c.insn;
+    std::string out = sizePtr(size) + "[";
+    bool has_base = true, has_index = false;
+    unsigned base = c.rm(), index = 0, scale = 1;
+
+    if (insn.rip_relative) {
+        // the address, as branch targets are
+        return out + hex(insn.target) + "]";
+    }
+    if (insn.has_sib) {
+        base = (insn.sib & 7) | ((insn.rex & 0x01) << 3);
+        index = ((insn.sib >> 3) & 7) | ((insn.rex & 0x02) << 2);
+        scale = 1 << (insn.sib >> 6);
+        has_index = index != 4;
+        has_base = !((insn.sib & 7) == 5 && (insn.modrm >> 6) == 0);
+    }
+
+    if (has_base) out += gpr64[base];
+    if (has_index) {
+        if (has_base) out += "+";
+        out += gpr64[index];
+        if (scale > 1) out += "*" + std::to_string(scale);
+    }
+    if (insn.disp_size) {
+        auto disp = readSigned(insn.bytes + insn.disp_offset, insn.disp_size);
+        if (!has_base && !has_index) out += hex(static_cast<uint32_t>(disp));
+        else if (disp) out += (disp < 0 ? "-" : "+") + hex(disp < 0 ? -disp : disp);
+    }
+    return out + "]";
+}
+
+// ModRM r/m operand: a register of <size> bits or memory
+std::string rmOperand(const Context &c, unsigned size) {
+    if (c.memory()) return memoryOperand(c, size);
+    if (size == kXmm) return xmm(c.rm());
+    return gpr(c.rm(), size, c.insn.rex);
+}
+
+// ModRM r/m operand of an SSE instruction: xmm register or <size> bits of memory
+std::string xmmOperand(const Context &c, unsigned size) {
+    if (c.memory()) return memoryOperand(c, size);
+    return xmm(c.rm());
+}
+
+std::string regOperand(const Context &c, unsigned size) {
+    if (size == kXmm) return xmm(c.reg());
+    return gpr(c.reg(), size, c.insn.rex);
+}
+
+// Sign-extended into 64-bit operands (and pushes), else shown as the
+// unsigned value of the operand size
+std::string immediate(const Context &c) {
+    const auto &insn = c.insn;
+    auto value = readSigned(insn.bytes + insn.imm_offset, insn.imm_size);
+    bool push = insn.map == 0 && (insn.opcode == 0x68 || insn.opcode == 0x6a);
+    if (c.rexW() || push) return signedHex(value);
+
+    bool extended = insn.map == 0 && (insn.opcode == 0x83 || insn.opcode == 0x6b);
+    unsigned bits = extended ? c.size : insn.imm_size * 8;
+    return hex(bits >= 64 ? value : value & ((uint64_t{1} << bits) - 1));
+}
+
+std::string join(const std::string &mnemonic, const std::string &a = "",
+                 const std::string &b = "", const std::string &d = "") {
+    std::string out = mnemonic;
+    if (!a.empty()) out += " " + a;
+    if (!b.empty()) out += ", " + b;
+    if (!d.empty()) out += ", " + d;
+    return out;
+}
+
+std::string oneByte(const Context &c) {
+    const auto &insn = c.insn;
+    auto op = insn.opcode;
+    unsigned v = c.size;
+    unsigned stack = c.opsize ? 16 : 64; // push/pop/call/jmp operands
+
+    if (op < 0x40) {
+        auto name = alu[op >> 3];
+        switch (op & 7) {
+            case 0: return join(name, rmOperand(c, 8), regOperand(c, 8));
+            case 1: return join(name, rmOperand(c, v), regOperand(c, v));
+            case 2: return join(name, regOperand(c, 8), rmOperand(c, 8));
+            case 3: return join(name, regOperand(c, v), rmOperand(c, v));
+            case 4: return join(name, "al", immediate(c));
+            case 5: return join(name, gpr(0, v, false), immediate(c));
+        }
+    }
+    auto low = (op & 7) | ((insn.rex & 0x01) << 3);
+    if (op >= 0x50 && op <= 0x57) return join("push", gpr(low, stack, false));
+    if (op >= 0x58 && op <= 0x5f) return join("pop", gpr(low, stack, false));
+    if (op >= 0x70 && op <= 0x7f)
+        return join(std::string{"j"} + conditions[op & 0x0f], hex(insn.target));
+    if (op >= 0x91 && op <= 0x97) return join("xchg", gpr(low, v, false), gpr(0, v, false));
+    if (op >= 0xb0 && op <= 0xb7) return join("mov", gpr(low, 8, insn.rex), immediate(c));
+    if (op >= 0xb8 && op <= 0xbf)
+        return join(insn.imm_size == 8 ? "movabs" : "mov", gpr(low, v, false), immediate(c));
+    if (op >= 0xd8 && op <= 0xdf) return "(x87)";
+
+    switch (op) {
+        case 0x63: return join("movsxd", regOperand(c, v), rmOperand(c, 32));
+        case 0x68: case 0x6a: return join("push", immediate(c));
+        case 0x69: case 0x6b:
+            return join("imul", regOperand(c, v), rmOperand(c, v), immediate(c));
+        case 0x80: return join(alu[c.ext()], rmOperand(c, 8), immediate(c));
+        case 0x81: case 0x83: return join(alu[c.ext()], rmOperand(c, v), immediate(c));
+        case 0x84: return join("test", rmOperand(c, 8), regOperand(c, 8));
+        case 0x85: return join("test", rmOperand(c, v), regOperand(c, v));
+        case 0x86: return join("xchg", rmOperand(c, 8), regOperand(c, 8));
+        case 0x87: return join("xchg", rmOperand(c, v), regOperand(c, v));
+        case 0x88: return join("mov", rmOperand(c, 8), regOperand(c, 8));
+        case 0x89: return join("mov", rmOperand(c, v), regOperand(c, v));
+        case 0x8a: return join("mov", regOperand(c, 8), rmOperand(c, 8));
+        case 0x8b: return join("mov", regOperand(c, v), rmOperand(c, v));
+        case 0x8d: return join("lea", regOperand(c, v), rmOperand(c, kNone));
+        case 0x8f: return join("pop", rmOperand(c, stack));
+        case 0x90:
+            if (c.rep) return "pause";
+            if (insn.rex & 0x01) return join("xchg", gpr(8, v, false), gpr(0, v, false));
+            return c.opsize ? "xchg ax, ax" : "nop";
+        case 0x98: return v == 64 ? "cdqe" : (v == 16 ? "cbw" : "cwde");
+        case 0x99: return v == 64 ? "cqo" : (v == 16 ? "cwd" : "cdq");
+        case 0x9c: return "pushf";
+        case 0x9d: return "popf";
+        case 0xa0: return join("movabs", "al", "BYTE PTR [" + immediate(c) + "]");
+        case 0xa1: return join("movabs", gpr(0, v, false), sizePtr(v) + "[" + immediate(c) + "]");
+        case 0xa2: return join("movabs", "BYTE PTR [" + immediate(c) + "]", "al");
+        case 0xa3: return join("movabs", sizePtr(v) + "[" + immediate(c) + "]", gpr(0, v, false));
+        case 0xa8: return join("test", "al", immediate(c));
+        case 0xa9: return join("test", gpr(0, v, false), immediate(c));
+        case 0xc0: return join(shifts[c.ext()], rmOperand(c, 8), immediate(c));
+        case 0xc1: return join(shifts[c.ext()], rmOperand(c, v), immediate(c));
+        case 0xc2: return join("ret", immediate(c));
+        case 0xc3: return c.rep ? "repz ret" : "ret";
+        case 0xc6: return join("mov", rmOperand(c, 8), immediate(c));
+        case 0xc7: return join("mov", rmOperand(c, v), immediate(c));
+        case 0xc8: {
+            uint16_t frame;
+            std::memcpy(&frame, insn.bytes + insn.imm_offset, 2);
+            return join("enter", hex(frame), hex(insn.bytes[insn.imm_offset + 2]));
+        }
+        case 0xc9: return "leave";
+        case 0xca: return join("retf", immediate(c));
+        case 0xcb: return "retf";
+        case 0xcc: return "int3";
+        case 0xcd: return join("int", hex(insn.bytes[insn.imm_offset]));
+        case 0xcf: return "iret";
+        case 0xd0: return join(shifts[c.ext()], rmOperand(c, 8), "1");
+        case 0xd1: return join(shifts[c.ext()], rmOperand(c, v), "1");
+        case 0xd2: return join(shifts[c.ext()], rmOperand(c, 8), "cl");
+        case 0xd3: return join(shifts[c.ext()], rmOperand(c, v), "cl");
+        case 0xe0: return join("loopne", hex(insn.target));
+        case 0xe1: return join("loope", hex(insn.target));
+        case 0xe2: return join("loop", hex(insn.target));
+        case 0xe3: return join("jrcxz", hex(insn.target));
+        case 0xe8: return join("call", hex(insn.target));
+        case 0xe9: case 0xeb: return join("jmp", hex(insn.target));
+        case 0xf1: return "int1";
+        case 0xf4: return "hlt";
+        case 0xf5: return "cmc";
+        case 0xf6:
+            if (c.ext() < 2) return join("test", rmOperand(c, 8), immediate(c));
+            return join(group3[c.ext()], rmOperand(c, 8));
+        case 0xf7:
+            if (c.ext() < 2) return join("test", rmOperand(c, v), immediate(c));
+            return join(group3[c.ext()], rmOperand(c, v));
+        case 0xf8: return "clc";
+        case 0xf9: return "stc";
+        case 0xfa: return "cli";
+        case 0xfb: return "sti";
+        case 0xfc: return "cld";
+        case 0xfd: return "std";
+        case 0xfe:
+            if (c.ext() < 2) return join(c.ext() ? "dec" : "inc", rmOperand(c, 8));
+            break;
+        case 0xff:
+            switch (c.ext()) {
+                case 0: return join("inc", rmOperand(c, v));
+                case 1: return join("dec", rmOperand(c, v));
+                case 2: return join("call", rmOperand(c, 64));
+                case 3: return join("call far", rmOperand(c, kNone));
+                case 4: return join("jmp", rmOperand(c, 64));
+                case 5: return join("jmp far", rmOperand(c, kNone));
+                case 6: return join("push", rmOperand(c, stack));
+            }
+            break;
+    }
+
+    // string instructions
+    const char *string_op = nullptr;
+    switch (op) {
+        case 0xa4: case 0xa5: string_op = "movs"; break;
+        case 0xa6: case 0xa7: string_op = "cmps"; break;
+        case 0xaa: case 0xab: string_op = "stos"; break;
+        case 0xac: case 0xad: string_op = "lods"; break;
+        case 0xae: case 0xaf: string_op = "scas"; break;
+    }
+    if (string_op) {
+        const char *suffix = (op & 1) ? (v == 64 ? "q" : v == 16 ? "w" : "d") : "b";
+        std::string prefix = c.rep ? (op >= 0xa6 && (op <= 0xa7 || op >= 0xae) ? "repz " : "rep ")
+                                   : (c.repne ? "repnz " : "");
+        return prefix + string_op + suffix;
+    }
+    return "(unknown)";
+}
+
+// SSE: the mandatory prefix picks the variant (none/66/F3/F2)
+std::string sse(const Context &c, const char *ps, const char *pd,
+                const char *ss, const char *sd) {
+    const char *name = c.rep ? ss : c.repne ? sd : c.opsize ? pd : ps;
+    if (!name) return "(unknown)";
+    unsigned mem = c.rep ? 32 : c.repne ? 64 : kXmm;
+    return join(name, regOperand(c, kXmm), xmmOperand(c, mem));
+}
+
+// SSE2 integer instructions (66 prefix), xmm, xmm/m128
+const char *sseInteger(uint8_t op) {
+    switch (op) {
+        case 0x60: return "punpcklbw";
+        case 0x61: return "punpcklwd";
+        case 0x62: return "punpckldq";
+        case 0x63: return "packsswb";
+        case 0x64: return "pcmpgtb";
+        case 0x65: return "pcmpgtw";
+        case 0x66: return "pcmpgtd";
+        case 0x67: return "packuswb";
+        case 0x68: return "punpckhbw";
+        case 0x69: return "punpckhwd";
+        case 0x6a: return "punpckhdq";
+        case 0x6b: return "packssdw";
+        case 0x6c: return "punpcklqdq";
+        case 0x6d: return "punpckhqdq";
+        case 0x74: return "pcmpeqb";
+        case 0x75: return "pcmpeqw";
+        case 0x76: return "pcmpeqd";
+        case 0xd4: return "paddq";
+        case 0xdb: return "pand";
+        case 0xdf: return "pandn";
+        case 0xeb: return "por";
+        case 0xf8: return "psubb";
+        case 0xf9: return "psubw";
+        case 0xfa: return "psubd";
+        case 0xfb: return "psubq";
+        case 0xfc: return "paddb";
+        case 0xfd: return "paddw";
+        case 0xfe: return "paddd";
+    }
+    return nullptr;
+}
+
+std::string twoByte(const Context &c) {
+    const auto &insn = c.insn;
+    auto op = insn.opcode;
+    unsigned v = c.size;
+
+    if (op >= 0x40 && op <= 0x4f)
+        return join(std::string{"cmov"} + conditions[op & 0x0f], regOperand(c, v), rmOperand(c, v));
+    if (op >= 0x80 && op <= 0x8f)
+        return join(std::string{"j"} + conditions[op & 0x0f], hex(insn.target));
+    if (op >= 0x90 && op <= 0x9f)
+        return join(std::string{"set"} + conditions[op & 0x0f], rmOperand(c, 8));
+    if (op >= 0xc8 && op <= 0xcf)
+        return join("bswap", gpr((op & 7) | ((insn.rex & 0x01) << 3), v, false));
+
+    if (c.opsize && sseInteger(op))
+        return join(sseInteger(op), regOperand(c, kXmm), xmmOperand(c, kXmm));
+
+    switch (op) {
+        case 0x05: return "syscall";
+        case 0x0b: return "ud2";
+        case 0x1e:
+            if (c.rep && insn.modrm == 0xfa) return "endbr64";
+            if (c.rep && insn.modrm == 0xfb) return "endbr32";
+            return join("nop", rmOperand(c, v));
+        case 0x1f: return join("nop", rmOperand(c, v));
+        case 0x10: return sse(c, "movups", "movupd", "movss", "movsd");
+        case 0x11: {
+            const char *name = c.rep ? "movss" : c.repne ? "movsd" : c.opsize ? "movupd" : "movups";
+            unsigned mem = c.rep ? 32 : c.repne ? 64 : kXmm;
+            return join(name, xmmOperand(c, mem), regOperand(c, kXmm));
+        }
+        case 0x14: return sse(c, "unpcklps", "unpcklpd", nullptr, nullptr);
+        case 0x16: return sse(c, "movhps", "movhpd", "movshdup", nullptr);
+        case 0x28: return sse(c, "movaps", "movapd", nullptr, nullptr);
+        case 0x29: return join(c.opsize ? "movapd" : "movaps", rmOperand(c, kXmm), regOperand(c, kXmm));
+        case 0x2a:
+            if (!c.rep && !c.repne) break;
+            return join(c.rep ? "cvtsi2ss" : "cvtsi2sd", regOperand(c, kXmm),
+                        rmOperand(c, c.rexW() ? 64 : 32));
+        case 0x2c: case 0x2d:
+            if (!c.rep && !c.repne) break;
+            return join(std::string{op == 0x2c ? "cvtt" : "cvt"} + (c.rep ? "ss2si" : "sd2si"),
+                        gpr(c.reg(), c.rexW() ? 64 : 32, false), xmmOperand(c, c.rep ? 32 : 64));
+        case 0x2e: return join(c.opsize ? "ucomisd" : "ucomiss", regOperand(c, kXmm),
+                               xmmOperand(c, c.opsize ? 64 : 32));
+        case 0x2f: return join(c.opsize ? "comisd" : "comiss", regOperand(c, kXmm),
+                               xmmOperand(c, c.opsize ? 64 : 32));
+        case 0x31: return "rdtsc";
+        case 0x51: return sse(c, "sqrtps", "sqrtpd", "sqrtss", "sqrtsd");
+        case 0x54: return sse(c, "andps", "andpd", nullptr, nullptr);
+        case 0x55: return sse(c, "andnps", "andnpd", nullptr, nullptr);
+        case 0x56: return sse(c, "orps", "orpd", nullptr, nullptr);
+        case 0x57: return sse(c, "xorps", "xorpd", nullptr, nullptr);
+        case 0x58: return sse(c, "addps", "addpd", "addss", "addsd");
+        case 0x59: return sse(c, "mulps", "mulpd", "mulss", "mulsd");
+        case 0x5a: return sse(c, "cvtps2pd", "cvtpd2ps", "cvtss2sd", "cvtsd2ss");
+        case 0x5b: return sse(c, "cvtdq2ps", "cvtps2dq", "cvttps2dq", nullptr);
+        case 0x5c: return sse(c, "subps", "subpd", "subss", "subsd");
+        case 0x5d: return sse(c, "minps", "minpd", "minss", "minsd");
+        case 0x5e: return sse(c, "divps", "divpd", "divss", "divsd");
+        case 0x5f: return sse(c, "maxps", "maxpd", "maxss", "maxsd");
+        case 0x6e:
+            return join(c.rexW() ? "movq" : "movd", regOperand(c, kXmm), rmOperand(c, c.rexW() ? 64 : 32));
+        case 0x7e:
+            if (c.rep) return join("movq", regOperand(c, kXmm), xmmOperand(c, 64));
+            return join(c.rexW() ? "movq" : "movd", rmOperand(c, c.rexW() ? 64 : 32), regOperand(c, kXmm));
+        case 0x6f: return sse(c, nullptr, "movdqa", "movdqu", nullptr);
+        case 0x7f:
+            if (!c.opsize && !c.rep) break;
+            return join(c.rep ? "movdqu" : "movdqa", rmOperand(c, kXmm), regOperand(c, kXmm));
+        case 0xd6: return join("movq", xmmOperand(c, 64), regOperand(c, kXmm));
+        case 0x70:
+            if (!c.opsize) break;
+            return join("pshufd", regOperand(c, kXmm), xmmOperand(c, kXmm), immediate(c));
+        case 0xd7:
+            if (!c.opsize) break;
+            return join("pmovmskb", gpr(c.reg(), 32, false), xmm(c.rm()));
+        case 0xef: return sse(c, nullptr, "pxor", nullptr, nullptr);
+        case 0xa2: return "cpuid";
+        case 0xa3: return join("bt", rmOperand(c, v), regOperand(c, v));
+        case 0xa4: return join("shld", rmOperand(c, v), regOperand(c, v), immediate(c));
+        case 0xa5: return join("shld", rmOperand(c, v), regOperand(c, v), "cl");
+        case 0xab: return join("bts", rmOperand(c, v), regOperand(c, v));
+        case 0xac: return join("shrd", rmOperand(c, v), regOperand(c, v), immediate(c));
+        case 0xad: return join("shrd", rmOperand(c, v), regOperand(c, v), "cl");
+        case 0xaf: return join("imul", regOperand(c, v), rmOperand(c, v));
+        case 0xb3: return join("btr", rmOperand(c, v), regOperand(c, v));
+        case 0xbb: return join("btc", rmOperand(c, v), regOperand(c, v));
+        case 0xba: {
+            const char *const bits[] = {nullptr, nullptr, nullptr, nullptr, "bt", "bts", "btr", "btc"};
+            if (!bits[c.ext()]) break;
+            return join(bits[c.ext()], rmOperand(c, v), immediate(c));
+        }
+        case 0xb0: return join("cmpxchg", rmOperand(c, 8), regOperand(c, 8));
+        case 0xb1: return join("cmpxchg", rmOperand(c, v), regOperand(c, v));
+        case 0xb6: return join("movzx", regOperand(c, v), rmOperand(c, 8));
+        case 0xb7: return join("movzx", regOperand(c, v), rmOperand(c, 16));
+        case 0xbe: return join("movsx", regOperand(c, v), rmOperand(c, 8));
+        case 0xbf: return join("movsx", regOperand(c, v), rmOperand(c, 16));
+        case 0xbc: return join(c.rep ? "tzcnt" : "bsf", regOperand(c, v), rmOperand(c, v));
+        case 0xbd: return join(c.rep ? "lzcnt" : "bsr", regOperand(c, v), rmOperand(c, v));
+        case 0xb8: if (c.rep) return join("popcnt", regOperand(c, v), rmOperand(c, v)); break;
+        case 0xc0: return join("xadd", rmOperand(c, 8), regOperand(c, 8));
+        case 0xc1: return join("xadd", rmOperand(c, v), regOperand(c, v));
+    }
+    return "(unknown)";
+}
+
+} // namespace
+
+std::string formatInstruction(const Instruction &insn) {
+    if (!insn.valid) return "(bad)";
+    if (insn.vex) return "(vex)";
+
+    Context c {insn, false, false, false, 32};
+    for (std::size_t i = 0; i < insn.opcode_offset; ++i) {
+        switch (insn.bytes[i]) {
+            case 0xf3: c.rep = true; break;
+            case 0xf2: c.repne = true; break;
+            case 0x66: c.opsize = true; break;
+        }
+        if ((insn.bytes[i] & 0xf0) == 0x40 || insn.bytes[i] == 0x0f) break;
+    }
+    c.size = (insn.rex & 0x08) ? 64 : c.opsize ? 16 : 32;
+
+    bool lock = insn.opcode_offset && insn.bytes[0] == 0xf0;
+    std::string text;
+    switch (insn.map) {
+        case 0: text = oneByte(c); break;
+        case 1: text = twoByte(c); break;
+        default: text = "(unknown)"; break;
+    }
+    return lock ? "lock " + text : text;
+}